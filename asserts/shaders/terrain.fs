@@ -7,44 +7,27 @@ in vec2 Tex;
 in vec3 Pos;
 in vec3 Normal;
 
-uniform sampler2D gTextureHeight0;
-uniform sampler2D gTextureHeight1;
-uniform sampler2D gTextureHeight2;
-uniform sampler2D gTextureHeight3;
-
-uniform float gHeight0 = 64.0;
-uniform float gHeight1 = 128.0;
-uniform float gHeight2 = 193.0;
-uniform float gHeight3 = 256.0;
+uniform sampler2DArray gMaterials;     // one layer per material
+uniform sampler2DArray gSplatMap;      // weights of materials 4i .. 4i + 3 in layer i
+uniform int gNumMaterials;
+uniform vec4 gSplatTransform;          // splat map uv = Tex * xy + zw
 
 uniform vec3 gReversedLightDir;
 
 vec4 CalcTexColor() {
-   vec4 TexColor;
-   float Height = Pos.y;
-
-   if (Height < gHeight0) {
-      TexColor = texture(gTextureHeight0, Tex);
-   } else if (Height < gHeight1) {
-      vec4 Color0 = texture(gTextureHeight0, Tex);
-      vec4 Color1 = texture(gTextureHeight1, Tex);
-      float Delta = gHeight1 - gHeight0;
-      float Factor = (Height - gHeight0) / Delta;
-      TexColor = mix(Color0, Color1, Factor);
-   } else if (Height < gHeight2) {
-      vec4 Color0 = texture(gTextureHeight1, Tex);
-      vec4 Color1 = texture(gTextureHeight2, Tex);
-      float Delta = gHeight2 - gHeight1;
-      float Factor = (Height - gHeight1) / Delta;
-      TexColor = mix(Color0, Color1, Factor);
-   } else if (Height < gHeight3) {
-      vec4 Color0 = texture(gTextureHeight2, Tex);
-      vec4 Color1 = texture(gTextureHeight3, Tex);
-      float Delta = gHeight3 - gHeight2;
-      float Factor = (Height - gHeight2) / Delta;
-      TexColor = mix(Color0, Color1, Factor);
-   } else {
-      TexColor = texture(gTextureHeight3, Tex);
+   vec2 SplatUV = Tex * gSplatTransform.xy + gSplatTransform.zw;
+   // gradients taken outside the weight test, which is not uniform control flow
+   vec2 dx = dFdx(Tex);
+   vec2 dy = dFdy(Tex);
+
+   vec4 TexColor = vec4(0.0);
+   for (int i = 0; i < gNumMaterials; i += 4) {
+      vec4 Weights = texture(gSplatMap, vec3(SplatUV, float(i / 4)));
+      for (int k = 0; k < 4 && i + k < gNumMaterials; k++) {
+         if (Weights[k] > 0.0) {
+            TexColor += Weights[k] * textureGrad(gMaterials, vec3(Tex, float(i + k)), dx, dy);
+         }
+      }
    }
 
    return TexColor;
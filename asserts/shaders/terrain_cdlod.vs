@@ -0,0 +1,63 @@
+#version 420
+// CDLOD node: one instance of the shared grid mesh per selected quadtree node.
+// Vertices morph onto the next coarser grid over the node's morph band, so they
+// match the parent LOD exactly where the node's range ends. Outputs match terrain.fs.
+layout (location = 0) in vec2 aGrid;        // 0..1 within the node
+layout (location = 1) in vec4 aNode;        // origin x, origin z (cells), size (cells), lod
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+uniform float gMinHeight;
+uniform float gMaxHeight;
+
+uniform float gWorldScale;
+uniform int gGridSize;
+uniform float gGridRes;                 // cells of the mesh per node side
+uniform sampler2D gHeightMap;           // texel (z, x) = sample (x, z)
+uniform vec3 gCameraPos;                // terrain local space
+uniform vec2 gMorph[16];                // per lod: (morph start, morph end) distance
+uniform float gTexScale;
+uniform vec2 gTexOrigin;
+uniform float gTexPeriod;
+
+out vec4 Color;
+out vec2 Tex;
+out vec3 Pos;
+out vec3 Normal;
+
+float SampleHeight(vec2 Grid) {
+    return texture(gHeightMap, (Grid.yx + 0.5) / float(gGridSize)).r;
+}
+
+void main() {
+    float CellSize = aNode.z / gGridRes;
+    vec2 Cell = aGrid * gGridRes;
+    vec2 Grid = aNode.xy + Cell * CellSize;
+    vec3 Unmorphed = vec3(Grid.x * gWorldScale, SampleHeight(Grid), Grid.y * gWorldScale);
+
+    // odd vertices slide onto their even neighbours, which is the parent's mesh
+    vec2 Band = gMorph[int(aNode.w)];
+    float K = clamp((distance(Unmorphed, gCameraPos) - Band.x) / (Band.y - Band.x), 0.0, 1.0);
+    Cell -= fract(Cell * 0.5) * 2.0 * K;
+    Grid = aNode.xy + Cell * CellSize;
+    vec3 Position = vec3(Grid.x * gWorldScale, SampleHeight(Grid), Grid.y * gWorldScale);
+
+    gl_Position = projection * view * model * vec4(Position, 1.0);
+    Pos = mat3(model) * Position;
+    Tex = gTexScale * (gTexOrigin + Grid) / gTexPeriod;
+    float DeltaHeight = gMaxHeight - gMinHeight;
+    float HeightRatio = (Position.y - gMinHeight) / DeltaHeight;
+    float c = HeightRatio * 0.8 + 0.2;
+    Color = vec4(c, c, c, 1.0);
+
+    // central differences, as the CPU normals
+    float hl = SampleHeight(Grid - vec2(1.0, 0.0));
+    float hr = SampleHeight(Grid + vec2(1.0, 0.0));
+    float hd = SampleHeight(Grid - vec2(0.0, 1.0));
+    float hu = SampleHeight(Grid + vec2(0.0, 1.0));
+    vec3 n = normalize(vec3(hl - hr, 2.0 * gWorldScale, hd - hu));
+    mat3 normalMatrix = mat3(transpose(inverse(view * model)));
+    Normal = normalize(normalMatrix * n);
+}
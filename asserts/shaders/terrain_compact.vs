@@ -0,0 +1,48 @@
+#version 330
+// Compact terrain vertices: only the height and an octahedral normal are stored.
+// gl_VertexID is the grid index z * gGridWidth + x (BaseVertex included).
+layout (location = 0) in float aHeight;     // 0..1 within gHeightRange
+layout (location = 1) in vec2 aOctNormal;   // -1..1
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+uniform float gMinHeight;
+uniform float gMaxHeight;
+
+uniform int gGridWidth;
+uniform float gWorldScale;
+uniform vec2 gHeightRange;      // (min, max - min)
+uniform float gTexScale;
+uniform vec2 gTexOrigin;
+uniform float gTexPeriod;
+
+out vec4 Color;
+out vec2 Tex;
+out vec3 Pos;
+out vec3 Normal;
+
+vec3 OctDecode(vec2 e) {
+    vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+    float t = max(-n.y, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.z += n.z >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    int x = gl_VertexID % gGridWidth;
+    int z = gl_VertexID / gGridWidth;
+    vec3 Position = vec3(float(x) * gWorldScale, gHeightRange.x + aHeight * gHeightRange.y, float(z) * gWorldScale);
+
+    gl_Position = projection * view * model * vec4(Position, 1.0);
+    Pos = mat3(model) * Position;
+    Tex = gTexScale * (gTexOrigin + vec2(x, z)) / gTexPeriod;
+    float DeltaHeight = gMaxHeight - gMinHeight;
+    float HeightRatio = (Position.y - gMinHeight) / DeltaHeight;
+    float c = HeightRatio * 0.8 + 0.2;
+    Color = vec4(c, c, c, 1.0);
+    mat3 normalMatrix = mat3(transpose(inverse(view * model)));
+    Normal = normalize(normalMatrix * OctDecode(aOctNormal));
+}
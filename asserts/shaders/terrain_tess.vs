@@ -0,0 +1,12 @@
+#version 400
+// Patch corners of TessGrid, the heights are fetched in the tessellation stages.
+layout (location = 0) in vec2 aGrid;        // grid units
+layout (location = 1) in vec2 aBounds;      // patch (min, max) height
+
+out vec2 vGrid;
+out vec2 vBounds;
+
+void main() {
+    vGrid = aGrid;
+    vBounds = aBounds;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "core/qgearray.h"
+#include "core/qgetiledarray.h"
+#include "core/qgetime.h"
+#include "core/qgethreadpool.h"
+#include "function/render/midpoint_displacement.h"
+
+// Compares Array2d (row-major) with TiledArray2d on the neighbourhood kernels of the
+// terrain code: midpoint displacement, central-difference normals walked along
+// either axis, and a two-pass chamfer over a LOD map walked against the rows.
+// The tiled heights are checked against the row-major ones.
+
+template<typename HeightArray>
+static double Generate(HeightArray& HeightMap, int Size) {
+    HeightMap.set_all(Size, Size, 0.0f);
+    Timer timer;
+    timer.Start();
+    MidpointDisplacementParallel(HeightMap, Size, 1.0f, 1234u);
+    timer.Stop();
+    return timer.GetElapsedMilliseconds();
+}
+
+// slope (1 - normal.y) of every sample, ZInner walks along the rows of an Array2d
+template<typename HeightArray>
+static double Normals(const HeightArray& HeightMap, HeightArray& Slopes, int Size, bool ZInner, float& Check) {
+    Slopes.set_all(Size, Size, 0.0f);
+    Timer timer;
+    timer.Start();
+    for (int i = 1; i < Size - 1; i++) {
+        for (int j = 1; j < Size - 1; j++) {
+            int x = ZInner ? i : j, z = ZInner ? j : i;
+            float dx = HeightMap.get(x - 1, z) - HeightMap.get(x + 1, z);
+            float dz = HeightMap.get(x, z - 1) - HeightMap.get(x, z + 1);
+            *Slopes.get_a(x, z) = 1.0f - 2.0f / sqrtf(dx * dx + 4.0f + dz * dz);
+        }
+    }
+    timer.Stop();
+    Check = Slopes.get(Size / 2, Size / 2);
+    return timer.GetElapsedMilliseconds();
+}
+
+// LODManager::LimitNeighbourLods on a Size x Size map, rows in the inner loop
+template<typename LodArray>
+static double Chamfer(LodArray& Lods, int Size) {
+    Lods.set_all(Size, Size, 8);
+    for (int i = 0; i < Size; i += 97) Lods.set(i, (i * 31) % Size, 0);
+    Timer timer;
+    timer.Start();
+    for (int z = 0; z < Size; z++) {
+        for (int x = 0; x < Size; x++) {
+            int& Core = *Lods.get_a(x, z);
+            if (x > 0) Core = std::min(Core, Lods.get(x - 1, z) + 1);
+            if (z > 0) Core = std::min(Core, Lods.get(x, z - 1) + 1);
+        }
+    }
+    for (int z = Size - 1; z >= 0; z--) {
+        for (int x = Size - 1; x >= 0; x--) {
+            int& Core = *Lods.get_a(x, z);
+            if (x < Size - 1) Core = std::min(Core, Lods.get(x + 1, z) + 1);
+            if (z < Size - 1) Core = std::min(Core, Lods.get(x, z + 1) + 1);
+        }
+    }
+    timer.Stop();
+    return timer.GetElapsedMilliseconds();
+}
+
+int main(int argc, char** argv) {
+    int MaxSize = argc > 1 ? atoi(argv[1]) : 4097;
+
+    printf("%-8s %-22s %14s %14s %8s\n", "size", "kernel", "row-major (ms)", "tiled (ms)", "speedup");
+    for (int Size = 1025; Size <= MaxSize; Size = (Size - 1) * 2 + 1) {
+        Array2d<float> a, aSlopes, aBack;
+        TiledArray2d<float> t, tSlopes;
+
+        double ta = Generate(a, Size);
+        double tt = Generate(t, Size);
+        t.copy_to(aBack);
+        bool identical = memcmp(a.begin(), aBack.begin(), (size_t)Size * Size * sizeof(float)) == 0;
+        printf("%-8d %-22s %14.2f %14.2f %7.2fx %s\n", Size, "midpoint displacement", ta, tt, ta / tt,
+               identical ? "identical" : "DIFFERENT");
+
+        float ca, ct;
+        ta = Normals(a, aSlopes, Size, true, ca);
+        tt = Normals(t, tSlopes, Size, true, ct);
+        printf("%-8d %-22s %14.2f %14.2f %7.2fx\n", Size, "normals, z inner", ta, tt, ta / tt);
+        ta = Normals(a, aSlopes, Size, false, ca);
+        tt = Normals(t, tSlopes, Size, false, ct);
+        printf("%-8d %-22s %14.2f %14.2f %7.2fx\n", Size, "normals, x inner", ta, tt, ta / tt);
+
+        Array2d<int> la;
+        TiledArray2d<int> lt;
+        ta = Chamfer(la, Size);
+        tt = Chamfer(lt, Size);
+        printf("%-8d %-22s %14.2f %14.2f %7.2fx %s\n", Size, "LOD map chamfer", ta, tt, ta / tt,
+               la.get(Size / 3, Size / 3) == lt.get(Size / 3, Size / 3) ? "" : "DIFFERENT");
+    }
+    return 0;
+}
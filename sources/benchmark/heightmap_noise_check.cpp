@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "core/qgearray.h"
+#include "core/qgethreadpool.h"
+#include "function/render/heightmap_noise.h"
+
+// Headless checks of the CPU heightmap reference: SynthesizeHeights must give the
+// same bits for a fixed seed whatever the pool splits the rows into, and
+// ThermalErosion must only move material around. Returns nonzero on failure.
+
+static double Sum(const Array2d<float>& HeightMap) {
+    double s = 0.0;
+    for (size_t x = 0; x < HeightMap.raw(); x++) {
+        for (size_t z = 0; z < HeightMap.col(); z++) s += HeightMap.get(x, z);
+    }
+    return s;
+}
+
+static bool Identical(const Array2d<float>& a, const Array2d<float>& b) {
+    return a.raw() == b.raw() && a.col() == b.col() &&
+           memcmp(a.begin(), b.begin(), a.raw() * a.col() * sizeof(float)) == 0;
+}
+
+static bool CheckDeterminism(int Size, uint32_t Seed, int Iterations) {
+    HeightSynthParams Params;
+    Params.Size = Size;
+    Params.Seed = Seed;
+    Params.Ridged = 0.3f;
+    Params.ThermalIterations = Iterations;
+
+    Array2d<float> a, b, c;
+    SynthesizeHeights(Params, a);
+    SynthesizeHeights(Params, b);
+    SynthesizeHeights(Params, c, ThreadPool::Serial());
+    bool ok = Identical(a, b) && Identical(a, c);
+
+    Params.Seed = Seed + 1;
+    Array2d<float> d;
+    SynthesizeHeights(Params, d);
+    bool seeded = !Identical(a, d);
+
+    printf("%-28s size %5d seed %08x erosion %3d: %s%s\n", "SynthesizeHeights determinism", Size, Seed, Iterations,
+           ok ? "ok" : "FAILED", seeded ? "" : ", next seed gives the same map");
+    return ok && seeded;
+}
+
+static bool CheckMassConservation(int Size, uint32_t Seed, int Iterations, float Talus, float Rate) {
+    HeightSynthParams Params;
+    Params.Size = Size;
+    Params.Seed = Seed;
+    Array2d<float> HeightMap;
+    SynthesizeHeights(Params, HeightMap);
+
+    Array2d<float> Eroded(Size, Size);
+    memcpy(Eroded.begin(), HeightMap.begin(), (size_t)Size * Size * sizeof(float));
+    ThermalErosion(Eroded, Iterations, Talus, Rate);
+    double Before = Sum(HeightMap);
+    double After = Sum(Eroded);
+
+    // every pair moves the same float both ways, only the additions round; a map
+    // the erosion left alone would pass vacuously
+    double Error = fabs(After - Before) / fabs(Before);
+    bool moved = !Identical(HeightMap, Eroded);
+    bool ok = Error < 1e-5 && moved;
+    printf("%-28s size %5d seed %08x erosion %3d: sum %.6e -> %.6e, relative error %.2e %s\n",
+           "ThermalErosion mass", Size, Seed, Iterations, Before, After, Error,
+           ok ? "ok" : (moved ? "FAILED" : "FAILED, nothing moved"));
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    ok &= CheckDeterminism(257, 0u, 0);
+    ok &= CheckDeterminism(513, 0x1234abcdu, 16);
+    ok &= CheckMassConservation(257, 7u, 64, 0.25f, 0.2f);
+    ok &= CheckMassConservation(513, 0x1234abcdu, 32, 0.05f, 0.25f);
+    ok &= CheckMassConservation(1025, 42u, 8, 0.0f, 0.25f);
+    printf("%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "core/qgearray.h"
+#include "function/render/ocean/ocean_cpu.h"
+
+// Headless check of the OceanSimulatorCPU transform: the displacement field, and the
+// slopes and Jacobian of the gradient field, are recomputed from the same spectrum
+// with direct DFTs in double precision and compared texel by texel. N = 64 runs the
+// radix-2^2 stages only, N = 128 adds the odd radix-2 stage, so both kernels of
+// qgesimd.h are covered. Returns nonzero on failure.
+
+typedef std::complex<double> cdouble;
+
+// unnormalized e^{+i} DFT of N values Stride apart, as fft.comp
+static void DirectDFT(const cdouble* In, cdouble* Out, int N, int Stride) {
+    const double Pi = 3.14159265358979323846;
+    for (int k = 0; k < N; k++) {
+        cdouble Sum = 0.0;
+        for (int n = 0; n < N; n++) Sum += In[n * Stride] * std::polar(1.0, 2.0 * Pi * ((k * n) % N) / N);
+        Out[k * Stride] = Sum;
+    }
+}
+
+// rows then columns, In is overwritten
+static void DirectDFT2D(std::vector<cdouble>& In, int N) {
+    std::vector<cdouble> Tmp(In.size());
+    for (int y = 0; y < N; y++) DirectDFT(&In[y * N], &Tmp[y * N], N, 1);
+    for (int x = 0; x < N; x++) DirectDFT(&Tmp[x], &In[x], N, N);
+}
+
+static bool CheckSize(int N, float Time) {
+    OceanParams Params;
+    Params.DispMapSize = N;
+    std::vector<std::complex<float>> H0;
+    std::vector<float> Omega;
+    GenerateOceanSpectrum(H0, Omega, Params, 1234u);
+
+    OceanSimulatorCPU Sim;
+    Sim.Init(Params, H0, Omega);
+    Sim.Update(Time);
+    const Array2d<glm::vec4>& Disp = Sim.getDisplacement();
+
+    // spectrum.comp in double
+    std::vector<cdouble> Height(N * N), Choppy(N * N);
+    for (int y = 0; y < N; y++) {
+        for (int x = 0; x < N; x++) {
+            cdouble h0_k = H0[y * (N + 1) + x];
+            cdouble h0_mk = std::conj((cdouble)H0[(N - y) * (N + 1) + (N - x)]);
+            double wt = (double)Omega[y * (N + 1) + x] * Time;
+            cdouble h = h0_k * std::polar(1.0, wt) + h0_mk * std::polar(1.0, -wt);
+            double kx = N / 2 - x, ky = N / 2 - y;
+            double kn = sqrt(kx * kx + ky * ky);
+            double nx = kn > 0.0 ? kx / kn : 0.0, ny = kn > 0.0 ? ky / kn : 0.0;
+            Height[y * N + x] = h;
+            // Dt_x + i Dt_z
+            Choppy[y * N + x] = cdouble(h.imag() * nx + h.real() * ny, -h.real() * nx + h.imag() * ny);
+        }
+    }
+    // slope spectra: a central difference of the displacement is the spectrum times
+    // 2i sin(2 pi u / N) along x (v along y); the checkerboard sign flips between
+    // the two neighbours, gradient.comp's stencil comes out with -sign
+    const double Pi = 3.14159265358979323846;
+    std::vector<cdouble> HeightDx(N * N), HeightDy(N * N), ChoppyDx(N * N), ChoppyDy(N * N);
+    for (int v = 0; v < N; v++) {
+        for (int u = 0; u < N; u++) {
+            cdouble Kx(0.0, 2.0 * sin(2.0 * Pi * u / N)), Ky(0.0, 2.0 * sin(2.0 * Pi * v / N));
+            HeightDx[v * N + u] = Height[v * N + u] * Kx;
+            HeightDy[v * N + u] = Height[v * N + u] * Ky;
+            ChoppyDx[v * N + u] = Choppy[v * N + u] * Kx;
+            ChoppyDy[v * N + u] = Choppy[v * N + u] * Ky;
+        }
+    }
+    DirectDFT2D(Height, N);
+    DirectDFT2D(Choppy, N);
+    DirectDFT2D(HeightDx, N);
+    DirectDFT2D(HeightDy, N);
+    DirectDFT2D(ChoppyDx, N);
+    DirectDFT2D(ChoppyDy, N);
+
+    // displacement.comp and gradient.comp, errors relative to the largest value of
+    // each field
+    const Array2d<glm::vec4>& Grad = Sim.getGradients();
+    const double InvTileSize = N / Params.PatchSize, TileSizeX2 = Params.PatchSize * 2.0 / N;
+    double DispErr = 0.0, DispMax = 0.0, SlopeErr = 0.0, SlopeMax = 0.0, JacobianErr = 0.0, JacobianMax = 0.0;
+    for (int y = 0; y < N; y++) {
+        for (int x = 0; x < N; x++) {
+            int i = y * N + x;
+            double sign = ((x + y) & 1) ? -1.0 : 1.0;
+            glm::dvec3 Ref(sign * Choppy[i].real() * CHOPPY_LAMBDA, sign * Height[i].real(),
+                           sign * Choppy[i].imag() * CHOPPY_LAMBDA);
+            glm::dvec3 Err = glm::abs(glm::dvec3(Disp.get(y, x)) - Ref);
+            DispErr = std::max(DispErr, std::max(Err.x, std::max(Err.y, Err.z)));
+            DispMax = std::max(DispMax, std::max(fabs(Ref.x), std::max(fabs(Ref.y), fabs(Ref.z))));
+
+            // (left.y - right.y, bottom.y - top.y), right - left of Dx/Dz along x and y
+            glm::dvec2 Slope(sign * HeightDx[i].real(), sign * HeightDy[i].real());
+            glm::dvec2 dDx = -sign * CHOPPY_LAMBDA * InvTileSize * glm::dvec2(ChoppyDx[i].real(), ChoppyDx[i].imag());
+            glm::dvec2 dDy = -sign * CHOPPY_LAMBDA * InvTileSize * glm::dvec2(ChoppyDy[i].real(), ChoppyDy[i].imag());
+            double J = (1.0 + dDx.x) * (1.0 + dDy.y) - dDx.y * dDy.x;
+            glm::dvec4 Got(Grad.get(y, x));
+            SlopeErr = std::max(SlopeErr, std::max(fabs(Got.x - Slope.x), fabs(Got.y - Slope.y)));
+            SlopeMax = std::max(SlopeMax, std::max(fabs(Slope.x), fabs(Slope.y)));
+            JacobianErr = std::max(JacobianErr, std::max(fabs(Got.w - J), fabs(Got.z - TileSizeX2) / TileSizeX2));
+            JacobianMax = std::max(JacobianMax, fabs(J));
+        }
+    }
+    bool ok = true;
+    const char* Names[3] = { "displacement", "slopes", "jacobian" };
+    double Errs[3] = { DispErr, SlopeErr, JacobianErr }, Maxs[3] = { DispMax, SlopeMax, JacobianMax };
+    for (int f = 0; f < 3; f++) {
+        double Relative = Errs[f] / Maxs[f];
+        ok &= Relative < 1e-5;
+        printf("N %5d t %6.2f %-12s: max |value| %.4e, max error %.3e (relative %.3e) %s\n", N, Time, Names[f],
+               Maxs[f], Errs[f], Relative, Relative < 1e-5 ? "ok" : "FAILED");
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    for (int N = 64; N <= 256; N *= 2) {
+        ok &= CheckSize(N, 0.0f);
+        ok &= CheckSize(N, 7.3f);
+    }
+    printf("%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+    return ok ? 0 : 1;
+}
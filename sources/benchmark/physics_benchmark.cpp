@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <algorithm>
+
+#include "core/qgearray.h"
+#include "function/render/midpoint_displacement.h"
+#include "function/physics/physics_world.h"
+
+// Drops a few thousand bodies on a generated 513^2 heightfield and reports the
+// fixed step time for 1 .. N Jolt worker threads.
+static const int TERRAIN_SIZE = 513;
+static const float WORLD_SCALE = 2.0f;
+static const float MAX_HEIGHT = 256.0f;
+
+static void CreateHeightMap(Array2d<float>& HeightMap) {
+    HeightMap.set_all(TERRAIN_SIZE, TERRAIN_SIZE, 0.0f);
+    MidpointDisplacementParallel(HeightMap, TERRAIN_SIZE, 1.0f, 1234u);
+    HeightMap.normalize(0.0f, MAX_HEIGHT);
+}
+
+static void Run(const Array2d<float>& HeightMap, int NumBodies, int NumSteps, int NumThreads) {
+    PhysicsWorld world;
+    world.Init(65536, NumThreads);
+    world.SetTerrain(HeightMap, WORLD_SCALE, glm::vec3(0.0f));
+
+    // a square grid of bodies over the middle of the map, alternating spheres and boxes
+    int Side = 1;
+    while (Side * Side < NumBodies) Side++;
+    float Spacing = 3.0f;
+    float Origin = (TERRAIN_SIZE - 1) * WORLD_SCALE * 0.5f - Side * Spacing * 0.5f;
+    for (int i = 0; i < NumBodies; i++) {
+        glm::vec3 Pos(Origin + (i % Side) * Spacing, MAX_HEIGHT + 20.0f + (i & 7), Origin + (i / Side) * Spacing);
+        if (i & 1) world.AddBox(Pos, glm::vec3(0.5f));
+        else world.AddSphere(Pos, 0.5f);
+    }
+
+    double Total = 0.0, Worst = 0.0;
+    for (int i = 0; i < NumSteps; i++) {
+        world.Step(1);
+        Total += world.getStepMilliseconds();
+        Worst = std::max(Worst, world.getStepMilliseconds());
+    }
+    printf("%-8d %-8d %14.3f %14.3f %8d\n", NumThreads, NumBodies, Total / NumSteps, Worst, world.getNumActiveBodies());
+}
+
+int main(int argc, char** argv) {
+    int NumBodies = argc > 1 ? atoi(argv[1]) : 4096;
+    int NumSteps = argc > 2 ? atoi(argv[2]) : 600;
+
+    Array2d<float> HeightMap;
+    CreateHeightMap(HeightMap);
+
+    printf("%-8s %-8s %14s %14s %8s\n", "threads", "bodies", "avg step (ms)", "max step (ms)", "active");
+    int MaxThreads = (int)std::max(std::thread::hardware_concurrency(), 1u);
+    for (int NumThreads = 1; NumThreads <= MaxThreads; NumThreads *= 2) {
+        Run(HeightMap, NumBodies, NumSteps, NumThreads);
+    }
+    return 0;
+}
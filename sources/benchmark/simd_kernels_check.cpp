@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "core/qgearray.h"
+#include "core/qgesimd.h"
+
+// Headless check of Array2d::downsample2x / resample (SimdDownsample2x,
+// SimdResampleBilinear) against plain scalar loops, on odd and even sizes that
+// leave every number of remainder lanes. The kernels run in whatever instruction
+// set the build picked (QGE_ENABLE_AVX2 for AVX2). Returns nonzero on failure.
+
+static void Fill(Array2d<float>& a, size_t raw, size_t col, unsigned Seed) {
+    a.set_all(raw, col, 0.0f);
+    unsigned s = Seed * 2654435761u + 1u;
+    for (size_t i = 0; i < raw; i++) {
+        for (size_t j = 0; j < col; j++) {
+            s = s * 1664525u + 1013904223u;
+            a.set(i, j, (float)(s >> 8) / (float)(1u << 24) * 200.0f - 100.0f);
+        }
+    }
+}
+
+// [1 2 1] / 4 tent in both directions, clamped at the borders
+static float DownsampleRef(const Array2d<float>& a, size_t r, size_t c) {
+    static const int Taps[3] = { -1, 0, 1 };
+    static const double Weights[3] = { 0.25, 0.5, 0.25 };
+    double Sum = 0.0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            long y = std::min(std::max((long)(2 * r) + Taps[i], 0L), (long)a.raw() - 1);
+            long x = std::min(std::max((long)(2 * c) + Taps[j], 0L), (long)a.col() - 1);
+            Sum += Weights[i] * Weights[j] * a.get(y, x);
+        }
+    }
+    return (float)Sum;
+}
+
+// corner-aligned bilinear
+static float ResampleRef(const Array2d<float>& a, size_t raw, size_t col, size_t r, size_t c) {
+    double sy = raw > 1 ? (double)r * (a.raw() - 1) / (raw - 1) : 0.0;
+    double sx = col > 1 ? (double)c * (a.col() - 1) / (col - 1) : 0.0;
+    size_t y0 = std::min((size_t)sy, a.raw() - 1), x0 = std::min((size_t)sx, a.col() - 1);
+    size_t y1 = std::min(y0 + 1, a.raw() - 1), x1 = std::min(x0 + 1, a.col() - 1);
+    double fy = sy - y0, fx = sx - x0;
+    double top = a.get(y0, x0) + (a.get(y0, x1) - a.get(y0, x0)) * fx;
+    double bottom = a.get(y1, x0) + (a.get(y1, x1) - a.get(y1, x0)) * fx;
+    return (float)(top + (bottom - top) * fy);
+}
+
+int main() {
+    const size_t Sizes[] = { 1, 2, 3, 4, 5, 7, 8, 9, 10, 15, 16, 17, 18, 19, 23, 31, 32, 33, 34, 65, 129 };
+    const size_t NumSizes = sizeof(Sizes) / sizeof(Sizes[0]);
+    // the data spans [-100, 100], the float path rounds differently from the double reference
+    const float Tolerance = 2e-4f;
+    int Failures = 0;
+    float DownErr = 0.0f, ResampleErr = 0.0f;
+
+    for (size_t i = 0; i < NumSizes; i++) {
+        for (size_t j = 0; j < NumSizes; j++) {
+            Array2d<float> a, out;
+            Fill(a, Sizes[i], Sizes[j], (unsigned)(i * NumSizes + j));
+
+            a.downsample2x(out);
+            bool ok = out.raw() == (Sizes[i] + 1) / 2 && out.col() == (Sizes[j] + 1) / 2;
+            for (size_t r = 0; ok && r < out.raw(); r++) {
+                for (size_t c = 0; c < out.col(); c++) {
+                    float e = fabsf(out.get(r, c) - DownsampleRef(a, r, c));
+                    DownErr = std::max(DownErr, e);
+                    if (e > Tolerance) ok = false;
+                }
+            }
+            if (!ok) {
+                printf("downsample2x %zu x %zu FAILED\n", Sizes[i], Sizes[j]);
+                Failures++;
+            }
+
+            // up, down and the same size, each row length with its own remainder
+            const size_t Targets[3][2] = { { Sizes[i] * 2 + 1, Sizes[j] * 3 + 2 }, { Sizes[j], Sizes[i] }, { Sizes[i], Sizes[j] } };
+            for (int t = 0; t < 3; t++) {
+                size_t raw = Targets[t][0], col = Targets[t][1];
+                a.resample(out, raw, col);
+                ok = true;
+                for (size_t r = 0; ok && r < raw; r++) {
+                    for (size_t c = 0; c < col; c++) {
+                        float e = fabsf(out.get(r, c) - ResampleRef(a, raw, col, r, c));
+                        ResampleErr = std::max(ResampleErr, e);
+                        if (e > Tolerance) ok = false;
+                    }
+                }
+                if (!ok) {
+                    printf("resample %zu x %zu -> %zu x %zu FAILED\n", Sizes[i], Sizes[j], raw, col);
+                    Failures++;
+                }
+            }
+        }
+    }
+
+#if defined(QGE_SIMD_AVX2)
+    const char* Isa = "AVX2";
+#elif defined(QGE_SIMD_SSE2)
+    const char* Isa = "SSE2";
+#else
+    const char* Isa = "scalar";
+#endif
+    printf("%s kernels, %zu x %zu sizes: downsample2x max error %.2e, resample max error %.2e\n", Isa, NumSizes,
+           NumSizes, DownErr, ResampleErr);
+    printf("%s\n", Failures == 0 ? "all checks passed" : "CHECKS FAILED");
+    return Failures == 0 ? 0 : 1;
+}
@@ -4,6 +4,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <type_traits>
+
+#include "qgesimd.h"
+
+#define QGE_ARRAY_ALIGNMENT 32     // one AVX register
+
+inline void* AlignedMalloc(size_t size) {
+    size = (size + QGE_ARRAY_ALIGNMENT - 1) / QGE_ARRAY_ALIGNMENT * QGE_ARRAY_ALIGNMENT;
+#if defined(_WIN32)
+    return _aligned_malloc(size, QGE_ARRAY_ALIGNMENT);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, QGE_ARRAY_ALIGNMENT, size) != 0) return nullptr;
+    return p;
+#endif
+}
+
+inline void AlignedFree(void* p) {
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
 
 template<typename Type>
 class Array2d {
@@ -12,10 +36,29 @@ public:
     Array2d(size_t raw, size_t col) {
         mRaw = raw;
         mCol = col;
-        mp = (Type*)malloc(raw * col * sizeof(Type));
+        mp = (Type*)AlignedMalloc(raw * col * sizeof(Type));
     }
-    ~Array2d() { if (mp != nullptr) free(mp); }
-    void destroy() { if (mp != nullptr) free(mp); mp = nullptr; }
+    ~Array2d() { if (mp != nullptr) AlignedFree(mp); }
+    Array2d(const Array2d&) = delete;
+    Array2d& operator=(const Array2d&) = delete;
+    Array2d(Array2d&& other) noexcept : mRaw(other.mRaw), mCol(other.mCol), mp(other.mp) {
+        other.mRaw = other.mCol = 0;
+        other.mp = nullptr;
+    }
+    Array2d& operator=(Array2d&& other) noexcept {
+        if (this != &other) {
+            if (mp != nullptr) AlignedFree(mp);
+            mRaw = other.mRaw;
+            mCol = other.mCol;
+            mp = other.mp;
+            other.mRaw = other.mCol = 0;
+            other.mp = nullptr;
+        }
+        return *this;
+    }
+    void destroy() { if (mp != nullptr) AlignedFree(mp); mp = nullptr; }
+    size_t raw() const { return mRaw; }
+    size_t col() const { return mCol; }
     const Type& get(size_t raw, size_t col) const {
         return mp[raw * mCol + col];
     }
@@ -28,41 +71,66 @@ public:
     void set_all(size_t raw, size_t col, Type val) {
         mRaw = raw;
         mCol = col;
-        if (mp != nullptr) free(mp);
-        mp = (Type*)malloc(raw * col * sizeof(Type));
-        for (int i = 0; i < raw * col; i++) mp[i] = val;
+        if (mp != nullptr) AlignedFree(mp);
+        mp = (Type*)AlignedMalloc(raw * col * sizeof(Type));
+        if constexpr (std::is_same<Type, float>::value) {
+            SimdFill(mp, raw * col, val);
+        } else {
+            for (size_t i = 0; i < raw * col; i++) mp[i] = val;
+        }
     }
     void set(size_t raw, size_t col, const Type& val) {
         *get_a(raw, col) = val;
     }
     void set(size_t raw, size_t col, void *p) {
-        if (mp != nullptr) free(mp);
+        if (mp != nullptr) AlignedFree(mp);
         mRaw = raw;
         mCol = col;
-        mp = (Type*)malloc(raw * col * sizeof(Type));
+        mp = (Type*)AlignedMalloc(raw * col * sizeof(Type));
         memcpy(mp, p, raw * col * sizeof(Type));
     }
+    // takes ownership of a malloc'ed buffer
     void set_m(size_t raw, size_t col, void* p) {
-        if (mp != nullptr) free(mp);
-        mRaw = raw;
-        mCol = col;
-        mp = (Type*)malloc(raw * col * sizeof(Type));
-        mp = (Type*)p;
-        p = nullptr;
+        set(raw, col, p);
+        free(p);
     }
     Type* begin() const { return mp; }
+    void minmax(Type& MinValue, Type& MaxValue) const {
+        if constexpr (std::is_same<Type, float>::value) {
+            SimdMinMax(mp, mRaw * mCol, MinValue, MaxValue);
+        } else {
+            MinValue = MaxValue = mp[0];
+            for (size_t i = 1; i < mRaw * mCol; i++) {
+                if (mp[i] < MinValue) MinValue = mp[i];
+                if (mp[i] > MaxValue) MaxValue = mp[i];
+            }
+        }
+    }
     void normalize(Type MinRange, Type MaxRange) {
         Type minx, maxx;
-        minx = maxx = mp[0];
-        for (int i = 1; i < mRaw * mCol; i++) {
-            if (mp[i] < minx) minx = mp[i];
-            if (mp[i] > maxx) maxx = mp[i];
-        }
+        minmax(minx, maxx);
         if (maxx <= minx) return;
 
         Type delta = maxx - minx;
         Type range = MaxRange - MinRange;
-        for (int i = 0; i < mRaw * mCol; i++) mp[i] = (mp[i] - minx) / delta * range + MinRange;
+        if constexpr (std::is_same<Type, float>::value) {
+            float scale = range / delta;
+            SimdRemap(mp, mRaw * mCol, scale, MinRange - minx * scale);
+        } else {
+            for (size_t i = 0; i < mRaw * mCol; i++) mp[i] = (mp[i] - minx) / delta * range + MinRange;
+        }
+    }
+    // half resolution copy, see SimdDownsample2x
+    void downsample2x(Array2d<float>& out) const {
+        static_assert(std::is_same<Type, float>::value, "downsample2x is only implemented for float");
+        out.set_all((mRaw + 1) / 2, (mCol + 1) / 2, 0.0f);
+        SimdDownsample2x(mp, mRaw, mCol, out.begin());
+    }
+    // bilinear copy to raw x col samples
+    void resample(Array2d<float>& out, size_t raw, size_t col) const {
+        static_assert(std::is_same<Type, float>::value, "resample is only implemented for float");
+        out.set_all(raw, col, 0.0f);
+        SimdResampleBilinear(mp, mRaw, mCol, out.begin(), raw, col);
     }
 
 private:
@@ -70,4 +138,4 @@ private:
     Type* mp = nullptr;
 };
 
-#endif // !__QGE_ARRAY_H__
\ No newline at end of file
+#endif // !__QGE_ARRAY_H__
@@ -0,0 +1,34 @@
+#ifndef __QGE_HASH_H__
+#define __QGE_HASH_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// 64-bit FNV-1a over 8-byte words, with a byte-wise tail. Not cryptographic,
+// only used to identify content (heightmaps, cooked caches).
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull) {
+    const uint64_t prime = 0x100000001b3ull;
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t hash = seed;
+
+    size_t words = size / sizeof(uint64_t);
+    for (size_t i = 0; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, p + i * sizeof(uint64_t), sizeof(uint64_t));
+        hash ^= w;
+        hash *= prime;
+        hash ^= hash >> 32;
+    }
+    for (size_t i = words * sizeof(uint64_t); i < size; i++) {
+        hash ^= p[i];
+        hash *= prime;
+    }
+    return hash;
+}
+
+template<typename T>
+inline uint64_t HashValue(const T& value, uint64_t seed = 0xcbf29ce484222325ull) {
+    return HashBytes(&value, sizeof(T), seed);
+}
+
+#endif // !__QGE_HASH_H__
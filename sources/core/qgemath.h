@@ -39,6 +39,25 @@ inline float RandomFloatRange(float Start, float End) {
     return RandomValue;
 }
 
+// Counter-based random numbers: the value only depends on the key, not on how
+// many numbers were drawn before, so generators can run in any order/thread.
+inline uint64_t SplitMix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+inline float CounterRandomFloat(uint32_t Seed, uint32_t Level, uint32_t x, uint32_t z) {
+    uint64_t h = SplitMix64(((uint64_t)Seed << 32) | Level);
+    h = SplitMix64(h ^ (((uint64_t)x << 32) | z));
+    return (float)(h >> 40) * (1.0f / 16777216.0f);     // 24 bits -> [0, 1)
+}
+
+inline float CounterRandomFloatRange(float Start, float End, uint32_t Seed, uint32_t Level, uint32_t x, uint32_t z) {
+    return CounterRandomFloat(Seed, Level, x, z) * (End - Start) + Start;
+}
+
 inline uint32_t Log2OfPow2(uint32_t x)
 {
 	uint32_t ret = 0;
@@ -0,0 +1,88 @@
+#include "qgemmap.h"
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+bool MappedFile::Open(const char* path) {
+    Close();
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (p == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    mFile = file;
+    mMapping = mapping;
+    mData = (const unsigned char*)p;
+    mSize = (size_t)size.QuadPart;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (mData != nullptr) UnmapViewOfFile(mData);
+    if (mMapping != nullptr) CloseHandle((HANDLE)mMapping);
+    if (mFile != nullptr) CloseHandle((HANDLE)mFile);
+    mData = nullptr;
+    mMapping = nullptr;
+    mFile = nullptr;
+    mSize = 0;
+}
+
+#else
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool MappedFile::Open(const char* path) {
+    Close();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0 || stat_buf.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* p = mmap(NULL, (size_t)stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    mFd = fd;
+    mData = (const unsigned char*)p;
+    mSize = (size_t)stat_buf.st_size;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (mData != nullptr) munmap((void*)mData, mSize);
+    if (mFd >= 0) close(mFd);
+    mData = nullptr;
+    mFd = -1;
+    mSize = 0;
+}
+
+#endif
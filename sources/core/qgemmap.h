@@ -0,0 +1,31 @@
+#ifndef __QGE_MMAP_H__
+#define __QGE_MMAP_H__
+
+#include <stdlib.h>
+
+// Read-only memory mapped file. Pages are only faulted in when touched.
+class MappedFile {
+public:
+    MappedFile() {};
+    ~MappedFile() { Close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const char* path);
+    void Close();
+    bool IsOpen() const { return mData != nullptr; }
+    const unsigned char* data() const { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    const unsigned char* mData = nullptr;
+    size_t mSize = 0;
+#ifdef _WIN32
+    void* mFile = nullptr;
+    void* mMapping = nullptr;
+#else
+    int mFd = -1;
+#endif
+};
+
+#endif // !__QGE_MMAP_H__
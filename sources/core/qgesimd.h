@@ -0,0 +1,378 @@
+#ifndef __QGE_SIMD_H__
+#define __QGE_SIMD_H__
+
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+// Bulk float kernels. The instruction set is picked at compile time: AVX2 when
+// the compiler targets it (-mavx2, /arch:AVX2, see QGE_ENABLE_AVX2), SSE2 on any
+// x86-64 build, plain C++ otherwise. All loads are unaligned so any pointer works,
+// Array2d storage is 32-byte aligned so the aligned case is the fast one.
+#if defined(__AVX2__)
+#define QGE_SIMD_AVX2 1
+#define QGE_SIMD_SSE2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QGE_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+inline void SimdFill(float* p, size_t n, float v) {
+    size_t i = 0;
+#if defined(QGE_SIMD_AVX2)
+    __m256 v8 = _mm256_set1_ps(v);
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(p + i, v8);
+#elif defined(QGE_SIMD_SSE2)
+    __m128 v4 = _mm_set1_ps(v);
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(p + i, v4);
+#endif
+    for (; i < n; i++) p[i] = v;
+}
+
+// min and max in a single pass
+inline void SimdMinMax(const float* p, size_t n, float& outMin, float& outMax) {
+    if (n == 0) return;
+    float mn = p[0], mx = p[0];
+    size_t i = 0;
+#if defined(QGE_SIMD_AVX2)
+    if (n >= 8) {
+        __m256 vmin = _mm256_loadu_ps(p), vmax = vmin;
+        for (i = 8; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_loadu_ps(p + i);
+            vmin = _mm256_min_ps(vmin, v);
+            vmax = _mm256_max_ps(vmax, v);
+        }
+        float lmin[8], lmax[8];
+        _mm256_storeu_ps(lmin, vmin);
+        _mm256_storeu_ps(lmax, vmax);
+        for (int k = 0; k < 8; k++) {
+            mn = std::min(mn, lmin[k]);
+            mx = std::max(mx, lmax[k]);
+        }
+    }
+#elif defined(QGE_SIMD_SSE2)
+    if (n >= 4) {
+        __m128 vmin = _mm_loadu_ps(p), vmax = vmin;
+        for (i = 4; i + 4 <= n; i += 4) {
+            __m128 v = _mm_loadu_ps(p + i);
+            vmin = _mm_min_ps(vmin, v);
+            vmax = _mm_max_ps(vmax, v);
+        }
+        float lmin[4], lmax[4];
+        _mm_storeu_ps(lmin, vmin);
+        _mm_storeu_ps(lmax, vmax);
+        for (int k = 0; k < 4; k++) {
+            mn = std::min(mn, lmin[k]);
+            mx = std::max(mx, lmax[k]);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        mn = std::min(mn, p[i]);
+        mx = std::max(mx, p[i]);
+    }
+    outMin = mn;
+    outMax = mx;
+}
+
+// p[i] = p[i] * scale + bias
+inline void SimdRemap(float* p, size_t n, float scale, float bias) {
+    size_t i = 0;
+#if defined(QGE_SIMD_AVX2)
+    __m256 s8 = _mm256_set1_ps(scale), b8 = _mm256_set1_ps(bias);
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(p + i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p + i), s8), b8));
+#elif defined(QGE_SIMD_SSE2)
+    __m128 s4 = _mm_set1_ps(scale), b4 = _mm_set1_ps(bias);
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(p + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p + i), s4), b4));
+#endif
+    for (; i < n; i++) p[i] = p[i] * scale + bias;
+}
+
+// dst[i] = a[i] * wa + b[i] * wb + c[i] * wc
+inline void SimdBlend3(const float* a, const float* b, const float* c, float* dst, size_t n, float wa, float wb, float wc) {
+    size_t i = 0;
+#if defined(QGE_SIMD_AVX2)
+    __m256 a8 = _mm256_set1_ps(wa), b8 = _mm256_set1_ps(wb), c8 = _mm256_set1_ps(wc);
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(a + i), a8);
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_loadu_ps(b + i), b8));
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_loadu_ps(c + i), c8));
+        _mm256_storeu_ps(dst + i, v);
+    }
+#elif defined(QGE_SIMD_SSE2)
+    __m128 a4 = _mm_set1_ps(wa), b4 = _mm_set1_ps(wb), c4 = _mm_set1_ps(wc);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(a + i), a4);
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(b + i), b4));
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(c + i), c4));
+        _mm_storeu_ps(dst + i, v);
+    }
+#endif
+    for (; i < n; i++) dst[i] = a[i] * wa + b[i] * wb + c[i] * wc;
+}
+
+// Halves a srcRows x srcCols grid into ((srcRows + 1) / 2) x ((srcCols + 1) / 2) with a
+// [1 2 1] / 4 tent in both directions, clamped at the borders. Sample 2i of the source
+// lands on sample i of the destination, so 2^n + 1 maps keep their corners.
+inline void SimdDownsample2x(const float* src, size_t srcRows, size_t srcCols, float* dst) {
+    size_t dstRows = (srcRows + 1) / 2;
+    size_t dstCols = (srcCols + 1) / 2;
+    std::vector<float> row(srcCols + 8);
+
+    for (size_t r = 0; r < dstRows; r++) {
+        size_t c = 2 * r;
+        const float* up   = src + (c > 0 ? c - 1 : 0) * srcCols;
+        const float* mid  = src + c * srcCols;
+        const float* down = src + std::min(c + 1, srcRows - 1) * srcCols;
+        SimdBlend3(up, mid, down, row.data(), srcCols, 0.25f, 0.5f, 0.25f);
+
+        const float* v = row.data();
+        float* out = dst + r * dstCols;
+        out[0] = 0.75f * v[0] + 0.25f * v[std::min<size_t>(1, srcCols - 1)];
+        size_t j = 1;
+#if defined(QGE_SIMD_SSE2)
+        // out[j] = (v[2j - 1] + 2 v[2j] + v[2j + 1]) / 4, deinterleaved with shuffles
+        __m128 quarter = _mm_set1_ps(0.25f), half = _mm_set1_ps(0.5f);
+        for (; 2 * j + 8 < srcCols && j + 4 <= dstCols; j += 4) {
+            __m128 a0 = _mm_loadu_ps(v + 2 * j), a1 = _mm_loadu_ps(v + 2 * j + 4);
+            __m128 b0 = _mm_loadu_ps(v + 2 * j - 1), b1 = _mm_loadu_ps(v + 2 * j + 3);
+            __m128 even = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 odd  = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+            __m128 prev = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 res = _mm_add_ps(_mm_mul_ps(even, half), _mm_mul_ps(_mm_add_ps(odd, prev), quarter));
+            _mm_storeu_ps(out + j, res);
+        }
+#endif
+        for (; j < dstCols; j++) {
+            size_t k = 2 * j;
+            float next = v[std::min(k + 1, srcCols - 1)];
+            out[j] = 0.25f * v[k - 1] + 0.5f * v[k] + 0.25f * next;
+        }
+    }
+}
+
+// Bilinear resample with corner-aligned sample positions (the first and last rows/columns
+// of src and dst coincide).
+inline void SimdResampleBilinear(const float* src, size_t srcRows, size_t srcCols,
+                                 float* dst, size_t dstRows, size_t dstCols) {
+    // positions in double, a float j * ratio is off by a few 1e-5 texels on large maps
+    double ry = dstRows > 1 ? (double)(srcRows - 1) / (double)(dstRows - 1) : 0.0;
+    double rx = dstCols > 1 ? (double)(srcCols - 1) / (double)(dstCols - 1) : 0.0;
+
+    // horizontal taps are the same for every row
+    std::vector<int> idx(dstCols);
+    std::vector<float> w(dstCols);
+    for (size_t j = 0; j < dstCols; j++) {
+        double sx = j * rx;
+        int i0 = std::min((int)sx, (int)srcCols - 2 >= 0 ? (int)srcCols - 2 : 0);
+        idx[j] = i0;
+        w[j] = srcCols > 1 ? (float)(sx - i0) : 0.0f;
+    }
+
+    std::vector<float> row(srcCols + 1);
+    for (size_t r = 0; r < dstRows; r++) {
+        double sy = r * ry;
+        size_t r0 = std::min((size_t)sy, srcRows > 1 ? srcRows - 2 : 0);
+        size_t r1 = std::min(r0 + 1, srcRows - 1);
+        float fy = (float)(sy - r0);
+        SimdBlend3(src + r0 * srcCols, src + r1 * srcCols, src + r1 * srcCols, row.data(), srcCols, 1.0f - fy, fy, 0.0f);
+        row[srcCols] = row[srcCols - 1];
+
+        float* out = dst + r * dstCols;
+        size_t j = 0;
+#if defined(QGE_SIMD_AVX2)
+        for (; j + 8 <= dstCols; j += 8) {
+            __m256i i8 = _mm256_loadu_si256((const __m256i*)&idx[j]);
+            __m256 w8 = _mm256_loadu_ps(&w[j]);
+            __m256 a = _mm256_i32gather_ps(row.data(), i8, 4);
+            __m256 b = _mm256_i32gather_ps(row.data() + 1, i8, 4);
+            _mm256_storeu_ps(out + j, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), w8)));
+        }
+#elif defined(QGE_SIMD_SSE2)
+        for (; j + 4 <= dstCols; j += 4) {
+            __m128 a = _mm_setr_ps(row[idx[j]], row[idx[j + 1]], row[idx[j + 2]], row[idx[j + 3]]);
+            __m128 b = _mm_setr_ps(row[idx[j] + 1], row[idx[j + 1] + 1], row[idx[j + 2] + 1], row[idx[j + 3] + 1]);
+            __m128 w4 = _mm_loadu_ps(&w[j]);
+            _mm_storeu_ps(out + j, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), w4)));
+        }
+#endif
+        for (; j < dstCols; j++) {
+            float a = row[idx[j]], b = row[idx[j] + 1];
+            out[j] = a + (b - a) * w[j];
+        }
+    }
+}
+
+// Heightmap normals by central differences for one row of samples. prev/cur/next are
+// three consecutive rows (the caller clamps them at the borders), invTwoSpacing is
+// 1 / (2 * sample spacing). Outputs the normalized (-dh/drow, 1, -dh/dcol) as SoA.
+inline void SimdHeightNormals(const float* prev, const float* cur, const float* next, size_t n, float invTwoSpacing,
+                              float* nx, float* ny, float* nz) {
+    if (n == 0) return;
+    auto Scalar = [&](size_t i) {
+        float left  = cur[i > 0 ? i - 1 : 0];
+        float right = cur[i + 1 < n ? i + 1 : n - 1];
+        float x = (prev[i] - next[i]) * invTwoSpacing;
+        float z = (left - right) * invTwoSpacing;
+        float inv = 1.0f / sqrtf(x * x + 1.0f + z * z);
+        nx[i] = x * inv;
+        ny[i] = inv;
+        nz[i] = z * inv;
+    };
+
+    Scalar(0);
+    size_t i = 1;
+#if defined(QGE_SIMD_AVX2)
+    __m256 k8 = _mm256_set1_ps(invTwoSpacing), one8 = _mm256_set1_ps(1.0f);
+    for (; i + 8 < n; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(prev + i), _mm256_loadu_ps(next + i)), k8);
+        __m256 z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(cur + i - 1), _mm256_loadu_ps(cur + i + 1)), k8);
+        __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(z, z)), one8);
+        __m256 inv = _mm256_div_ps(one8, _mm256_sqrt_ps(len2));
+        _mm256_storeu_ps(nx + i, _mm256_mul_ps(x, inv));
+        _mm256_storeu_ps(ny + i, inv);
+        _mm256_storeu_ps(nz + i, _mm256_mul_ps(z, inv));
+    }
+#elif defined(QGE_SIMD_SSE2)
+    __m128 k4 = _mm_set1_ps(invTwoSpacing), one4 = _mm_set1_ps(1.0f);
+    for (; i + 4 < n; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(prev + i), _mm_loadu_ps(next + i)), k4);
+        __m128 z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(cur + i - 1), _mm_loadu_ps(cur + i + 1)), k4);
+        __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z)), one4);
+        __m128 inv = _mm_div_ps(one4, _mm_sqrt_ps(len2));
+        _mm_storeu_ps(nx + i, _mm_mul_ps(x, inv));
+        _mm_storeu_ps(ny + i, inv);
+        _mm_storeu_ps(nz + i, _mm_mul_ps(z, inv));
+    }
+#endif
+    for (; i < n; i++) Scalar(i);
+}
+
+// Radix-2 butterfly over n lanes of split complex rows: t = w * b, a' = a + t,
+// b' = a - t. Every lane shares the twiddle w, so n independent transforms (the
+// columns of a row-major block) advance together.
+inline void SimdButterfly2(float* aRe, float* aIm, float* bRe, float* bIm, size_t n, float wRe, float wIm) {
+    size_t i = 0;
+#if defined(QGE_SIMD_AVX2)
+    __m256 wr8 = _mm256_set1_ps(wRe), wi8 = _mm256_set1_ps(wIm);
+    for (; i + 8 <= n; i += 8) {
+        __m256 ar = _mm256_loadu_ps(aRe + i), ai = _mm256_loadu_ps(aIm + i);
+        __m256 br = _mm256_loadu_ps(bRe + i), bi = _mm256_loadu_ps(bIm + i);
+        __m256 tr = _mm256_sub_ps(_mm256_mul_ps(wr8, br), _mm256_mul_ps(wi8, bi));
+        __m256 ti = _mm256_add_ps(_mm256_mul_ps(wr8, bi), _mm256_mul_ps(wi8, br));
+        _mm256_storeu_ps(aRe + i, _mm256_add_ps(ar, tr));
+        _mm256_storeu_ps(aIm + i, _mm256_add_ps(ai, ti));
+        _mm256_storeu_ps(bRe + i, _mm256_sub_ps(ar, tr));
+        _mm256_storeu_ps(bIm + i, _mm256_sub_ps(ai, ti));
+    }
+#elif defined(QGE_SIMD_SSE2)
+    __m128 wr4 = _mm_set1_ps(wRe), wi4 = _mm_set1_ps(wIm);
+    for (; i + 4 <= n; i += 4) {
+        __m128 ar = _mm_loadu_ps(aRe + i), ai = _mm_loadu_ps(aIm + i);
+        __m128 br = _mm_loadu_ps(bRe + i), bi = _mm_loadu_ps(bIm + i);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(wr4, br), _mm_mul_ps(wi4, bi));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(wr4, bi), _mm_mul_ps(wi4, br));
+        _mm_storeu_ps(aRe + i, _mm_add_ps(ar, tr));
+        _mm_storeu_ps(aIm + i, _mm_add_ps(ai, ti));
+        _mm_storeu_ps(bRe + i, _mm_sub_ps(ar, tr));
+        _mm_storeu_ps(bIm + i, _mm_sub_ps(ai, ti));
+    }
+#endif
+    for (; i < n; i++) {
+        float tr = wRe * bRe[i] - wIm * bIm[i];
+        float ti = wRe * bIm[i] + wIm * bRe[i];
+        float ar = aRe[i], ai = aIm[i];
+        aRe[i] = ar + tr;
+        aIm[i] = ai + ti;
+        bRe[i] = ar - tr;
+        bIm[i] = ai - ti;
+    }
+}
+
+// Two radix-2 stages fused (radix-2^2) on the rows r[0..3] = x, x + h, x + 2h, x + 3h:
+// r0/r1 and r2/r3 with twiddle w1, then r0/r2 with w2 and r1/r3 with i * w2.
+// Halves the passes over the data compared with two SimdButterfly2 stages.
+inline void SimdButterfly4(float* const Re[4], float* const Im[4], size_t n, float w1Re, float w1Im, float w2Re, float w2Im) {
+    // t = w * b; a + t, a - t
+    auto Scalar = [&](size_t i) {
+        float b0r, b0i, b1r, b1i, b2r, b2i, b3r, b3i, tr, ti;
+        tr = w1Re * Re[1][i] - w1Im * Im[1][i];
+        ti = w1Re * Im[1][i] + w1Im * Re[1][i];
+        b0r = Re[0][i] + tr; b0i = Im[0][i] + ti;
+        b1r = Re[0][i] - tr; b1i = Im[0][i] - ti;
+        tr = w1Re * Re[3][i] - w1Im * Im[3][i];
+        ti = w1Re * Im[3][i] + w1Im * Re[3][i];
+        b2r = Re[2][i] + tr; b2i = Im[2][i] + ti;
+        b3r = Re[2][i] - tr; b3i = Im[2][i] - ti;
+
+        tr = w2Re * b2r - w2Im * b2i;
+        ti = w2Re * b2i + w2Im * b2r;
+        Re[0][i] = b0r + tr; Im[0][i] = b0i + ti;
+        Re[2][i] = b0r - tr; Im[2][i] = b0i - ti;
+        // i * w2 = (-w2Im, w2Re)
+        tr = -w2Im * b3r - w2Re * b3i;
+        ti = -w2Im * b3i + w2Re * b3r;
+        Re[1][i] = b1r + tr; Im[1][i] = b1i + ti;
+        Re[3][i] = b1r - tr; Im[3][i] = b1i - ti;
+    };
+
+    size_t i = 0;
+#if defined(QGE_SIMD_AVX2)
+    __m256 w1r = _mm256_set1_ps(w1Re), w1i = _mm256_set1_ps(w1Im);
+    __m256 w2r = _mm256_set1_ps(w2Re), w2i = _mm256_set1_ps(w2Im);
+    for (; i + 8 <= n; i += 8) {
+        __m256 r0 = _mm256_loadu_ps(Re[0] + i), i0 = _mm256_loadu_ps(Im[0] + i);
+        __m256 r1 = _mm256_loadu_ps(Re[1] + i), i1 = _mm256_loadu_ps(Im[1] + i);
+        __m256 r2 = _mm256_loadu_ps(Re[2] + i), i2 = _mm256_loadu_ps(Im[2] + i);
+        __m256 r3 = _mm256_loadu_ps(Re[3] + i), i3 = _mm256_loadu_ps(Im[3] + i);
+        __m256 tr = _mm256_sub_ps(_mm256_mul_ps(w1r, r1), _mm256_mul_ps(w1i, i1));
+        __m256 ti = _mm256_add_ps(_mm256_mul_ps(w1r, i1), _mm256_mul_ps(w1i, r1));
+        __m256 b0r = _mm256_add_ps(r0, tr), b0i = _mm256_add_ps(i0, ti);
+        __m256 b1r = _mm256_sub_ps(r0, tr), b1i = _mm256_sub_ps(i0, ti);
+        tr = _mm256_sub_ps(_mm256_mul_ps(w1r, r3), _mm256_mul_ps(w1i, i3));
+        ti = _mm256_add_ps(_mm256_mul_ps(w1r, i3), _mm256_mul_ps(w1i, r3));
+        __m256 b2r = _mm256_add_ps(r2, tr), b2i = _mm256_add_ps(i2, ti);
+        __m256 b3r = _mm256_sub_ps(r2, tr), b3i = _mm256_sub_ps(i2, ti);
+
+        tr = _mm256_sub_ps(_mm256_mul_ps(w2r, b2r), _mm256_mul_ps(w2i, b2i));
+        ti = _mm256_add_ps(_mm256_mul_ps(w2r, b2i), _mm256_mul_ps(w2i, b2r));
+        _mm256_storeu_ps(Re[0] + i, _mm256_add_ps(b0r, tr)); _mm256_storeu_ps(Im[0] + i, _mm256_add_ps(b0i, ti));
+        _mm256_storeu_ps(Re[2] + i, _mm256_sub_ps(b0r, tr)); _mm256_storeu_ps(Im[2] + i, _mm256_sub_ps(b0i, ti));
+        tr = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_add_ps(_mm256_mul_ps(w2i, b3r), _mm256_mul_ps(w2r, b3i)));
+        ti = _mm256_sub_ps(_mm256_mul_ps(w2r, b3r), _mm256_mul_ps(w2i, b3i));
+        _mm256_storeu_ps(Re[1] + i, _mm256_add_ps(b1r, tr)); _mm256_storeu_ps(Im[1] + i, _mm256_add_ps(b1i, ti));
+        _mm256_storeu_ps(Re[3] + i, _mm256_sub_ps(b1r, tr)); _mm256_storeu_ps(Im[3] + i, _mm256_sub_ps(b1i, ti));
+    }
+#elif defined(QGE_SIMD_SSE2)
+    __m128 w1r = _mm_set1_ps(w1Re), w1i = _mm_set1_ps(w1Im);
+    __m128 w2r = _mm_set1_ps(w2Re), w2i = _mm_set1_ps(w2Im);
+    for (; i + 4 <= n; i += 4) {
+        __m128 r0 = _mm_loadu_ps(Re[0] + i), i0 = _mm_loadu_ps(Im[0] + i);
+        __m128 r1 = _mm_loadu_ps(Re[1] + i), i1 = _mm_loadu_ps(Im[1] + i);
+        __m128 r2 = _mm_loadu_ps(Re[2] + i), i2 = _mm_loadu_ps(Im[2] + i);
+        __m128 r3 = _mm_loadu_ps(Re[3] + i), i3 = _mm_loadu_ps(Im[3] + i);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(w1r, r1), _mm_mul_ps(w1i, i1));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(w1r, i1), _mm_mul_ps(w1i, r1));
+        __m128 b0r = _mm_add_ps(r0, tr), b0i = _mm_add_ps(i0, ti);
+        __m128 b1r = _mm_sub_ps(r0, tr), b1i = _mm_sub_ps(i0, ti);
+        tr = _mm_sub_ps(_mm_mul_ps(w1r, r3), _mm_mul_ps(w1i, i3));
+        ti = _mm_add_ps(_mm_mul_ps(w1r, i3), _mm_mul_ps(w1i, r3));
+        __m128 b2r = _mm_add_ps(r2, tr), b2i = _mm_add_ps(i2, ti);
+        __m128 b3r = _mm_sub_ps(r2, tr), b3i = _mm_sub_ps(i2, ti);
+
+        tr = _mm_sub_ps(_mm_mul_ps(w2r, b2r), _mm_mul_ps(w2i, b2i));
+        ti = _mm_add_ps(_mm_mul_ps(w2r, b2i), _mm_mul_ps(w2i, b2r));
+        _mm_storeu_ps(Re[0] + i, _mm_add_ps(b0r, tr)); _mm_storeu_ps(Im[0] + i, _mm_add_ps(b0i, ti));
+        _mm_storeu_ps(Re[2] + i, _mm_sub_ps(b0r, tr)); _mm_storeu_ps(Im[2] + i, _mm_sub_ps(b0i, ti));
+        tr = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_mul_ps(w2i, b3r), _mm_mul_ps(w2r, b3i)));
+        ti = _mm_sub_ps(_mm_mul_ps(w2r, b3r), _mm_mul_ps(w2i, b3i));
+        _mm_storeu_ps(Re[1] + i, _mm_add_ps(b1r, tr)); _mm_storeu_ps(Im[1] + i, _mm_add_ps(b1i, ti));
+        _mm_storeu_ps(Re[3] + i, _mm_sub_ps(b1r, tr)); _mm_storeu_ps(Im[3] + i, _mm_sub_ps(b1i, ti));
+    }
+#endif
+    for (; i < n; i++) Scalar(i);
+}
+
+#endif // !__QGE_SIMD_H__
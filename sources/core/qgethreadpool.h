@@ -0,0 +1,136 @@
+#ifndef __QGE_THREAD_POOL_H__
+#define __QGE_THREAD_POOL_H__
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <algorithm>
+
+// Fixed set of worker threads. ParallelFor lets the calling thread take part,
+// so it is safe to call from inside a task.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned NumThreads = 0) {
+        if (NumThreads == 0) {
+            unsigned hw = std::thread::hardware_concurrency();
+            NumThreads = hw > 1 ? hw - 1 : 1;  // leave a core for the render thread
+        }
+        for (unsigned i = 0; i < NumThreads; i++)
+            mWorkers.emplace_back([this] { WorkerLoop(); });
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mCond.notify_all();
+        for (std::thread& t : mWorkers) t.join();
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned GetNumThreads() const { return (unsigned)mWorkers.size(); }
+
+    template<typename F>
+    std::future<decltype(std::declval<F>()())> Submit(F&& func) {
+        typedef decltype(std::declval<F>()()) R;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+        std::future<R> result = task->get_future();
+        Push([task] { (*task)(); });
+        return result;
+    }
+
+    // Calls func(begin, end) over [Begin, End) split in chunks of at least MinChunk items.
+    void ParallelFor(int Begin, int End, const std::function<void(int, int)>& func, int MinChunk = 1) {
+        int count = End - Begin;
+        if (count <= 0) return;
+        int NumChunks = std::min(count / std::max(MinChunk, 1), (int)(GetNumThreads() + 1) * 4);
+        if (NumChunks <= 1 || mWorkers.empty()) {
+            func(Begin, End);
+            return;
+        }
+
+        struct Job {
+            std::atomic<int> next { 0 };
+            std::atomic<int> done { 0 };
+            std::mutex mutex;
+            std::condition_variable cond;
+        };
+        auto job = std::make_shared<Job>();
+        int ChunkSize = (count + NumChunks - 1) / NumChunks;
+        NumChunks = (count + ChunkSize - 1) / ChunkSize;
+
+        auto run = [job, &func, Begin, End, ChunkSize, NumChunks] {
+            int chunk;
+            while ((chunk = job->next.fetch_add(1)) < NumChunks) {
+                int b = Begin + chunk * ChunkSize;
+                func(b, std::min(b + ChunkSize, End));
+                if (job->done.fetch_add(1) + 1 == NumChunks) {
+                    std::lock_guard<std::mutex> lock(job->mutex);
+                    job->cond.notify_all();
+                }
+            }
+        };
+
+        unsigned helpers = std::min((unsigned)NumChunks - 1, GetNumThreads());
+        for (unsigned i = 0; i < helpers; i++) Push(run);
+        run();
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->cond.wait(lock, [&job, NumChunks] { return job->done.load() == NumChunks; });
+    }
+
+    static ThreadPool& Global() {
+        static ThreadPool pool;
+        return pool;
+    }
+    // no workers, everything runs on the calling thread: the serial baseline for
+    // benchmarks and determinism checks
+    static ThreadPool& Serial() {
+        static ThreadPool pool(NoWorkers{});
+        return pool;
+    }
+
+private:
+    struct NoWorkers {};
+    explicit ThreadPool(NoWorkers) {}
+
+    std::vector<std::thread> mWorkers;
+    std::queue<std::function<void()>> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    bool mStop = false;
+
+    void Push(std::function<void()> task) {
+        if (mWorkers.empty()) {
+            task();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTasks.push(std::move(task));
+        }
+        mCond.notify_one();
+    }
+
+    void WorkerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCond.wait(lock, [this] { return mStop || !mTasks.empty(); });
+                if (mStop && mTasks.empty()) return;
+                task = std::move(mTasks.front());
+                mTasks.pop();
+            }
+            task();
+        }
+    }
+};
+
+#endif // !__QGE_THREAD_POOL_H__
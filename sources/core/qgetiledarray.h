@@ -0,0 +1,216 @@
+#ifndef __QGE_TILED_ARRAY_H__
+#define __QGE_TILED_ARRAY_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <type_traits>
+
+#include "qgearray.h"
+#include "qgesimd.h"
+
+#define QGE_TILE_SHIFT 4    // 16 x 16 elements, 1 KB of floats per tile
+
+/*
+ * Array2d with the same accessors, stored as square tiles of 2^TileShift elements a
+ * side. Tiles are row-major in the array and elements row-major in the tile, so
+ * (raw, col) and its neighbours in either direction usually share a tile and a few
+ * cache lines; in Array2d a step in raw is a whole row away.
+ *
+ * There are no row pointers (operator[]); whole rows and tiles move with the bulk
+ * copies, and for_each_tile hands out the tiles for kernels that work in place.
+ * The last tile row/column is padded. Padding is zeroed on allocation and takes
+ * part in set_all/normalize but not in minmax, so it always holds defined values.
+ */
+template<typename Type, int TileShift = QGE_TILE_SHIFT>
+class TiledArray2d {
+public:
+    static const size_t TileSize = (size_t)1 << TileShift;
+    static const size_t TileMask = TileSize - 1;
+    static const size_t TileElems = TileSize * TileSize;
+
+    TiledArray2d() {};
+    TiledArray2d(size_t raw, size_t col) { alloc(raw, col); }
+    ~TiledArray2d() { if (mp != nullptr) AlignedFree(mp); }
+    TiledArray2d(const TiledArray2d&) = delete;
+    TiledArray2d& operator=(const TiledArray2d&) = delete;
+    TiledArray2d(TiledArray2d&& other) noexcept
+        : mRaw(other.mRaw), mCol(other.mCol), mTilesRaw(other.mTilesRaw), mTilesCol(other.mTilesCol), mp(other.mp) {
+        other.mRaw = other.mCol = other.mTilesRaw = other.mTilesCol = 0;
+        other.mp = nullptr;
+    }
+    TiledArray2d& operator=(TiledArray2d&& other) noexcept {
+        if (this != &other) {
+            if (mp != nullptr) AlignedFree(mp);
+            mRaw = other.mRaw;
+            mCol = other.mCol;
+            mTilesRaw = other.mTilesRaw;
+            mTilesCol = other.mTilesCol;
+            mp = other.mp;
+            other.mRaw = other.mCol = other.mTilesRaw = other.mTilesCol = 0;
+            other.mp = nullptr;
+        }
+        return *this;
+    }
+    void destroy() {
+        if (mp != nullptr) AlignedFree(mp);
+        mp = nullptr;
+        mRaw = mCol = mTilesRaw = mTilesCol = 0;
+    }
+    size_t raw() const { return mRaw; }
+    size_t col() const { return mCol; }
+    size_t tiles_raw() const { return mTilesRaw; }
+    size_t tiles_col() const { return mTilesCol; }
+    // element count including the padding
+    size_t capacity() const { return mTilesRaw * mTilesCol * TileElems; }
+
+    size_t index(size_t raw, size_t col) const {
+        return (((raw >> TileShift) * mTilesCol + (col >> TileShift)) << (2 * TileShift)) +
+               ((raw & TileMask) << TileShift) + (col & TileMask);
+    }
+    const Type& get(size_t raw, size_t col) const {
+        return mp[index(raw, col)];
+    }
+    Type* get_a(size_t raw, size_t col) const {
+        return &mp[index(raw, col)];
+    }
+    void set(size_t raw, size_t col, const Type& val) {
+        mp[index(raw, col)] = val;
+    }
+    void set_all(size_t raw, size_t col, Type val) {
+        alloc(raw, col);
+        if constexpr (std::is_same<Type, float>::value) {
+            SimdFill(mp, capacity(), val);
+        } else {
+            for (size_t i = 0; i < capacity(); i++) mp[i] = val;
+        }
+    }
+    Type* begin() const { return mp; }
+
+    // tile (TileRaw, TileCol): TileSize rows of TileSize elements
+    Type* tile(size_t TileRaw, size_t TileCol) const {
+        return &mp[(TileRaw * mTilesCol + TileCol) * TileElems];
+    }
+    // func(TileRaw, TileCol, Type* tile, rows, cols) for every tile in memory order,
+    // rows/cols are the valid part (smaller in the padded last tile row/column)
+    template<typename Func>
+    void for_each_tile(Func func) const {
+        for (size_t tr = 0; tr < mTilesRaw; tr++) {
+            size_t Rows = std::min(TileSize, mRaw - (tr << TileShift));
+            for (size_t tc = 0; tc < mTilesCol; tc++) {
+                size_t Cols = std::min(TileSize, mCol - (tc << TileShift));
+                func(tr, tc, tile(tr, tc), Rows, Cols);
+            }
+        }
+    }
+
+    // bulk copies, one memcpy per tile row
+    void copy_row_in(size_t raw, const Type* src) {
+        for (size_t tc = 0; tc < mTilesCol; tc++) {
+            size_t Cols = std::min(TileSize, mCol - (tc << TileShift));
+            memcpy(tile(raw >> TileShift, tc) + ((raw & TileMask) << TileShift), src + (tc << TileShift), Cols * sizeof(Type));
+        }
+    }
+    void copy_row_out(size_t raw, Type* dst) const {
+        for (size_t tc = 0; tc < mTilesCol; tc++) {
+            size_t Cols = std::min(TileSize, mCol - (tc << TileShift));
+            memcpy(dst + (tc << TileShift), tile(raw >> TileShift, tc) + ((raw & TileMask) << TileShift), Cols * sizeof(Type));
+        }
+    }
+    // the valid part of a tile from/to a row-major block with Stride elements per row
+    void copy_tile_in(size_t TileRaw, size_t TileCol, const Type* src, size_t Stride) {
+        size_t Rows = std::min(TileSize, mRaw - (TileRaw << TileShift));
+        size_t Cols = std::min(TileSize, mCol - (TileCol << TileShift));
+        Type* t = tile(TileRaw, TileCol);
+        for (size_t r = 0; r < Rows; r++) memcpy(t + (r << TileShift), src + r * Stride, Cols * sizeof(Type));
+    }
+    void copy_tile_out(size_t TileRaw, size_t TileCol, Type* dst, size_t Stride) const {
+        size_t Rows = std::min(TileSize, mRaw - (TileRaw << TileShift));
+        size_t Cols = std::min(TileSize, mCol - (TileCol << TileShift));
+        const Type* t = tile(TileRaw, TileCol);
+        for (size_t r = 0; r < Rows; r++) memcpy(dst + r * Stride, t + (r << TileShift), Cols * sizeof(Type));
+    }
+    // whole array from/to the row-major layout
+    void set(const Array2d<Type>& src) {
+        alloc(src.raw(), src.col());
+        for (size_t tr = 0; tr < mTilesRaw; tr++) {
+            for (size_t tc = 0; tc < mTilesCol; tc++)
+                copy_tile_in(tr, tc, src.get_a(tr << TileShift, tc << TileShift), mCol);
+        }
+    }
+    void copy_to(Array2d<Type>& dst) const {
+        if (dst.raw() != mRaw || dst.col() != mCol) dst = Array2d<Type>(mRaw, mCol);
+        for (size_t tr = 0; tr < mTilesRaw; tr++) {
+            for (size_t tc = 0; tc < mTilesCol; tc++)
+                copy_tile_out(tr, tc, dst.get_a(tr << TileShift, tc << TileShift), mCol);
+        }
+    }
+
+    void minmax(Type& MinValue, Type& MaxValue) const {
+        MinValue = MaxValue = mp[0];
+        for_each_tile([&](size_t, size_t, const Type* t, size_t Rows, size_t Cols) {
+            for (size_t r = 0; r < Rows; r++) {
+                const Type* p = t + (r << TileShift);
+                Type lo, hi;
+                if constexpr (std::is_same<Type, float>::value) {
+                    SimdMinMax(p, Cols, lo, hi);
+                } else {
+                    lo = hi = p[0];
+                    for (size_t i = 1; i < Cols; i++) {
+                        if (p[i] < lo) lo = p[i];
+                        if (p[i] > hi) hi = p[i];
+                    }
+                }
+                if (lo < MinValue) MinValue = lo;
+                if (hi > MaxValue) MaxValue = hi;
+            }
+        });
+    }
+    void normalize(Type MinRange, Type MaxRange) {
+        Type minx, maxx;
+        minmax(minx, maxx);
+        if (maxx <= minx) return;
+
+        Type delta = maxx - minx;
+        Type range = MaxRange - MinRange;
+        if constexpr (std::is_same<Type, float>::value) {
+            float scale = range / delta;
+            SimdRemap(mp, capacity(), scale, MinRange - minx * scale);
+        } else {
+            for (size_t i = 0; i < capacity(); i++) mp[i] = (mp[i] - minx) / delta * range + MinRange;
+        }
+    }
+
+private:
+    void alloc(size_t raw, size_t col) {
+        if (mp != nullptr) AlignedFree(mp);
+        mRaw = raw;
+        mCol = col;
+        mTilesRaw = (raw + TileMask) >> TileShift;
+        mTilesCol = (col + TileMask) >> TileShift;
+        mp = (Type*)AlignedMalloc(capacity() * sizeof(Type));
+        clear_padding();
+    }
+    // the elements of the last tile row/column beyond raw() x col()
+    void clear_padding() {
+        static_assert(std::is_trivially_copyable<Type>::value, "padding is cleared with memset");
+        size_t Rows = mRaw & TileMask, Cols = mCol & TileMask;
+        if (Cols != 0) {
+            for (size_t tr = 0; tr < mTilesRaw; tr++) {
+                Type* t = tile(tr, mTilesCol - 1);
+                for (size_t r = 0; r < TileSize; r++) memset(t + (r << TileShift) + Cols, 0, (TileSize - Cols) * sizeof(Type));
+            }
+        }
+        if (Rows != 0) {
+            for (size_t tc = 0; tc < mTilesCol; tc++)
+                memset(tile(mTilesRaw - 1, tc) + (Rows << TileShift), 0, (TileSize - Rows) * TileSize * sizeof(Type));
+        }
+    }
+
+    size_t mRaw = 0, mCol = 0;
+    size_t mTilesRaw = 0, mTilesCol = 0;
+    Type* mp = nullptr;
+};
+
+#endif // !__QGE_TILED_ARRAY_H__
@@ -0,0 +1,355 @@
+#include "physics_world.h"
+#include "render/terrain.h"
+#include "core/qgetime.h"
+#include "core/qgethreadpool.h"
+
+#include <Jolt/RegisterTypes.h>
+#include <Jolt/Core/Factory.h>
+#include <Jolt/Physics/PhysicsSettings.h>
+#include <Jolt/Physics/Collision/Shape/HeightFieldShape.h>
+#include <Jolt/Physics/Collision/Shape/SphereShape.h>
+#include <Jolt/Physics/Collision/Shape/BoxShape.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <stdio.h>
+
+namespace PhysicsLayers {
+    static constexpr JPH::ObjectLayer NON_MOVING = 0;
+    static constexpr JPH::ObjectLayer MOVING = 1;
+    static constexpr JPH::ObjectLayer NUM_LAYERS = 2;
+};
+
+namespace PhysicsBroadPhase {
+    static constexpr JPH::BroadPhaseLayer NON_MOVING(0);
+    static constexpr JPH::BroadPhaseLayer MOVING(1);
+    static constexpr unsigned NUM_LAYERS = 2;
+};
+
+class PhysicsBroadPhaseLayers : public JPH::BroadPhaseLayerInterface {
+public:
+    virtual unsigned GetNumBroadPhaseLayers() const override { return PhysicsBroadPhase::NUM_LAYERS; }
+    virtual JPH::BroadPhaseLayer GetBroadPhaseLayer(JPH::ObjectLayer Layer) const override {
+        return Layer == PhysicsLayers::NON_MOVING ? PhysicsBroadPhase::NON_MOVING : PhysicsBroadPhase::MOVING;
+    }
+#if defined(JPH_EXTERNAL_PROFILE) || defined(JPH_PROFILE_ENABLED)
+    virtual const char* GetBroadPhaseLayerName(JPH::BroadPhaseLayer Layer) const override {
+        return Layer == PhysicsBroadPhase::NON_MOVING ? "NON_MOVING" : "MOVING";
+    }
+#endif
+};
+
+class PhysicsObjectVsBroadPhaseFilter : public JPH::ObjectVsBroadPhaseLayerFilter {
+public:
+    virtual bool ShouldCollide(JPH::ObjectLayer Layer, JPH::BroadPhaseLayer BroadPhaseLayer) const override {
+        return Layer != PhysicsLayers::NON_MOVING || BroadPhaseLayer == PhysicsBroadPhase::MOVING;
+    }
+};
+
+class PhysicsObjectLayerPairFilter : public JPH::ObjectLayerPairFilter {
+public:
+    virtual bool ShouldCollide(JPH::ObjectLayer Layer1, JPH::ObjectLayer Layer2) const override {
+        return Layer1 != PhysicsLayers::NON_MOVING || Layer2 != PhysicsLayers::NON_MOVING;
+    }
+};
+
+// Jolt's allocator, factory and type registry are process wide
+static int sJoltUsers = 0;
+
+PhysicsWorld::PhysicsWorld() {
+}
+
+PhysicsWorld::~PhysicsWorld() {
+    Shutdown();
+}
+
+bool PhysicsWorld::Init(unsigned MaxBodies, int NumThreads) {
+    if (mSystem) return true;
+    if (sJoltUsers++ == 0) {
+        JPH::RegisterDefaultAllocator();
+        JPH::Factory::sInstance = new JPH::Factory();
+        JPH::RegisterTypes();
+    }
+
+    if (NumThreads <= 0) {
+        // the stepping thread works on the jobs too, the render thread keeps its core
+        unsigned hw = std::thread::hardware_concurrency();
+        NumThreads = hw > 2 ? (int)hw - 2 : 1;
+    }
+    mNumThreads = (unsigned)NumThreads;
+    mTempAllocator = std::make_unique<JPH::TempAllocatorImpl>(64 << 20);
+    mJobSystem = std::make_unique<JPH::JobSystemThreadPool>(JPH::cMaxPhysicsJobs, JPH::cMaxPhysicsBarriers, NumThreads);
+
+    mBroadPhaseLayers = std::make_unique<PhysicsBroadPhaseLayers>();
+    mObjectVsBroadPhase = std::make_unique<PhysicsObjectVsBroadPhaseFilter>();
+    mObjectPairs = std::make_unique<PhysicsObjectLayerPairFilter>();
+    mSystem = std::make_unique<JPH::PhysicsSystem>();
+    mSystem->Init(MaxBodies, 0, MaxBodies * 2, MaxBodies * 2, *mBroadPhaseLayers, *mObjectVsBroadPhase, *mObjectPairs);
+
+    mStop = false;
+    mWorker = std::thread(&PhysicsWorld::WorkerLoop, this);
+    return true;
+}
+
+void PhysicsWorld::Shutdown() {
+    if (!mSystem) return;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mCond.notify_all();
+    if (mWorker.joinable()) mWorker.join();
+
+    // the body manager frees the bodies still in the system
+    mSystem.reset();
+    mObjectPairs.reset();
+    mObjectVsBroadPhase.reset();
+    mBroadPhaseLayers.reset();
+    mJobSystem.reset();
+    mTempAllocator.reset();
+    mTerrainBody = JPH::BodyID();
+    mPendingTerrain = nullptr;
+    mBodies.clear();
+    mPrevStates.clear();
+    mCurrStates.clear();
+    mResultPrev.clear();
+    mResultCurr.clear();
+    mPendingSteps = 0;
+    mBusy = false;
+    mHasResult = false;
+    mAccumulator = 0.0f;
+
+    if (--sJoltUsers == 0) {
+        JPH::UnregisterTypes();
+        delete JPH::Factory::sInstance;
+        JPH::Factory::sInstance = nullptr;
+    }
+}
+
+bool PhysicsWorld::SetTerrain(const Terrain* pTerrain, const glm::vec3& Offset) {
+    if (!mSystem) return false;
+    JPH::ShapeRefC Shape = CreateHeightFieldShape(pTerrain, Offset);
+    Sync();
+    mPendingTerrain = nullptr;
+    return ReplaceTerrainBody(Shape);
+}
+
+bool PhysicsWorld::SetTerrain(const Array2d<float>& HeightMap, float WorldScale, const glm::vec3& Offset) {
+    if (!mSystem) return false;
+    JPH::ShapeRefC Shape = BuildHeightField((int)HeightMap.raw(), WorldScale, Offset,
+        [&HeightMap](int x, float* scratch) { return (const float*)HeightMap[x]; });
+    Sync();
+    mPendingTerrain = nullptr;
+    return ReplaceTerrainBody(Shape);
+}
+
+JPH::ShapeRefC PhysicsWorld::CreateHeightFieldShape(const Terrain* pTerrain, const glm::vec3& Offset) {
+    return BuildHeightField(pTerrain->getSize(), pTerrain->GetWorldScale(), Offset,
+        [pTerrain](int x, float* scratch) { return pTerrain->GetHeightRow(x, scratch); });
+}
+
+// Jolt keeps its own block compressed copy of the samples, so the float array of
+// the settings is the only extra copy: it is filled straight from the terrain rows
+// and released once the shape is built. Jolt stores (x, z) at z * Size + x, the
+// terrain keeps rows of constant x, hence the transpose.
+JPH::ShapeRefC PhysicsWorld::BuildHeightField(int Size, float WorldScale, const glm::vec3& Offset,
+                                              const std::function<const float*(int, float*)>& GetRow) {
+    if (Size < 2) return nullptr;
+
+    JPH::ShapeSettings::ShapeResult Result;
+    {
+        JPH::HeightFieldShapeSettings Settings;
+        Settings.mOffset = JPH::Vec3(Offset.x, Offset.y, Offset.z);
+        Settings.mScale = JPH::Vec3(WorldScale, 1.0f, WorldScale);
+        Settings.mSampleCount = (JPH::uint32)Size;
+        Settings.mHeightSamples.resize((size_t)Size * Size);
+        float* Samples = Settings.mHeightSamples.data();
+        ThreadPool::Global().ParallelFor(0, Size, [&](int xBegin, int xEnd) {
+            std::vector<float> scratch(Size);
+            for (int x = xBegin; x < xEnd; x++) {
+                const float* row = GetRow(x, &scratch[0]);
+                for (int z = 0; z < Size; z++) Samples[(size_t)z * Size + x] = row[z];
+            }
+        }, 16);
+        Result = Settings.Create();
+    }
+    if (Result.HasError()) {
+        printf("PhysicsWorld: heightfield failed: %s\n", Result.GetError().c_str());
+        return nullptr;
+    }
+    return Result.Get();
+}
+
+// the stepping thread must be idle
+bool PhysicsWorld::ReplaceTerrainBody(const JPH::ShapeRefC& Shape) {
+    if (!mSystem || Shape == nullptr) return false;
+    JPH::BodyInterface& Bodies = mSystem->GetBodyInterface();
+    if (!mTerrainBody.IsInvalid()) {
+        Bodies.RemoveBody(mTerrainBody);
+        Bodies.DestroyBody(mTerrainBody);
+    }
+    JPH::BodyCreationSettings Settings(Shape, JPH::RVec3::sZero(), JPH::Quat::sIdentity(),
+                                       JPH::EMotionType::Static, PhysicsLayers::NON_MOVING);
+    mTerrainBody = Bodies.CreateAndAddBody(Settings, JPH::EActivation::DontActivate);
+    mOptimizeBroadPhase = true;
+    return !mTerrainBody.IsInvalid();
+}
+
+int PhysicsWorld::AddSphere(const glm::vec3& Pos, float Radius) {
+    JPH::BodyCreationSettings Settings(new JPH::SphereShape(Radius), JPH::RVec3(Pos.x, Pos.y, Pos.z),
+                                       JPH::Quat::sIdentity(), JPH::EMotionType::Dynamic, PhysicsLayers::MOVING);
+    return AddBody(Settings);
+}
+
+int PhysicsWorld::AddBox(const glm::vec3& Pos, const glm::vec3& HalfExtent) {
+    JPH::BodyCreationSettings Settings(new JPH::BoxShape(JPH::Vec3(HalfExtent.x, HalfExtent.y, HalfExtent.z)),
+                                       JPH::RVec3(Pos.x, Pos.y, Pos.z), JPH::Quat::sIdentity(),
+                                       JPH::EMotionType::Dynamic, PhysicsLayers::MOVING);
+    return AddBody(Settings);
+}
+
+int PhysicsWorld::AddBody(const JPH::BodyCreationSettings& Settings) {
+    if (!mSystem) return -1;
+    Sync();
+    JPH::BodyID id = mSystem->GetBodyInterface().CreateAndAddBody(Settings, JPH::EActivation::Activate);
+    if (id.IsInvalid()) {
+        printf("PhysicsWorld: body limit reached\n");
+        return -1;
+    }
+
+    BodyState State;
+    State.Pos = glm::vec3(Settings.mPosition.GetX(), Settings.mPosition.GetY(), Settings.mPosition.GetZ());
+    State.Rot = glm::quat(Settings.mRotation.GetW(), Settings.mRotation.GetX(), Settings.mRotation.GetY(), Settings.mRotation.GetZ());
+    mBodies.push_back(id);
+    mPrevStates.push_back(State);
+    mCurrStates.push_back(State);
+    mOptimizeBroadPhase = true;
+    return (int)mBodies.size() - 1;
+}
+
+int PhysicsWorld::getNumActiveBodies() const {
+    return mSystem ? (int)mSystem->GetNumActiveBodies(JPH::EBodyType::RigidBody) : 0;
+}
+
+void PhysicsWorld::Update(float DeltaTime) {
+    if (!mSystem) return;
+    mAccumulator += DeltaTime;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mBusy) return;
+    }
+    Publish();
+    if (mPendingTerrain != nullptr) {
+        ReplaceTerrainBody(mPendingTerrain);
+        mPendingTerrain = nullptr;
+    }
+
+    int Steps = (int)(mAccumulator / mFixedStep);
+    if (Steps > mMaxStepsPerUpdate) {
+        Steps = mMaxStepsPerUpdate;
+        mAccumulator = Steps * mFixedStep;
+    }
+    mAccumulator -= Steps * mFixedStep;
+    if (Steps == 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPendingSteps = Steps;
+        mBusy = true;
+    }
+    mCond.notify_all();
+}
+
+void PhysicsWorld::Sync() {
+    if (!mSystem) return;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCond.wait(lock, [this] { return !mBusy; });
+    }
+    Publish();
+}
+
+void PhysicsWorld::Step(int NumSteps) {
+    if (!mSystem || NumSteps <= 0) return;
+    Sync();
+    RunSteps(NumSteps);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mHasResult = true;
+    }
+    Publish();
+}
+
+void PhysicsWorld::RunSteps(int NumSteps) {
+    if (mOptimizeBroadPhase) {
+        mSystem->OptimizeBroadPhase();
+        mOptimizeBroadPhase = false;
+    }
+
+    Timer timer;
+    double Milliseconds = 0.0;
+    for (int i = 0; i < NumSteps; i++) {
+        if (i == NumSteps - 1) CaptureStates(mResultPrev);
+        timer.Start();
+        mSystem->Update(mFixedStep, 1, mTempAllocator.get(), mJobSystem.get());
+        timer.Stop();
+        Milliseconds += timer.GetElapsedMilliseconds();
+    }
+    CaptureStates(mResultCurr);
+    mResultMilliseconds = Milliseconds / NumSteps;
+}
+
+void PhysicsWorld::CaptureStates(std::vector<BodyState>& States) {
+    States.resize(mBodies.size());
+    const JPH::BodyInterface& Bodies = mSystem->GetBodyInterfaceNoLock();
+    ThreadPool::Global().ParallelFor(0, (int)mBodies.size(), [&](int Begin, int End) {
+        for (int i = Begin; i < End; i++) {
+            JPH::RVec3 Pos;
+            JPH::Quat Rot;
+            Bodies.GetPositionAndRotation(mBodies[i], Pos, Rot);
+            States[i].Pos = glm::vec3(Pos.GetX(), Pos.GetY(), Pos.GetZ());
+            States[i].Rot = glm::quat(Rot.GetW(), Rot.GetX(), Rot.GetY(), Rot.GetZ());
+        }
+    }, 1024);
+}
+
+// main thread, only while no batch runs
+void PhysicsWorld::Publish() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mHasResult) return;
+    mPrevStates.swap(mResultPrev);
+    mCurrStates.swap(mResultCurr);
+    mStepMilliseconds = mResultMilliseconds;
+    mHasResult = false;
+}
+
+void PhysicsWorld::WorkerLoop() {
+    for (;;) {
+        int Steps;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCond.wait(lock, [this] { return mStop || mPendingSteps > 0; });
+            if (mStop) return;
+            Steps = mPendingSteps;
+            mPendingSteps = 0;
+        }
+        RunSteps(Steps);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBusy = false;
+            mHasResult = true;
+        }
+        mCond.notify_all();
+    }
+}
+
+glm::mat4 PhysicsWorld::GetRenderTransform(int Body) const {
+    float Alpha = glm::clamp(mAccumulator / mFixedStep, 0.0f, 1.0f);
+    const BodyState& a = mPrevStates[Body];
+    const BodyState& b = mCurrStates[Body];
+    glm::mat4 Transform = glm::translate(glm::mat4(1.0f), glm::mix(a.Pos, b.Pos, Alpha));
+    return Transform * glm::mat4_cast(glm::slerp(a.Rot, b.Rot, Alpha));
+}
+
+void PhysicsWorld::GetRenderTransforms(std::vector<glm::mat4>& Transforms) const {
+    Transforms.resize(mBodies.size());
+    for (int i = 0; i < (int)mBodies.size(); i++) Transforms[i] = GetRenderTransform(i);
+}
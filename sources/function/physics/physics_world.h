@@ -0,0 +1,134 @@
+#ifndef __PHYSICS_WORLD_H__
+#define __PHYSICS_WORLD_H__
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/TempAllocator.h>
+#include <Jolt/Core/JobSystemThreadPool.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/Body/BodyID.h>
+#include <Jolt/Physics/Body/BodyCreationSettings.h>
+
+#include "core/qgearray.h"
+
+class Terrain;
+class PhysicsBroadPhaseLayers;
+class PhysicsObjectVsBroadPhaseFilter;
+class PhysicsObjectLayerPairFilter;
+
+/*
+ * Jolt PhysicsSystem with a static heightfield built from a Terrain and any
+ * number of dynamic bodies.
+ *
+ * The simulation advances in fixed steps on its own thread, and every step is
+ * spread over Jolt's JobSystemThreadPool. Update() never waits: it collects the
+ * batch of steps that finished since the last call and starts the next batch.
+ * Rendering therefore runs one batch behind the simulation and interpolates each
+ * body between the last two finished steps.
+ *
+ * Bodies are added between steps, AddSphere/AddBox and SetTerrain wait for a
+ * running batch. SetTerrainShape does not: the heightfield shape is built on any
+ * thread beforehand and the body swap happens in the next Update that finds the
+ * stepping thread idle.
+ */
+class PhysicsWorld {
+public:
+    PhysicsWorld();
+    ~PhysicsWorld();
+
+    // NumThreads 0: one Jolt worker per core, minus the render and the stepping thread
+    bool Init(unsigned MaxBodies = 65536, int NumThreads = 0);
+    void Shutdown();
+    bool IsInit() const { return mSystem != nullptr; }
+
+    // static heightfield, Offset is the world position of grid sample (0, 0)
+    bool SetTerrain(const Terrain* pTerrain, const glm::vec3& Offset);
+    bool SetTerrain(const Array2d<float>& HeightMap, float WorldScale, const glm::vec3& Offset);
+    // the heightfield shape alone, callable from any thread once Init ran; nullptr on error
+    static JPH::ShapeRefC CreateHeightFieldShape(const Terrain* pTerrain, const glm::vec3& Offset);
+    // replaces the terrain body with Shape at the next idle Update, never waits
+    void SetTerrainShape(const JPH::ShapeRefC& Shape) { mPendingTerrain = Shape; }
+
+    // both return the body index for GetRenderTransform, -1 when the world is full
+    int AddSphere(const glm::vec3& Pos, float Radius);
+    int AddBox(const glm::vec3& Pos, const glm::vec3& HalfExtent);
+    int getNumBodies() const { return (int)mBodies.size(); }
+    int getNumActiveBodies() const;
+
+    void setFixedStep(float dt) { mFixedStep = dt; }
+    // steps beyond this per Update are dropped, so a long frame does not snowball
+    void setMaxStepsPerUpdate(int count) { mMaxStepsPerUpdate = count; }
+
+    // main loop: publishes the finished batch and queues the steps due for DeltaTime
+    void Update(float DeltaTime);
+    // waits for the running batch and publishes it
+    void Sync();
+    // runs NumSteps fixed steps on the calling thread (still on the job system)
+    void Step(int NumSteps);
+
+    // body transform between the last two finished steps
+    glm::mat4 GetRenderTransform(int Body) const;
+    void GetRenderTransforms(std::vector<glm::mat4>& Transforms) const;
+
+    // wall time of one fixed step, averaged over the last batch
+    double getStepMilliseconds() const { return mStepMilliseconds; }
+    unsigned getNumThreads() const { return mNumThreads; }
+
+private:
+    struct BodyState {
+        glm::vec3 Pos = glm::vec3(0.0f);
+        glm::quat Rot = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    };
+
+    static JPH::ShapeRefC BuildHeightField(int Size, float WorldScale, const glm::vec3& Offset,
+                                           const std::function<const float*(int, float*)>& GetRow);
+    bool ReplaceTerrainBody(const JPH::ShapeRefC& Shape);
+    int AddBody(const JPH::BodyCreationSettings& Settings);
+    void RunSteps(int NumSteps);
+    void CaptureStates(std::vector<BodyState>& States);
+    void Publish();
+    void WorkerLoop();
+
+    std::unique_ptr<JPH::TempAllocatorImpl> mTempAllocator;
+    std::unique_ptr<JPH::JobSystemThreadPool> mJobSystem;
+    std::unique_ptr<PhysicsBroadPhaseLayers> mBroadPhaseLayers;
+    std::unique_ptr<PhysicsObjectVsBroadPhaseFilter> mObjectVsBroadPhase;
+    std::unique_ptr<PhysicsObjectLayerPairFilter> mObjectPairs;
+    std::unique_ptr<JPH::PhysicsSystem> mSystem;
+    JPH::BodyID mTerrainBody;
+    JPH::ShapeRefC mPendingTerrain;         // main thread only
+    unsigned mNumThreads = 0;
+
+    float mFixedStep = 1.0f / 60.0f;
+    int mMaxStepsPerUpdate = 4;
+    float mAccumulator = 0.0f;
+    bool mOptimizeBroadPhase = false;
+    double mStepMilliseconds = 0.0;
+
+    // main thread only, mBodies is read by the worker while a batch runs
+    std::vector<JPH::BodyID> mBodies;
+    std::vector<BodyState> mPrevStates;
+    std::vector<BodyState> mCurrStates;
+
+    // shared with the physics thread
+    std::thread mWorker;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    int mPendingSteps = 0;
+    bool mBusy = false;
+    bool mHasResult = false;
+    bool mStop = false;
+    std::vector<BodyState> mResultPrev;
+    std::vector<BodyState> mResultCurr;
+    double mResultMilliseconds = 0.0;
+};
+
+#endif // !__PHYSICS_WORLD_H__
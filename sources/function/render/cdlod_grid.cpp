@@ -0,0 +1,173 @@
+#include "cdlod_grid.h"
+#include "terrain.h"
+
+#include <algorithm>
+#include <float.h>
+
+bool CdlodGrid::Build(const Terrain* pTerrain, int LeafCells) {
+    Destroy();
+    mPyramid = &pTerrain->getHeightPyramid();
+    mSize = pTerrain->getSize();
+    mWorldScale = pTerrain->GetWorldScale();
+    mLeafCells = LeafCells;
+
+    int Cells = mSize - 1;
+    bool PowerOfTwo = LeafCells >= HEIGHT_PYRAMID_LEAF && (LeafCells & (LeafCells - 1)) == 0;
+    mMaxLod = 0;
+    while ((LeafCells << mMaxLod) < Cells) mMaxLod++;
+    if (!PowerOfTwo || (LeafCells << mMaxLod) != Cells || mMaxLod >= CDLOD_MAX_LODS) {
+        printf("CDLOD needs (size - 1) = LeafCells * 2^n with LeafCells a power of two (size %d, LeafCells %d)\n",
+               mSize, LeafCells);
+        return false;
+    }
+    mPyramidOffset = 0;
+    while ((HEIGHT_PYRAMID_LEAF << mPyramidOffset) < LeafCells) mPyramidOffset++;
+
+    // (LeafCells + 1)^2 vertices in [0, 1]; quads listed quadrant by quadrant
+    int n = LeafCells + 1, Half = LeafCells / 2;
+    std::vector<glm::vec2> Vertices((size_t)n * n);
+    for (int z = 0; z < n; z++) {
+        for (int x = 0; x < n; x++) Vertices[(size_t)z * n + x] = glm::vec2(x, z) / (float)LeafCells;
+    }
+    std::vector<unsigned short> Indices;
+    Indices.reserve((size_t)LeafCells * LeafCells * 6);
+    for (int q = 0; q < 4; q++) {
+        int qx = (q & 1) * Half, qz = (q >> 1) * Half;
+        for (int z = qz; z < qz + Half; z++) {
+            for (int x = qx; x < qx + Half; x++) {
+                unsigned short v00 = (unsigned short)(z * n + x), v10 = v00 + 1;
+                unsigned short v01 = (unsigned short)(v00 + n), v11 = v01 + 1;
+                // same winding as the GeoMipGrid fans
+                Indices.push_back(v00); Indices.push_back(v01); Indices.push_back(v10);
+                Indices.push_back(v10); Indices.push_back(v01); Indices.push_back(v11);
+            }
+        }
+    }
+    mNumIndices = (int)Indices.size();
+
+    glGenVertexArrays(1, &mVAO);
+    glBindVertexArray(mVAO);
+    glGenBuffers(1, &mVB);
+    glBindBuffer(GL_ARRAY_BUFFER, mVB);
+    glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(glm::vec2), &Vertices[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+    glGenBuffers(1, &mIB);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIB);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, Indices.size() * sizeof(unsigned short), &Indices[0], GL_STATIC_DRAW);
+
+    glGenBuffers(1, &mInstanceVB);
+    glBindBuffer(GL_ARRAY_BUFFER, mInstanceVB);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void CdlodGrid::Destroy() {
+    if (mVB > 0) glDeleteBuffers(1, &mVB);
+    if (mIB > 0) glDeleteBuffers(1, &mIB);
+    if (mInstanceVB > 0) glDeleteBuffers(1, &mInstanceVB);
+    if (mVAO > 0) glDeleteVertexArrays(1, &mVAO);
+    mVB = mIB = mInstanceVB = mVAO = 0;
+    mInstanceCapacity = 0;
+    mNumIndices = 0;
+    mNumSelected = 0;
+    mPyramid = nullptr;
+}
+
+void CdlodGrid::CalcRanges() {
+    float LodDistance = std::max(mLodDistance, MinLodDistance(mLeafCells, mWorldScale));
+    for (int Lod = 0; Lod < CDLOD_MAX_LODS; Lod++) {
+        mRanges[Lod] = LodDistance * (float)(1 << Lod);
+    }
+}
+
+// true when the node's area is taken care of (selected or culled), false when it is
+// beyond its own range and the parent has to cover it
+bool CdlodGrid::SelectNode(int Lod, int NodeX, int NodeZ) {
+    mNumVisited++;
+    int Cells = mLeafCells << Lod;
+    const glm::vec2& h = mPyramid->GetBounds(mPyramidOffset + Lod, NodeX, NodeZ);
+    glm::vec3 Min(NodeX * Cells * mWorldScale, h.x, NodeZ * Cells * mWorldScale);
+    glm::vec3 Max(Min.x + Cells * mWorldScale, h.y, Min.z + Cells * mWorldScale);
+
+    glm::vec3 Nearest = glm::clamp(mCameraPos, Min, Max);
+    float DistSq = glm::dot(Nearest - mCameraPos, Nearest - mCameraPos);
+    if (Lod < mMaxLod && DistSq > mRanges[Lod] * mRanges[Lod]) return false;
+    if (!mFrustum.IsBoxVisible(Min, Max)) return true;
+
+    glm::vec4 Node((float)(NodeX * Cells), (float)(NodeZ * Cells), (float)Cells, (float)Lod);
+    if (Lod == 0 || DistSq > mRanges[Lod - 1] * mRanges[Lod - 1]) {
+        mSelected[DRAW_FULL].push_back(Node);
+        mNumSelected++;
+        return true;
+    }
+
+    for (int q = 0; q < 4; q++) {
+        if (!SelectNode(Lod - 1, NodeX * 2 + (q & 1), NodeZ * 2 + (q >> 1))) {
+            mSelected[DRAW_QUADRANT_0 + q].push_back(Node);
+            mNumSelected++;
+        }
+    }
+    return true;
+}
+
+void CdlodGrid::Select(const glm::vec3& CameraPos, const glm::mat4& ViewProj) {
+    for (int i = 0; i < DRAW_GROUPS; i++) mSelected[i].clear();
+    mNumSelected = 0;
+    mNumVisited = 0;
+    if (!IsBuilt()) return;
+
+    CalcRanges();
+    mCameraPos = CameraPos;
+    mFrustum.Update(ViewProj);
+    SelectNode(mMaxLod, 0, 0);
+}
+
+void CdlodGrid::Draw(Shader& shader, const glm::vec3& CameraPos, GLuint HeightTexture) {
+    if (!IsBuilt() || mNumSelected == 0) return;
+
+    // morph band of each LOD: (start, end) distance
+    glm::vec2 Morph[CDLOD_MAX_LODS];
+    for (int Lod = 0; Lod < CDLOD_MAX_LODS; Lod++) {
+        float Prev = Lod > 0 ? mRanges[Lod - 1] : 0.0f;
+        float End = Lod < mMaxLod ? mRanges[Lod] : FLT_MAX;
+        Morph[Lod] = glm::vec2(Prev + (mRanges[Lod] - Prev) * mMorphStart, End);
+    }
+    glUniform2fv(glGetUniformLocation(shader.ID, "gMorph"), CDLOD_MAX_LODS, &Morph[0][0]);
+    shader.setVec3("gCameraPos", CameraPos);
+    shader.setFloat("gGridRes", (float)mLeafCells);
+    shader.setInt("gGridSize", mSize);
+    shader.setInt("gHeightMap", 2);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, HeightTexture);
+
+    mInstances.clear();
+    for (int i = 0; i < DRAW_GROUPS; i++) mInstances.insert(mInstances.end(), mSelected[i].begin(), mSelected[i].end());
+    glBindBuffer(GL_ARRAY_BUFFER, mInstanceVB);
+    if (mInstances.size() > mInstanceCapacity) {
+        mInstanceCapacity = mInstances.size() * 2;
+        glBufferData(GL_ARRAY_BUFFER, mInstanceCapacity * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, mInstances.size() * sizeof(glm::vec4), &mInstances[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(mVAO);
+    int QuadrantIndices = mNumIndices / 4;
+    GLuint BaseInstance = 0;
+    for (int i = 0; i < DRAW_GROUPS; i++) {
+        GLsizei Count = (GLsizei)mSelected[i].size();
+        if (Count > 0) {
+            int First = i == DRAW_FULL ? 0 : (i - DRAW_QUADRANT_0) * QuadrantIndices;
+            int NumIndices = i == DRAW_FULL ? mNumIndices : QuadrantIndices;
+            glDrawElementsInstancedBaseInstance(GL_TRIANGLES, NumIndices, GL_UNSIGNED_SHORT,
+                (void*)(First * sizeof(unsigned short)), Count, BaseInstance);
+        }
+        BaseInstance += Count;
+    }
+    glBindVertexArray(0);
+}
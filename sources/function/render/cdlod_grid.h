@@ -0,0 +1,101 @@
+#ifndef __CDLOD_GRID_H__
+#define __CDLOD_GRID_H__
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "frustum.h"
+
+class Terrain;
+class HeightPyramid;
+
+#define CDLOD_MAX_LODS 16       // size of the gMorph array in terrain_cdlod.vs
+#define CDLOD_LEAF_CELLS 32     // default LOD 0 node size in cells
+
+/*
+ * Continuous distance-dependent LOD (Strugar). A quadtree over the heightmap,
+ * LOD 0 nodes span LeafCells x LeafCells cells and every level above doubles
+ * that. Node bounds come from the terrain's HeightPyramid, so the tree itself is
+ * implicit and costs nothing to build.
+ *
+ * Select() walks the tree top-down and stops at nodes that are culled or far
+ * enough for their LOD, so it touches O(visible nodes) instead of every patch.
+ * All nodes draw the same LeafCells x LeafCells grid mesh, instanced; the mesh's
+ * indices are ordered by quadrant so a node that only covers part of its area
+ * draws single quadrants (five instanced draws in total). terrain_cdlod.vs reads
+ * the heights from the terrain's height texture and morphs every vertex towards
+ * the next coarser grid as it approaches the end of its LOD range, so LOD changes
+ * neither pop nor crack and no stitching indices exist.
+ */
+class CdlodGrid {
+public:
+    CdlodGrid() {};
+    ~CdlodGrid() = default;
+
+    // GL thread. LeafCells is a power of two, at least HEIGHT_PYRAMID_LEAF; the terrain
+    // needs (size - 1) = LeafCells * 2^n
+    bool Build(const Terrain* pTerrain, int LeafCells = CDLOD_LEAF_CELLS);
+    void Destroy();
+    bool IsBuilt() const { return mVAO > 0; }
+
+    // LOD 0 reaches LodDistance (world units) from the camera, each LOD above twice
+    // as far; vertices start morphing at MorphStart of their band. Distances below
+    // MinLodDistance are raised to it when the ranges are computed.
+    void setLodParams(float LodDistance, float MorphStart = 0.7f) {
+        mLodDistance = LodDistance;
+        mMorphStart = MorphStart;
+    }
+    // a range shorter than twice the node diagonal lets neighbouring nodes end up two
+    // LODs apart, or with morph bands that disagree, and the seams crack
+    static float MinLodDistance(int LeafCells, float WorldScale) { return 2.0f * 1.41421356f * LeafCells * WorldScale; }
+
+    // CPU only; CameraPos and ViewProj in the terrain's local space
+    void Select(const glm::vec3& CameraPos, const glm::mat4& ViewProj);
+    // expects terrain_cdlod.vs, draws the last selection
+    void Draw(Shader& shader, const glm::vec3& CameraPos, GLuint HeightTexture);
+
+    int getNumSelectedNodes() const { return mNumSelected; }
+    int getNumVisitedNodes() const { return mNumVisited; }
+    size_t getBytes() const {
+        return (size_t)(mLeafCells + 1) * (mLeafCells + 1) * sizeof(glm::vec2) + (size_t)mNumIndices * sizeof(unsigned short);
+    }
+
+private:
+    enum {
+        DRAW_FULL,          // whole node
+        DRAW_QUADRANT_0,    // then one list per quadrant, (x, z) = (q & 1, q >> 1)
+        DRAW_GROUPS = 5
+    };
+
+    bool SelectNode(int Lod, int NodeX, int NodeZ);
+    void CalcRanges();
+
+    const HeightPyramid* mPyramid = nullptr;
+    int mSize = 0;
+    int mLeafCells = 0;
+    int mMaxLod = 0;
+    int mPyramidOffset = 0;         // pyramid level of LOD 0 nodes
+    float mWorldScale = 1.0f;
+    float mLodDistance = 64.0f;
+    float mMorphStart = 0.7f;
+    float mRanges[CDLOD_MAX_LODS];
+
+    // per selection
+    glm::vec3 mCameraPos = glm::vec3(0.0f);
+    Frustum mFrustum;
+    std::vector<glm::vec4> mSelected[DRAW_GROUPS];      // (origin x, origin z, size in cells, lod)
+    std::vector<glm::vec4> mInstances;
+    int mNumSelected = 0;
+    int mNumVisited = 0;
+
+    GLuint mVAO = 0;
+    GLuint mVB = 0;
+    GLuint mIB = 0;
+    GLuint mInstanceVB = 0;
+    size_t mInstanceCapacity = 0;
+    int mNumIndices = 0;
+};
+
+#endif // !__CDLOD_GRID_H__
@@ -0,0 +1,47 @@
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__
+
+#include <glm/glm.hpp>
+
+// View frustum as six planes (x, y, z, d), normals pointing inside.
+// Planes are pulled out of the clip matrix (Gribb & Hartmann), so boxes
+// must be in the same space the matrix transforms from.
+class Frustum {
+public:
+    Frustum() {};
+    explicit Frustum(const glm::mat4& ViewProj) { Update(ViewProj); }
+
+    void Update(const glm::mat4& ViewProj) {
+        glm::vec4 r0(ViewProj[0][0], ViewProj[1][0], ViewProj[2][0], ViewProj[3][0]);
+        glm::vec4 r1(ViewProj[0][1], ViewProj[1][1], ViewProj[2][1], ViewProj[3][1]);
+        glm::vec4 r2(ViewProj[0][2], ViewProj[1][2], ViewProj[2][2], ViewProj[3][2]);
+        glm::vec4 r3(ViewProj[0][3], ViewProj[1][3], ViewProj[2][3], ViewProj[3][3]);
+
+        mPlanes[0] = r3 + r0;   // left
+        mPlanes[1] = r3 - r0;   // right
+        mPlanes[2] = r3 + r1;   // bottom
+        mPlanes[3] = r3 - r1;   // top
+        mPlanes[4] = r3 + r2;   // near
+        mPlanes[5] = r3 - r2;   // far
+        for (int i = 0; i < 6; i++) mPlanes[i] /= glm::length(glm::vec3(mPlanes[i]));
+    }
+
+    // false only when the box is completely outside one of the planes
+    bool IsBoxVisible(const glm::vec3& Min, const glm::vec3& Max) const {
+        for (int i = 0; i < 6; i++) {
+            const glm::vec4& p = mPlanes[i];
+            glm::vec3 v(p.x >= 0.0f ? Max.x : Min.x,
+                        p.y >= 0.0f ? Max.y : Min.y,
+                        p.z >= 0.0f ? Max.z : Min.z);
+            if (p.x * v.x + p.y * v.y + p.z * v.z + p.w < 0.0f) return false;
+        }
+        return true;
+    }
+
+    const glm::vec4& GetPlane(int i) const { return mPlanes[i]; }
+
+private:
+    glm::vec4 mPlanes[6];
+};
+
+#endif // !__FRUSTUM_H__
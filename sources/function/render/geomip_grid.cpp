@@ -1,9 +1,98 @@
 #include "geomip_grid.h"
 #include "terrain.h"
+#include "core/qgesimd.h"
+#include "core/qgethreadpool.h"
+#include "core/qgehash.h"
+#include "terrain_cache.h"
+
+#include <float.h>
+#include <stdint.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <tuple>
+#include <unordered_map>
 
 extern int gShowPoints;
 
+std::shared_ptr<GeoMipIndexTable> GeoMipIndexTable::Acquire(int Width, int PatchSize, bool Compact) {
+    static std::mutex CacheMutex;
+    static std::map<std::tuple<int, int, bool>, std::weak_ptr<GeoMipIndexTable>> Cache;
+
+    std::lock_guard<std::mutex> lock(CacheMutex);
+    std::weak_ptr<GeoMipIndexTable>& entry = Cache[std::make_tuple(Width, PatchSize, Compact)];
+    std::shared_ptr<GeoMipIndexTable> table = entry.lock();
+    if (!table) {
+        table = std::make_shared<GeoMipIndexTable>();
+        table->mCompact = Compact;
+        entry = table;
+    }
+    return table;
+}
+
+#define RESTART_INDEX 0xFFFFFFFFu
+
+// Follows the strip from the triangle (a, b, c) for as long as an unused triangle
+// shares its last edge with the winding the strip needs. Triangle k of a strip is
+// (v[k], v[k+1], v[k+2]) when k is even and (v[k+1], v[k], v[k+2]) when it is odd.
+static void GrowStrip(unsigned int a, unsigned int b, unsigned int c, int First,
+                      const std::unordered_map<uint64_t, std::pair<int, unsigned int>>& Edges,
+                      const std::vector<bool>& Used, std::vector<unsigned int>& Strip, std::vector<int>& Tris) {
+    Strip.assign({ a, b, c });
+    Tris.assign(1, First);
+    for (;;) {
+        size_t k = Strip.size() - 2;
+        unsigned int p = Strip[k], q = Strip[k + 1];
+        uint64_t key = k % 2 == 0 ? ((uint64_t)p << 32 | q) : ((uint64_t)q << 32 | p);
+        auto it = Edges.find(key);
+        if (it == Edges.end() || Used[it->second.first] ||
+            std::find(Tris.begin(), Tris.end(), it->second.first) != Tris.end()) break;
+        Tris.push_back(it->second.first);
+        Strip.push_back(it->second.second);
+    }
+}
+
+// Greedy stripifier for one permutation: strips joined by RESTART_INDEX, same
+// triangles and winding as the list.
+static void StripifyTriangles(const unsigned int* List, int Count, std::vector<unsigned int>& Out) {
+    int NumTris = Count / 3;
+    std::unordered_map<uint64_t, std::pair<int, unsigned int>> Edges;    // directed edge -> (triangle, third vertex)
+    Edges.reserve(Count);
+    for (int t = 0; t < NumTris; t++) {
+        const unsigned int* v = List + 3 * t;
+        for (int e = 0; e < 3; e++) {
+            Edges.emplace((uint64_t)v[e] << 32 | v[(e + 1) % 3], std::make_pair(t, v[(e + 2) % 3]));
+        }
+    }
+
+    std::vector<bool> Used(NumTris, false);
+    std::vector<unsigned int> Strip, BestStrip;
+    std::vector<int> Tris, BestTris;
+    Out.clear();
+    for (int t = 0; t < NumTris; t++) {
+        if (Used[t]) continue;
+        const unsigned int* v = List + 3 * t;
+        BestStrip.clear();
+        for (int r = 0; r < 3; r++) {   // the rotation that runs longest
+            GrowStrip(v[r], v[(r + 1) % 3], v[(r + 2) % 3], t, Edges, Used, Strip, Tris);
+            if (Strip.size() > BestStrip.size()) {
+                BestStrip.swap(Strip);
+                BestTris.swap(Tris);
+            }
+        }
+        for (int i : BestTris) Used[i] = true;
+        if (!Out.empty()) Out.push_back(RESTART_INDEX);
+        Out.insert(Out.end(), BestStrip.begin(), BestStrip.end());
+    }
+}
+
 void GeoMipGrid::Create(int w, int d, int PatchSize, const Terrain* pterrain) {
+    Build(w, d, PatchSize, pterrain);
+    Upload();
+}
+
+void GeoMipGrid::Build(int w, int d, int PatchSize, const Terrain* pterrain) {
     if ((w - 1) % (PatchSize - 1) != 0) {
         int RecommendedWidth = ((w - 1 + PatchSize - 1) / (PatchSize - 1)) * (PatchSize - 1) + 1;
         printf("Width minus 1 (%d) must be divisible by PatchSize minus 1 (%d)\n", w, PatchSize);
@@ -28,6 +117,9 @@ void GeoMipGrid::Create(int w, int d, int PatchSize, const Terrain* pterrain) {
         exit(0);
     }
 
+    if (mPendingDraw.valid()) mPendingDraw.wait();
+    mUploading = false;     // a half finished upload restarts with the new vertices
+
     mWidth = w;
     mDepth = d;
     mPatchSize = PatchSize;
@@ -35,49 +127,148 @@ void GeoMipGrid::Create(int w, int d, int PatchSize, const Terrain* pterrain) {
     mNumPatchesX = (w - 1) / (PatchSize - 1);
     mNumPatchesZ = (d - 1) / (PatchSize - 1);
     float WorldScale = pterrain->GetWorldScale();
+    LodMode Mode = mLodManager.GetLodMode();   // InitLodManager goes back to distance bands
     mMaxLOD = mLodManager.InitLodManager(PatchSize, mNumPatchesX, mNumPatchesZ, WorldScale);
-    mLodInfo.resize(mMaxLOD + 1);
 
-    setupGrid(pterrain);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    mIndexTable = GeoMipIndexTable::Acquire(mWidth, mPatchSize, mCompactIndices);
+    std::string CachePath;
+    uint64_t CacheKey = 0;
+    if (!mCacheDir.empty()) {
+        char name[64];
+        CacheKey = CalcCacheKey(pterrain);
+        snprintf(name, sizeof(name), "/terrain_%016llx.qgtc", (unsigned long long)CacheKey);
+        CachePath = mCacheDir + name;
+    }
+
+    if (CachePath.empty() || !LoadCache(CachePath.c_str(), CacheKey)) {
+        {
+            std::lock_guard<std::mutex> lock(mIndexTable->mMutex);
+            if (!mIndexTable->mBuilt) {
+                mIndexTable->mLodInfo.resize(mMaxLOD + 1);
+                mIndexTable->mIndices.resize(CalcNumIndices());
+                int NumIndices = InitIndices(mIndexTable->mIndices);
+                mIndexTable->mIndices.resize(NumIndices);
+                mIndexTable->mIndices.shrink_to_fit();
+                mIndexTable->mListBytes = (size_t)NumIndices * sizeof(unsigned int);
+                printf("Final number of indices %d\n", NumIndices);
+                if (mIndexTable->mCompact) CompactIndices();
+                mIndexTable->mBuilt = true;
+            }
+        }
+
+        CalcPatchBounds(pterrain);
+        glm::vec2 Bounds = mPatchHeights.get(0, 0);
+        for (int PatchX = 0; PatchX < mNumPatchesX; PatchX++) {
+            for (int PatchZ = 0; PatchZ < mNumPatchesZ; PatchZ++) {
+                Bounds.x = std::min(Bounds.x, mPatchHeights.get(PatchX, PatchZ).x);
+                Bounds.y = std::max(Bounds.y, mPatchHeights.get(PatchX, PatchZ).y);
+            }
+        }
+        mHeightRange = glm::vec2(Bounds.x, Bounds.y - Bounds.x);
+
+        printf("Preparing space for %d vertices\n", mWidth * mDepth);
+        if (mVertexFormat == TERRAIN_VERTEX_COMPACT) {
+            mCompactVertices.resize((size_t)mWidth * mDepth);
+            InitCompactVertices(pterrain, mCompactVertices);
+        } else {
+            mVertices.resize((size_t)mWidth * mDepth);
+            InitVertices(pterrain, mVertices);
+            CalcNormals(pterrain, &mVertices[0].Normal, sizeof(Vertex));
+        }
+
+        if (!CachePath.empty()) SaveCache(CachePath.c_str(), CacheKey);
+    }
+    mHasPatchErrors = false;
+    mCommands.reserve(mNumPatchesX * mNumPatchesZ);
 
     m_Terrain = pterrain;
     mWorldScale = m_Terrain->GetWorldScale();
+    if (Mode != LOD_MODE_DISTANCE) setLodMode(Mode);
 }
 
-void GeoMipGrid::setupGrid(const Terrain* pTerrain) {
-    std::vector<Vertex> Vertices;
-    Vertices.resize(mWidth * mDepth);
-    printf("Preparing space for %zu vertices\n", Vertices.size());
-    InitVertices(pTerrain, Vertices);
-
-    int NumIndices = CalcNumIndices();
-    std::vector<unsigned int> Indices;
-    Indices.resize(NumIndices);
-    NumIndices = InitIndices(Indices);
-    printf("Final number of indices %d\n", NumIndices);
-
-    CalcNormals(Vertices, Indices);
-
-    glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(Vertex), &Vertices[0], GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, Indices.size() * sizeof(unsigned int), &Indices[0], GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tex));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+void GeoMipGrid::Upload() {
+    size_t Budget = SIZE_MAX;
+    UploadStep(Budget);
+}
+
+bool GeoMipGrid::UploadStep(size_t& Budget) {
+    const unsigned char* Src;
+    size_t Bytes;
+    if (mCacheFile.IsOpen()) {
+        // cooked vertices go from the mapping straight to the driver
+        const TerrainCacheHeader* header = (const TerrainCacheHeader*)mCacheFile.data();
+        Src = mCacheFile.data() + header->VertexOffset;
+        Bytes = header->VertexBytes;
+    } else if (mVertexFormat == TERRAIN_VERTEX_COMPACT) {
+        Src = (const unsigned char*)&mCompactVertices[0];
+        Bytes = mCompactVertices.size() * sizeof(CompactVertex);
+    } else {
+        Src = (const unsigned char*)&mVertices[0];
+        Bytes = mVertices.size() * sizeof(Vertex);
+    }
+
+    if (!mUploading) {
+        if (mNormalTexture > 0) glDeleteTextures(1, &mNormalTexture);
+        mNormalTexture = 0;
+        if (VAO > 0) glDeleteVertexArrays(1, &VAO);
+        if (VBO > 0) glDeleteBuffers(1, &VBO);
+
+        if (mIndexTable->EBO == 0) {
+            glGenBuffers(1, &mIndexTable->EBO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexTable->EBO);
+            if (mIndexTable->mIndexType == GL_UNSIGNED_SHORT) {
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndexTable->getBytes(), &mIndexTable->mIndices16[0], GL_STATIC_DRAW);
+            } else {
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndexTable->getBytes(), &mIndexTable->mIndices[0], GL_STATIC_DRAW);
+            }
+            Budget -= std::min(Budget, mIndexTable->getBytes());
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexTable->EBO);
+        glBufferData(GL_ARRAY_BUFFER, Bytes, nullptr, GL_STATIC_DRAW);
+
+        if (mVertexFormat == TERRAIN_VERTEX_COMPACT) {
+            // normalized: the height arrives as 0..1, the octahedral normal as -1..1
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Normal));
+        } else {
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tex));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        mUploadOffset = 0;
+        mUploading = true;
+    }
+
+    size_t Chunk = std::min(Budget, Bytes - mUploadOffset);
+    if (Chunk > 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, mUploadOffset, Chunk, Src + mUploadOffset);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        mUploadOffset += Chunk;
+        Budget -= Chunk;
+    }
+    if (mUploadOffset < Bytes) return false;
+
+    std::vector<Vertex>().swap(mVertices);
+    std::vector<CompactVertex>().swap(mCompactVertices);
+    mCacheFile.Close();
+    mUploading = false;
+    mUploadOffset = 0;
+    return true;
 }
 
 unsigned int GeoMipGrid::AddTriangle(unsigned int Index, std::vector<unsigned int>& Indices, 
@@ -93,35 +284,49 @@ unsigned int GeoMipGrid::AddTriangle(unsigned int Index, std::vector<unsigned in
     return Index;
 }
 
-void GeoMipGrid::CalcNormals(std::vector<Vertex>& Vertices, std::vector<unsigned int>& Indices) {
-    unsigned int Index = 0;
-
-    // Accumulate each triangle normal into each of the triangle vertices
-    for (int z = 0 ; z < mDepth - 1 ; z += (mPatchSize - 1)) {
-        for (int x = 0 ; x < mWidth - 1; x += (mPatchSize - 1)) {
-            int BaseVertex = z * mWidth + x;
-            //printf("Base index %d\n", BaseVertex);
-            int numIndices = mLodInfo[0].info[0][0][0][0].count;
-    		for (unsigned int i = 0 ; i < numIndices; i += 3) {
-                unsigned int Index0 = BaseVertex + Indices[i];
-                unsigned int Index1 = BaseVertex + Indices[i + 1];
-                unsigned int Index2 = BaseVertex + Indices[i + 2];
-		        glm::vec3 v1 = Vertices[Index1].Pos - Vertices[Index0].Pos;
-		        glm::vec3 v2 = Vertices[Index2].Pos - Vertices[Index0].Pos;
-		        glm::vec3 Normal = glm::cross(v1, v2);
-		        Normal = glm::normalize(Normal);
-
-		        Vertices[Index0].Normal += Normal;
-		        Vertices[Index1].Normal += Normal;
-		        Vertices[Index2].Normal += Normal;
-    		}
+// Normals straight from the heightmap by central differences. Each task takes a
+// column of patches, rows are processed with SimdHeightNormals and scattered to
+// Normals[z * mWidth + x], Stride bytes apart.
+void GeoMipGrid::CalcNormals(const Terrain* pTerrain, glm::vec3* Normals, size_t Stride) {
+    float InvTwoSpacing = 0.5f / pTerrain->GetWorldScale();
+    char* base = (char*)Normals;
+
+    ThreadPool::Global().ParallelFor(0, mNumPatchesX, [&](int PatchBegin, int PatchEnd) {
+        int xBegin = PatchBegin * (mPatchSize - 1);
+        int xEnd = PatchEnd == mNumPatchesX ? mWidth : PatchEnd * (mPatchSize - 1);
+
+        std::vector<float> scratch(3 * mDepth);
+        std::vector<float> nx(mDepth), ny(mDepth), nz(mDepth);
+        for (int x = xBegin; x < xEnd; x++) {
+            const float* prev = pTerrain->GetHeightRow(x > 0 ? x - 1 : 0, &scratch[0]);
+            const float* cur  = pTerrain->GetHeightRow(x, &scratch[mDepth]);
+            const float* next = pTerrain->GetHeightRow(x < mWidth - 1 ? x + 1 : x, &scratch[2 * mDepth]);
+            SimdHeightNormals(prev, cur, next, mDepth, InvTwoSpacing, &nx[0], &ny[0], &nz[0]);
+
+            for (int z = 0; z < mDepth; z++) {
+                glm::vec3* n = (glm::vec3*)(base + ((size_t)z * mWidth + x) * Stride);
+                *n = glm::vec3(nx[z], ny[z], nz[z]);
+            }
         }
-    }
+    });
+}
 
-    // Normalize all the vertex normals
-    for (unsigned int i = 0 ; i < Vertices.size() ; i++) {
-        Vertices[i].Normal = glm::normalize(Vertices[i].Normal);
-    }
+unsigned int GeoMipGrid::CreateNormalTexture() {
+    if (mNormalTexture > 0) return mNormalTexture;
+
+    std::vector<glm::vec3> Normals((size_t)mWidth * mDepth);
+    CalcNormals(m_Terrain, &Normals[0], sizeof(glm::vec3));
+
+    glGenTextures(1, &mNormalTexture);
+    glBindTexture(GL_TEXTURE_2D, mNormalTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, mWidth, mDepth, 0, GL_RGB, GL_FLOAT, &Normals[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return mNormalTexture;
 }
 
 void GeoMipGrid::Vertex::InitVertex(const Terrain* pTerrain, int x, int z) {
@@ -129,40 +334,224 @@ void GeoMipGrid::Vertex::InitVertex(const Terrain* pTerrain, int x, int z) {
 	float WorldScale = pTerrain->GetWorldScale();
     Pos = glm::vec3(x * WorldScale, y, z * WorldScale);
 
-    float sz = (float)pTerrain->getSize();
+    float period = pTerrain->GetTexPeriod();
     float texScale = pTerrain->GetTexScale();
-    Tex = glm::vec2(texScale * (float)x / sz, texScale * (float)z / sz);
+    glm::vec2 origin = pTerrain->GetTexOrigin();
+    Tex = glm::vec2(texScale * (origin.x + (float)x) / period, texScale * (origin.y + (float)z) / period);
+}
+
+void GeoMipGrid::PrepareDraw(const glm::vec3 CameraPos, const glm::mat4& ViewProj) {
+    if (mPendingDraw.valid()) mPendingDraw.wait();
+    mPendingDraw = ThreadPool::Global().Submit([this, CameraPos, ViewProj] {
+        BuildDrawCommands(CameraPos, ViewProj, mCommands);
+    });
 }
 
-void GeoMipGrid::Draw(const glm::vec3 CameraPos) {
+void GeoMipGrid::BuildDrawCommands(const glm::vec3& CameraPos, const glm::mat4& ViewProj,
+                                   std::vector<DrawElementsIndirectCommand>& Commands) {
     mLodManager.Update(CameraPos);
+    Frustum frustum(ViewProj);
+
+    Commands.clear();
+    mStripCommands.clear();
+    mNumCulled = 0;
+    for (int PatchZ = 0 ; PatchZ < mNumPatchesZ ; PatchZ++) {
+        for (int PatchX = 0 ; PatchX < mNumPatchesX ; PatchX++) {
+            if (!IsPatchVisible(PatchX, PatchZ, CameraPos, frustum)) {
+                mNumCulled++;
+                continue;
+            }
+
+            int z = PatchZ * (mPatchSize - 1);
+            int x = PatchX * (mPatchSize - 1);
+
+            const LODManager::PatchLod& plod = mLodManager.GetPatchLod(PatchX, PatchZ);
+            const SingleLodInfo& info = mIndexTable->mLodInfo[plod.Core].info[plod.Left][plod.Right][plod.Top][plod.Bottom];
+
+            DrawElementsIndirectCommand cmd;
+            cmd.count = info.count;
+            cmd.instanceCount = 1;
+            cmd.firstIndex = info.start;
+            cmd.baseVertex = z * mWidth + x;
+            cmd.baseInstance = 0;
+            if (info.strip) {
+                mStripCommands.push_back(cmd);
+            } else {
+                Commands.push_back(cmd);
+            }
+        }
+    }
+    Commands.insert(Commands.end(), mStripCommands.begin(), mStripCommands.end());
+    mNumStripCommands = (int)mStripCommands.size();
+    mNumDrawn = (int)Commands.size();
+}
+
+void GeoMipGrid::Draw(const glm::vec3 CameraPos, const glm::mat4& ViewProj) {
+    if (mPendingDraw.valid()) {
+        mPendingDraw.get();
+    } else {
+        BuildDrawCommands(CameraPos, ViewProj, mCommands);
+    }
 
     glBindVertexArray(VAO);
     if (gShowPoints > 0) {
-        glDrawElementsBaseVertex(GL_POINTS, mLodInfo[0].info[0][0][0][0].count, GL_UNSIGNED_INT, (void*)0, 0);
+        glDrawElementsBaseVertex(GL_POINTS, mIndexTable->mLodInfo[0].info[0][0][0][0].count, mIndexTable->mIndexType, (void*)0, 0);
     }
 
-    if (gShowPoints != 2) {
-        for (int PatchZ = 0 ; PatchZ < mNumPatchesZ ; PatchZ++) {
-            for (int PatchX = 0 ; PatchX < mNumPatchesX ; PatchX++) {
-                int z = PatchZ * (mPatchSize - 1);
-                int x = PatchX * (mPatchSize - 1);
-                
-                const LODManager::PatchLod& plod = mLodManager.GetPatchLod(PatchX, PatchZ);
-                int C = plod.Core;
-                int L = plod.Left;
-                int R = plod.Right;
-                int T = plod.Top;
-                int B = plod.Bottom;
+    if (gShowPoints != 2 && !mCommands.empty()) {
+        if (mIndirectBuffer == 0) glGenBuffers(1, &mIndirectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirectBuffer);
 
-                size_t BaseIndex = sizeof(unsigned int) * mLodInfo[C].info[L][R][T][B].start;
+        // orphan the previous frame's storage so the upload never waits on the GPU
+        size_t Bytes = mCommands.size() * sizeof(DrawElementsIndirectCommand);
+        mIndirectCapacity = std::max(mIndirectCapacity, mCommands.size());
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, mIndirectCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, Bytes, &mCommands[0]);
 
-                int BaseVertex = z * mWidth + x;
+        // the strips use GL_PRIMITIVE_RESTART_FIXED_INDEX, enabled by the application
+        GLsizei NumLists = (GLsizei)(mCommands.size() - mNumStripCommands);
+        if (NumLists > 0) {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, mIndexTable->mIndexType, (void*)0, NumLists, 0);
+        }
+        if (mNumStripCommands > 0) {
+            glMultiDrawElementsIndirect(GL_TRIANGLE_STRIP, mIndexTable->mIndexType,
+                                        (void*)(NumLists * sizeof(DrawElementsIndirectCommand)), mNumStripCommands, 0);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
 
-                glDrawElementsBaseVertex(GL_TRIANGLES, mLodInfo[C].info[L][R][T][B].count, 
-                                        GL_UNSIGNED_INT, (void*)BaseIndex, BaseVertex);
+void GeoMipGrid::CalcPatchBounds(const Terrain* pTerrain) {
+    mPatchHeights.set_all(mNumPatchesX, mNumPatchesZ, glm::vec2(0.0f));
+
+    ThreadPool::Global().ParallelFor(0, mNumPatchesX, [&](int PatchBegin, int PatchEnd) {
+        std::vector<float> scratch(mDepth);
+        for (int PatchX = PatchBegin; PatchX < PatchEnd; PatchX++) {
+            // neighbouring patches share their edge row/column
+            int x0 = PatchX * (mPatchSize - 1);
+            for (int x = x0; x < x0 + mPatchSize; x++) {
+                const float* row = pTerrain->GetHeightRow(x, &scratch[0]);
+                for (int PatchZ = 0; PatchZ < mNumPatchesZ; PatchZ++) {
+                    float minH, maxH;
+                    SimdMinMax(row + PatchZ * (mPatchSize - 1), mPatchSize, minH, maxH);
+                    glm::vec2* bounds = mPatchHeights.get_a(PatchX, PatchZ);
+                    if (x == x0) {
+                        *bounds = glm::vec2(minH, maxH);
+                    } else {
+                        bounds->x = std::min(bounds->x, minH);
+                        bounds->y = std::max(bounds->y, maxH);
+                    }
+                }
             }
         }
+    });
+}
+
+void GeoMipGrid::setLodMode(LodMode Mode) {
+    if (Mode == LOD_MODE_SCREEN_ERROR && !mHasPatchErrors) {
+        std::vector<float> Errors;
+        CalcPatchErrors(m_Terrain, Errors);
+        mLodManager.SetPatchErrors(Errors);
+        mHasPatchErrors = true;
+    }
+    mLodManager.SetLodMode(Mode);
+}
+
+// Max vertical distance between the full resolution heights of a patch and the
+// bilinear surface through its LOD l vertices (every 2^l-th sample). The fans
+// don't interpolate exactly bilinearly, but the bound is close enough to pick LODs.
+void GeoMipGrid::CalcPatchErrors(const Terrain* pTerrain, std::vector<float>& Errors) {
+    Errors.assign((size_t)mNumPatchesX * mNumPatchesZ * (mMaxLOD + 1), 0.0f);
+
+    ThreadPool::Global().ParallelFor(0, mNumPatchesX, [&](int PatchBegin, int PatchEnd) {
+        std::vector<float> rows((size_t)mPatchSize * mDepth);
+        for (int PatchX = PatchBegin; PatchX < PatchEnd; PatchX++) {
+            int x0 = PatchX * (mPatchSize - 1);
+            for (int i = 0; i < mPatchSize; i++) {
+                float* row = &rows[(size_t)i * mDepth];
+                const float* src = pTerrain->GetHeightRow(x0 + i, row);
+                if (src != row) memcpy(row, src, mDepth * sizeof(float));
+            }
+
+            for (int PatchZ = 0; PatchZ < mNumPatchesZ; PatchZ++) {
+                const float* h = &rows[PatchZ * (mPatchSize - 1)];
+                float* PatchErrors = &Errors[((size_t)PatchX * mNumPatchesZ + PatchZ) * (mMaxLOD + 1)];
+
+                for (int lod = 1; lod <= mMaxLOD; lod++) {
+                    int Step = 1 << lod;
+                    float InvStep = 1.0f / (float)Step;
+                    float MaxError = 0.0f;
+                    for (int i = 0; i < mPatchSize; i++) {
+                        int i0 = std::min(i / Step * Step, mPatchSize - 1 - Step);
+                        float fi = (i - i0) * InvStep;
+                        const float* r0 = h + (size_t)i0 * mDepth;
+                        const float* r1 = h + (size_t)(i0 + Step) * mDepth;
+                        const float* r = h + (size_t)i * mDepth;
+                        for (int j = 0; j < mPatchSize; j++) {
+                            int j0 = std::min(j / Step * Step, mPatchSize - 1 - Step);
+                            float fj = (j - j0) * InvStep;
+                            float a = r0[j0] + (r0[j0 + Step] - r0[j0]) * fj;
+                            float b = r1[j0] + (r1[j0 + Step] - r1[j0]) * fj;
+                            MaxError = std::max(MaxError, fabsf(a + (b - a) * fi - r[j]));
+                        }
+                    }
+                    PatchErrors[lod] = std::max(MaxError, PatchErrors[lod - 1]);
+                }
+            }
+        }
+    });
+}
+
+bool GeoMipGrid::IsPatchVisible(int PatchX, int PatchZ, const glm::vec3& CameraPos, const Frustum& frustum) const {
+    float PatchWorldSize = (mPatchSize - 1) * mWorldScale;
+    const glm::vec2& h = mPatchHeights.get(PatchX, PatchZ);
+    glm::vec3 Min(PatchX * PatchWorldSize, h.x, PatchZ * PatchWorldSize);
+    glm::vec3 Max(Min.x + PatchWorldSize, h.y, Min.z + PatchWorldSize);
+
+    if (!frustum.IsBoxVisible(Min, Max)) return false;
+    if (!mHorizonCulling) return true;
+
+    // hidden when the sight lines to all four top corners go through the ground
+    return !(IsOccluded(CameraPos, glm::vec3(Min.x, Max.y, Min.z)) &&
+             IsOccluded(CameraPos, glm::vec3(Max.x, Max.y, Min.z)) &&
+             IsOccluded(CameraPos, glm::vec3(Min.x, Max.y, Max.z)) &&
+             IsOccluded(CameraPos, glm::vec3(Max.x, Max.y, Max.z)));
+}
+
+// Walks the patch cells between Eye and Target (2D DDA). The segment is blocked
+// when, across a whole cell, it stays below that patch's minimum height. Only
+// the patch minimum is trusted so this never hides something in front of a
+// ridge, but it can miss occlusion by thin peaks.
+bool GeoMipGrid::IsOccluded(const glm::vec3& Eye, const glm::vec3& Target) const {
+    float CellSize = (mPatchSize - 1) * mWorldScale;
+    float ox = Eye.x / CellSize, oz = Eye.z / CellSize;
+    float dx = (Target.x - Eye.x) / CellSize, dz = (Target.z - Eye.z) / CellSize;
+    int cx = (int)floorf(ox), cz = (int)floorf(oz);
+    int StepX = dx > 0.0f ? 1 : -1, StepZ = dz > 0.0f ? 1 : -1;
+
+    float tDeltaX = dx != 0.0f ? fabsf(1.0f / dx) : FLT_MAX;
+    float tDeltaZ = dz != 0.0f ? fabsf(1.0f / dz) : FLT_MAX;
+    float tMaxX = dx != 0.0f ? ((dx > 0.0f ? cx + 1 - ox : ox - cx) * tDeltaX) : FLT_MAX;
+    float tMaxZ = dz != 0.0f ? ((dz > 0.0f ? cz + 1 - oz : oz - cz) * tDeltaZ) : FLT_MAX;
+
+    float t = 0.0f;
+    for (;;) {
+        float tNext = std::min(tMaxX, tMaxZ);
+        if (tNext >= 1.0f) return false;    // reached the target's cell
+
+        if (t > 0.0f && cx >= 0 && cx < mNumPatchesX && cz >= 0 && cz < mNumPatchesZ) {
+            float y = std::max(Eye.y + (Target.y - Eye.y) * t, Eye.y + (Target.y - Eye.y) * tNext);
+            if (y < mPatchHeights.get(cx, cz).x) return true;
+        }
+
+        t = tNext;
+        if (tMaxX < tMaxZ) {
+            cx += StepX;
+            tMaxX += tDeltaX;
+        } else {
+            cz += StepZ;
+            tMaxZ += tDeltaZ;
+        }
     }
 }
 
@@ -180,6 +569,25 @@ void GeoMipGrid::InitVertices(const Terrain* pTerrain, std::vector<Vertex>& Vert
     assert(Index == Vertices.size());
 }
 
+// Heights quantized to mHeightRange and octahedral normals; X/Z and the texture
+// coordinates are left to terrain_compact.vs.
+void GeoMipGrid::InitCompactVertices(const Terrain* pTerrain, std::vector<CompactVertex>& Vertices) {
+    std::vector<glm::vec3> Normals((size_t)mWidth * mDepth);
+    CalcNormals(pTerrain, &Normals[0], sizeof(glm::vec3));
+
+    ThreadPool::Global().ParallelFor(0, mWidth, [&](int xBegin, int xEnd) {
+        std::vector<float> scratch(mDepth);
+        for (int x = xBegin; x < xEnd; x++) {
+            const float* row = pTerrain->GetHeightRow(x, &scratch[0]);
+            for (int z = 0; z < mDepth; z++) {
+                size_t Index = (size_t)z * mWidth + x;
+                Vertices[Index].Height = QuantizeHeight(row[z], mHeightRange);
+                OctEncodeNormal(Normals[Index], Vertices[Index].Normal);
+            }
+        }
+    }, 16);
+}
+
 
 int GeoMipGrid::InitIndices(std::vector<unsigned int>& Indices) {
     int Index = 0;
@@ -200,11 +608,11 @@ int GeoMipGrid::InitIndicesLOD(int Index, std::vector<unsigned int>& Indices, in
         for (int r = 0 ; r < RIGHT ; r++) {
             for (int t = 0 ; t < TOP ; t++) {
                 for (int b = 0 ; b < BOTTOM ; b++) {
-                    mLodInfo[lod].info[l][r][t][b].start = Index;
+                    mIndexTable->mLodInfo[lod].info[l][r][t][b].start = Index;
                     Index = InitIndicesLODSingle(Index, Indices, lod, lod + l, lod + r, lod + t, lod + b);
 
-                    mLodInfo[lod].info[l][r][t][b].count = Index - mLodInfo[lod].info[l][r][t][b].start;
-                    TotalIndicesForLOD += mLodInfo[lod].info[l][r][t][b].count;
+                    mIndexTable->mLodInfo[lod].info[l][r][t][b].count = Index - mIndexTable->mLodInfo[lod].info[l][r][t][b].start;
+                    TotalIndicesForLOD += mIndexTable->mLodInfo[lod].info[l][r][t][b].count;
                 }
             }
         }
@@ -317,3 +725,181 @@ int GeoMipGrid::CalcNumIndices() {
     printf("Initial number of indices %d\n", NumIndices);
     return NumIndices;
 }
+
+// Re-encodes every permutation of the 32-bit lists as strips where that is shorter,
+// then narrows to 16 bits when the patch-local indices allow it.
+void GeoMipGrid::CompactIndices() {
+    std::vector<unsigned int>& Lists = mIndexTable->mIndices;
+    std::vector<unsigned int> Packed, Strip;
+    Packed.reserve(Lists.size());
+    int NumStrips = 0;
+
+    for (int lod = 0 ; lod <= mMaxLOD ; lod++) {
+        for (int l = 0 ; l < LEFT ; l++) {
+            for (int r = 0 ; r < RIGHT ; r++) {
+                for (int t = 0 ; t < TOP ; t++) {
+                    for (int b = 0 ; b < BOTTOM ; b++) {
+                        SingleLodInfo& info = mIndexTable->mLodInfo[lod].info[l][r][t][b];
+                        const unsigned int* List = &Lists[info.start];
+                        StripifyTriangles(List, info.count, Strip);
+
+                        info.start = (int)Packed.size();
+                        info.strip = Strip.size() < (size_t)info.count;
+                        if (info.strip) {
+                            Packed.insert(Packed.end(), Strip.begin(), Strip.end());
+                            NumStrips++;
+                        } else {
+                            Packed.insert(Packed.end(), List, List + info.count);
+                        }
+                        info.count = (int)Packed.size() - info.start;
+                    }
+                }
+            }
+        }
+    }
+
+    unsigned int MaxIndex = (mPatchSize - 1) * (mWidth + 1);
+    if (MaxIndex < 0xFFFF) {
+        mIndexTable->mIndices16.resize(Packed.size());
+        for (size_t i = 0; i < Packed.size(); i++) {
+            mIndexTable->mIndices16[i] = Packed[i] == RESTART_INDEX ? 0xFFFF : (uint16_t)Packed[i];
+        }
+        mIndexTable->mIndexType = GL_UNSIGNED_SHORT;
+        std::vector<unsigned int>().swap(Lists);
+    } else {
+        Packed.shrink_to_fit();
+        Lists.swap(Packed);
+    }
+
+    printf("Compact indices: %d of %d permutations as strips, %s, %zu bytes (%zu saved)\n",
+           NumStrips, (mMaxLOD + 1) * LEFT * RIGHT * TOP * BOTTOM,
+           mIndexTable->mIndexType == GL_UNSIGNED_SHORT ? "16-bit" : "32-bit",
+           mIndexTable->getBytes(), mIndexTable->mListBytes - mIndexTable->getBytes());
+}
+
+uint64_t GeoMipGrid::CalcCacheKey(const Terrain* pTerrain) const {
+    uint64_t Key = HashValue((uint32_t)TERRAIN_CACHE_VERSION);
+    Key = HashValue(mWidth, Key);
+    Key = HashValue(mDepth, Key);
+    Key = HashValue(mPatchSize, Key);
+    Key = HashValue((int)mVertexFormat, Key);
+    Key = HashValue(mCompactIndices, Key);
+    Key = HashValue(pTerrain->GetWorldScale(), Key);
+    Key = HashValue(pTerrain->GetTexScale(), Key);
+    Key = HashValue(pTerrain->GetTexOrigin(), Key);
+    Key = HashValue(pTerrain->GetTexPeriod(), Key);
+
+    std::vector<float> scratch(mDepth);
+    for (int x = 0; x < mWidth; x++) {
+        Key = HashBytes(pTerrain->GetHeightRow(x, &scratch[0]), mDepth * sizeof(float), Key);
+    }
+    return Key;
+}
+
+// Maps a cooked grid. Only small tables are copied (the shared index table when no
+// other grid filled it yet, the patch bounds); the vertices stay in the mapping
+// until Upload hands them to GL.
+bool GeoMipGrid::LoadCache(const char* path, uint64_t Key) {
+    mCacheFile.Close();
+    if (!mCacheFile.Open(path)) return false;
+
+    const TerrainCacheHeader* header = (const TerrainCacheHeader*)mCacheFile.data();
+    size_t VertexSize = mVertexFormat == TERRAIN_VERTEX_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex);
+    if (mCacheFile.size() < sizeof(TerrainCacheHeader) || memcmp(header->Magic, TERRAIN_CACHE_MAGIC, 4) != 0 ||
+        header->Version != TERRAIN_CACHE_VERSION || header->Key != Key || header->FileSize != mCacheFile.size() ||
+        header->Width != (uint32_t)mWidth || header->Depth != (uint32_t)mDepth ||
+        header->PatchSize != (uint32_t)mPatchSize || header->MaxLOD != (uint32_t)mMaxLOD ||
+        header->VertexFormat != (uint32_t)mVertexFormat || header->VertexBytes != (uint64_t)mWidth * mDepth * VertexSize ||
+        header->IndexOffset % TERRAIN_CACHE_ALIGN != 0 || header->LodInfoOffset % TERRAIN_CACHE_ALIGN != 0 ||
+        header->BoundsOffset % TERRAIN_CACHE_ALIGN != 0 || header->IndexOffset + header->IndexBytes > header->FileSize ||
+        header->LodInfoOffset + (mMaxLOD + 1) * sizeof(LodInfo) > header->FileSize ||
+        header->BoundsOffset + (uint64_t)mNumPatchesX * mNumPatchesZ * sizeof(glm::vec2) > header->FileSize) {
+        printf("Ignoring stale terrain cache '%s'\n", path);
+        mCacheFile.Close();
+        return false;
+    }
+
+    const unsigned char* data = mCacheFile.data();
+    {
+        std::lock_guard<std::mutex> lock(mIndexTable->mMutex);
+        if (!mIndexTable->mBuilt) {
+            const LodInfo* Lods = (const LodInfo*)(data + header->LodInfoOffset);
+            mIndexTable->mLodInfo.assign(Lods, Lods + mMaxLOD + 1);
+            mIndexTable->mIndexType = (GLenum)header->IndexType;
+            if (mIndexTable->mIndexType == GL_UNSIGNED_SHORT) {
+                const uint16_t* Indices = (const uint16_t*)(data + header->IndexOffset);
+                mIndexTable->mIndices16.assign(Indices, Indices + header->IndexBytes / sizeof(uint16_t));
+            } else {
+                const unsigned int* Indices = (const unsigned int*)(data + header->IndexOffset);
+                mIndexTable->mIndices.assign(Indices, Indices + header->IndexBytes / sizeof(unsigned int));
+            }
+            mIndexTable->mListBytes = header->ListBytes;
+            mIndexTable->mBuilt = true;
+        }
+    }
+
+    mPatchHeights.set_all(mNumPatchesX, mNumPatchesZ, glm::vec2(0.0f));
+    memcpy(mPatchHeights.begin(), data + header->BoundsOffset, (size_t)mNumPatchesX * mNumPatchesZ * sizeof(glm::vec2));
+    mHeightRange = glm::vec2(header->HeightMin, header->HeightRange);
+    printf("Loaded cooked terrain '%s'\n", path);
+    return true;
+}
+
+// Written next to the final name and renamed, so a crash never leaves a torn cache
+void GeoMipGrid::SaveCache(const char* path, uint64_t Key) const {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    TerrainCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, TERRAIN_CACHE_MAGIC, 4);
+    header.Version = TERRAIN_CACHE_VERSION;
+    header.Key = Key;
+    header.Width = mWidth;
+    header.Depth = mDepth;
+    header.PatchSize = mPatchSize;
+    header.MaxLOD = mMaxLOD;
+    header.VertexFormat = mVertexFormat;
+    header.IndexType = mIndexTable->mIndexType;
+    header.HeightMin = mHeightRange.x;
+    header.HeightRange = mHeightRange.y;
+    header.ListBytes = mIndexTable->mListBytes;
+
+    const void* Vertices = mVertexFormat == TERRAIN_VERTEX_COMPACT ? (const void*)&mCompactVertices[0] : (const void*)&mVertices[0];
+    const void* Indices = mIndexTable->mIndexType == GL_UNSIGNED_SHORT ? (const void*)&mIndexTable->mIndices16[0] : (const void*)&mIndexTable->mIndices[0];
+    size_t LodBytes = mIndexTable->mLodInfo.size() * sizeof(LodInfo);
+    size_t BoundsBytes = (size_t)mNumPatchesX * mNumPatchesZ * sizeof(glm::vec2);
+
+    header.VertexOffset = sizeof(TerrainCacheHeader);
+    header.VertexBytes = getVertexBytes();
+    header.IndexOffset = AlignTerrainCacheOffset(header.VertexOffset + header.VertexBytes);
+    header.IndexBytes = mIndexTable->getBytes();
+    header.LodInfoOffset = AlignTerrainCacheOffset(header.IndexOffset + header.IndexBytes);
+    header.BoundsOffset = AlignTerrainCacheOffset(header.LodInfoOffset + LodBytes);
+    header.FileSize = header.BoundsOffset + BoundsBytes;
+
+    std::string TempPath = std::string(path) + ".tmp";
+    {
+        std::ofstream file(TempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            printf("%s:%d - error opening '%s'\n", __FILE__, __LINE__, TempPath.c_str());
+            return;
+        }
+        const char Padding[TERRAIN_CACHE_ALIGN] = {};
+        auto Pad = [&](uint64_t Offset) { file.write(Padding, Offset - (uint64_t)file.tellp()); };
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)Vertices, header.VertexBytes);
+        Pad(header.IndexOffset);
+        file.write((const char*)Indices, header.IndexBytes);
+        Pad(header.LodInfoOffset);
+        file.write((const char*)mIndexTable->mLodInfo.data(), LodBytes);
+        Pad(header.BoundsOffset);
+        file.write((const char*)mPatchHeights.begin(), BoundsBytes);
+        if (!file) {
+            printf("%s:%d - error writing '%s'\n", __FILE__, __LINE__, TempPath.c_str());
+            return;
+        }
+    }
+    std::filesystem::rename(TempPath, path, ec);
+    if (ec) printf("%s:%d - error renaming '%s'\n", __FILE__, __LINE__, TempPath.c_str());
+}
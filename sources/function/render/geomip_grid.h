@@ -2,27 +2,154 @@
 #define __GEOMIP_GRID_H__
 
 #include <iostream>
+#include <string>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <future>
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 
 #include "lod_manager.h"
+#include "frustum.h"
+#include "terrain_vertex.h"
 #include "core/qgemath.h"
+#include "core/qgemmap.h"
 
 class Terrain;
 
+// layout fixed by glMultiDrawElementsIndirect
+typedef struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+} DrawElementsIndirectCommand;
+
+typedef struct SingleLodInfo {
+    int start = 0;
+    int count = 0;
+    bool strip = false;     // GL_TRIANGLE_STRIP with primitive restart instead of GL_TRIANGLES
+} SingleLodInfo;
+#define LEFT   2
+#define RIGHT  2
+#define TOP    2
+#define BOTTOM 2
+typedef struct LodInfo {
+    SingleLodInfo info[LEFT][RIGHT][TOP][BOTTOM];
+} LodInfo;
+
+// The stitched index patterns depend only on the grid width (row stride) and the
+// patch size, so every GeoMipGrid with the same pair shares one table and one EBO.
+//
+// Compact tables turn each permutation into triangle strips joined by the fixed
+// restart index when that is shorter, and store 16-bit indices when the largest
+// patch-local index ((PatchSize - 1) * (Width + 1), BaseVertex adds the rest) fits.
+class GeoMipIndexTable {
+public:
+    static std::shared_ptr<GeoMipIndexTable> Acquire(int Width, int PatchSize, bool Compact);
+
+    size_t getBytes() const {
+        return mIndexType == GL_UNSIGNED_SHORT ? mIndices16.size() * sizeof(uint16_t) : mIndices.size() * sizeof(unsigned int);
+    }
+
+    std::mutex mMutex;                  // held while the first user fills the table
+    bool mBuilt = false;
+    bool mCompact = false;
+    std::vector<unsigned int> mIndices;
+    std::vector<uint16_t> mIndices16;   // instead of mIndices when mIndexType is GL_UNSIGNED_SHORT
+    GLenum mIndexType = GL_UNSIGNED_INT;
+    std::vector<LodInfo> mLodInfo;
+    size_t mListBytes = 0;              // size of the plain 32-bit triangle lists
+    unsigned int EBO = 0;               // created by the first Upload, GL thread only
+};
+
 class GeoMipGrid {
 public:
     GeoMipGrid() {};
     ~GeoMipGrid() = default;
+    // Build + Upload
     void Create(int w, int d, int patchSize, const Terrain* pterrain);
-    void Draw(const glm::vec3 CameraPos);
+    // CPU half: vertices, normals, patch bounds and the shared index table. No GL calls,
+    // can run on any thread. With a cache directory set, a matching cooked file is
+    // mapped instead and a missing one is written.
+    void Build(int w, int d, int patchSize, const Terrain* pterrain);
+    // GL half, on the GL thread after Build
+    void Upload();
+    // Upload spread over frames: sends at most Budget bytes of vertices per call and
+    // takes them off Budget. True once the buffers are complete and the CPU copy freed;
+    // the grid must not be drawn before that.
+    bool UploadStep(size_t& Budget);
+    // configuration only (formats, cache, culling, LOD mode), before Build
+    void CopySettings(const GeoMipGrid& other) {
+        mVertexFormat = other.mVertexFormat;
+        mCompactIndices = other.mCompactIndices;
+        mCacheDir = other.mCacheDir;
+        mHorizonCulling = other.mHorizonCulling;
+        mLodManager.SetLodMode(other.mLodManager.GetLodMode());
+    }
+    // directory for cooked grids (see terrain_cache.h), empty disables the cache
+    void setCacheDir(const std::string& dir) { mCacheDir = dir; }
+    // CameraPos and ViewProj are in the terrain's local space (ViewProj = projection * view * model)
+    void Draw(const glm::vec3 CameraPos, const glm::mat4& ViewProj);
+    // Starts BuildDrawCommands on the thread pool; the next Draw picks up the result
+    // instead of building the commands itself. No GL calls are made off the main thread.
+    void PrepareDraw(const glm::vec3 CameraPos, const glm::mat4& ViewProj);
+    // LOD update + culling -> one indirect command per visible patch. CPU only.
+    // Triangle list commands come first, the last getNumStripCommands() are strips.
+    void BuildDrawCommands(const glm::vec3& CameraPos, const glm::mat4& ViewProj,
+                           std::vector<DrawElementsIndirectCommand>& Commands);
     void Destroy() {
+        if (mPendingDraw.valid()) mPendingDraw.wait();
+        if (mIndirectBuffer > 0) glDeleteBuffers(1, &mIndirectBuffer);
+        mIndirectBuffer = 0;
+        mIndirectCapacity = 0;
         if (VAO > 0) glDeleteVertexArrays(1, &VAO);
         if (VBO > 0) glDeleteBuffers(1, &VBO);
-        if (EBO > 0) glDeleteBuffers(1, &EBO);
+        VAO = VBO = 0;
+        mUploading = false;
+        // the last grid using the table frees its EBO; the CPU indices stay for later uploads
+        if (mIndexTable && mIndexTable.use_count() == 1 && mIndexTable->EBO > 0) {
+            glDeleteBuffers(1, &mIndexTable->EBO);
+            mIndexTable->EBO = 0;
+        }
+        mIndexTable.reset();
+        if (mNormalTexture > 0) glDeleteTextures(1, &mNormalTexture);
+        mNormalTexture = 0;
     }
+    // bytes held by the vertex buffer (or the CPU vertices before Upload)
+    size_t getVertexBytes() const { 
+        return (size_t)mWidth * mDepth * (mVertexFormat == TERRAIN_VERTEX_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex)); 
+    }
+    // 16-bit indices and triangle strips, takes effect at the next Build
+    void setCompactIndices(bool enable) { mCompactIndices = enable; }
+    // index buffer bytes saved against plain 32-bit triangle lists
+    size_t getIndexBytesSaved() const { return mIndexTable ? mIndexTable->mListBytes - mIndexTable->getBytes() : 0; }
+    int getNumStripCommands() const { return mNumStripCommands; }
+    // takes effect at the next Build; the compact format needs terrain_compact.vs
+    void setVertexFormat(TerrainVertexFormat Format) { mVertexFormat = Format; }
+    TerrainVertexFormat getVertexFormat() const { return mVertexFormat; }
+    // (min, max - min) the compact heights are quantized against
+    glm::vec2 getHeightRange() const { return mHeightRange; }
     glm::vec2 getCenterPos() { return glm::vec2(mDepth / 2 * mWorldScale,  mWidth / 2 * mWorldScale); };
+    // LOD selection only; Draw/BuildDrawCommands do it too, repeating it for the same
+    // camera position costs nothing
+    void UpdateLod(const glm::vec3& CameraPos) { mLodManager.Update(CameraPos); }
+    LODManager& getLodManager() { return mLodManager; }
+    int getNumPatchesX() const { return mNumPatchesX; }
+    int getNumPatchesZ() const { return mNumPatchesZ; }
+    // mWidth x mDepth GL_RGB16F texture of the vertex normals, created on first use
+    unsigned int CreateNormalTexture();
+    void setHorizonCulling(bool enable) { mHorizonCulling = enable; }
+    int getNumDrawnPatches() const { return mNumDrawn; }
+    int getNumCulledPatches() const { return mNumCulled; }
+    int getNumLodPatchesTouched() const { return mLodManager.GetNumTouched(); }
+    // the screen-space error mode computes the per-patch errors on first use
+    void setLodMode(LodMode Mode);
+    void setScreenErrorParams(float PixelThreshold, float FovY, float ViewportHeight) {
+        mLodManager.SetScreenErrorParams(PixelThreshold, FovY, ViewportHeight);
+    }
 
 private:
     typedef struct Vertex {
@@ -32,11 +159,15 @@ private:
         void InitVertex(const Terrain* pTerrain, int x, int z);
     } Vertex;
 
-    void setupGrid(const Terrain* pterrain);
     unsigned int AddTriangle(unsigned int Index, std::vector<unsigned int>& Indices, 
                             unsigned int v1, unsigned int v2, unsigned int v3);
-    void CalcNormals(std::vector<Vertex>& Vertices, std::vector<unsigned int>& Indices);
+    void CalcNormals(const Terrain* pTerrain, glm::vec3* Normals, size_t Stride);
+    void CalcPatchBounds(const Terrain* pTerrain);
+    void CalcPatchErrors(const Terrain* pTerrain, std::vector<float>& Errors);
+    bool IsPatchVisible(int PatchX, int PatchZ, const glm::vec3& CameraPos, const Frustum& frustum) const;
+    bool IsOccluded(const glm::vec3& Eye, const glm::vec3& Target) const;
     void InitVertices(const Terrain* pTerrain, std::vector<Vertex>& Vertices);
+    void InitCompactVertices(const Terrain* pTerrain, std::vector<CompactVertex>& Vertices);
     int InitIndices(std::vector<unsigned int>& Indices);
     int InitIndicesLOD(int Index, std::vector<unsigned int>& Indices, int lod);
     int InitIndicesLODSingle(int Index, std::vector<unsigned int>& Indices, 
@@ -44,31 +175,47 @@ private:
     unsigned int CreateTriangleFan(int Index, std::vector<unsigned int>& Indices, 
             int lodCore, int lodLeft, int lodRight, int lodTop, int lodBottom, int x, int z);
     int CalcNumIndices();
+    void CompactIndices();
+    uint64_t CalcCacheKey(const Terrain* pTerrain) const;
+    bool LoadCache(const char* path, uint64_t Key);
+    void SaveCache(const char* path, uint64_t Key) const;
 
     int mWidth = 0;
     int mDepth = 0;
     int mPatchSize = 0;
     float mWorldScale = 1.0f;
-    unsigned int VAO, VBO, EBO;
+    unsigned int VAO = 0, VBO = 0;
+    unsigned int mNormalTexture = 0;
 
     int mMaxLOD = 0;
     LODManager mLodManager;
-    typedef struct SingleLodInfo {
-        int start = 0;
-        int count = 0;
-    } SingleLodInfo;
-    #define LEFT   2
-    #define RIGHT  2
-    #define TOP    2
-    #define BOTTOM 2
-    typedef struct LodInfo {
-        SingleLodInfo info[LEFT][RIGHT][TOP][BOTTOM];
-    } LodInfo;
-    std::vector<LodInfo> mLodInfo;
+    std::shared_ptr<GeoMipIndexTable> mIndexTable;
+    TerrainVertexFormat mVertexFormat = TERRAIN_VERTEX_FULL;
+    bool mCompactIndices = false;
+    std::vector<Vertex> mVertices;      // between Build and Upload
+    std::vector<CompactVertex> mCompactVertices;
+    glm::vec2 mHeightRange = glm::vec2(0.0f);
+    std::string mCacheDir;
+    MappedFile mCacheFile;              // cooked grid between Build and Upload
+    size_t mUploadOffset = 0;           // vertex bytes sent by UploadStep so far
+    bool mUploading = false;
     int mNumPatchesX = 0;
     int mNumPatchesZ = 0;
 
-    const Terrain* m_Terrain;
+    Array2d<glm::vec2> mPatchHeights;     // (min, max) height of every patch
+    bool mHorizonCulling = false;
+    bool mHasPatchErrors = false;
+    int mNumDrawn = 0;
+    int mNumCulled = 0;
+
+    std::vector<DrawElementsIndirectCommand> mCommands;
+    std::vector<DrawElementsIndirectCommand> mStripCommands;    // scratch for BuildDrawCommands
+    int mNumStripCommands = 0;
+    std::future<void> mPendingDraw;
+    unsigned int mIndirectBuffer = 0;
+    size_t mIndirectCapacity = 0;       // in commands
+
+    const Terrain* m_Terrain = nullptr;
 };
 
 #endif // !__GEOMIP_GRID_H__
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "height_pyramid.h"
+#include "terrain.h"
+#include "core/qgesimd.h"
+#include "core/qgethreadpool.h"
+
+#include <algorithm>
+
+void HeightPyramid::Build(const Terrain* pTerrain) {
+    mTerrain = pTerrain;
+    mSize = pTerrain->getSize();
+    mCells = mSize - 1;
+    mWorldScale = pTerrain->GetWorldScale();
+    mLevels.clear();
+    if (mCells < 1) return;
+
+    int n = (mCells + HEIGHT_PYRAMID_LEAF - 1) / HEIGHT_PYRAMID_LEAF;
+    Array2d<glm::vec2> Leaves;
+    Leaves.set_all(n, n, glm::vec2(0.0f));
+
+    ThreadPool::Global().ParallelFor(0, n, [&](int BlockBegin, int BlockEnd) {
+        std::vector<float> scratch(mSize);
+        for (int bx = BlockBegin; bx < BlockEnd; bx++) {
+            // a block of cells spans LEAF + 1 samples, neighbours share the edge
+            int x0 = bx * HEIGHT_PYRAMID_LEAF;
+            int x1 = std::min(x0 + HEIGHT_PYRAMID_LEAF, mCells);
+            for (int x = x0; x <= x1; x++) {
+                const float* row = mTerrain->GetHeightRow(x, &scratch[0]);
+                for (int bz = 0; bz < n; bz++) {
+                    int z0 = bz * HEIGHT_PYRAMID_LEAF;
+                    int z1 = std::min(z0 + HEIGHT_PYRAMID_LEAF, mCells);
+                    float minH, maxH;
+                    SimdMinMax(row + z0, z1 - z0 + 1, minH, maxH);
+                    glm::vec2* bounds = Leaves.get_a(bx, bz);
+                    if (x == x0) {
+                        *bounds = glm::vec2(minH, maxH);
+                    } else {
+                        bounds->x = std::min(bounds->x, minH);
+                        bounds->y = std::max(bounds->y, maxH);
+                    }
+                }
+            }
+        }
+    }, 4);
+    mLevels.push_back(std::move(Leaves));
+
+    while (n > 1) {
+        const Array2d<glm::vec2>& Prev = mLevels.back();
+        int m = (n + 1) / 2;
+        Array2d<glm::vec2> Level;
+        Level.set_all(m, m, glm::vec2(0.0f));
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < m; j++) {
+                glm::vec2 b = Prev.get(2 * i, 2 * j);
+                for (int c = 1; c < 4; c++) {
+                    int ci = 2 * i + (c & 1), cj = 2 * j + (c >> 1);
+                    if (ci >= n || cj >= n) continue;
+                    b.x = std::min(b.x, Prev.get(ci, cj).x);
+                    b.y = std::max(b.y, Prev.get(ci, cj).y);
+                }
+                Level.set(i, j, b);
+            }
+        }
+        mLevels.push_back(std::move(Level));
+        n = m;
+    }
+}
+
+size_t HeightPyramid::getBytes() const {
+    size_t Bytes = 0;
+    for (const Array2d<glm::vec2>& Level : mLevels) Bytes += Level.raw() * Level.col() * sizeof(glm::vec2);
+    return Bytes;
+}
+
+float HeightPyramid::GetHeightInterpolated(float x, float z) const {
+    x = glm::clamp(x, 0.0f, (float)mCells);
+    z = glm::clamp(z, 0.0f, (float)mCells);
+    int ix = std::min((int)x, mCells - 1);
+    int iz = std::min((int)z, mCells - 1);
+    float fx = x - (float)ix, fz = z - (float)iz;
+
+    float h00 = mTerrain->GetHeight(ix, iz);
+    float h10 = mTerrain->GetHeight(ix + 1, iz);
+    float h01 = mTerrain->GetHeight(ix, iz + 1);
+    float h11 = mTerrain->GetHeight(ix + 1, iz + 1);
+    float h0 = h00 + (h10 - h00) * fx;
+    float h1 = h01 + (h11 - h01) * fx;
+    return h0 + (h1 - h0) * fz;
+}
+
+// clips [t0, t1] to the slab lo <= o + d * t <= hi
+static bool ClipSlab(float o, float d, float lo, float hi, float& t0, float& t1) {
+    if (d == 0.0f) return o >= lo && o <= hi;
+    float a = (lo - o) / d, b = (hi - o) / d;
+    if (a > b) std::swap(a, b);
+    t0 = std::max(t0, a);
+    t1 = std::min(t1, b);
+    return t0 <= t1;
+}
+
+bool HeightPyramid::Raycast(const TerrainRay& ray, TerrainRayHit& hit) const {
+    hit.Hit = false;
+    float Length = glm::length(ray.Dir);
+    if (mLevels.empty() || Length <= 0.0f) return false;
+
+    // grid space: one unit per cell in x/z, t stays the world distance
+    glm::vec3 Dir = ray.Dir / Length;
+    glm::vec3 o(ray.Origin.x / mWorldScale, ray.Origin.y, ray.Origin.z / mWorldScale);
+    glm::vec3 d(Dir.x / mWorldScale, Dir.y, Dir.z / mWorldScale);
+
+    struct Node {
+        int Level, x, z;
+        float tNear, tFar;
+    };
+    Node Stack[4 * 64];
+    int Top = 0;
+    float Best = ray.MaxDistance;
+
+    auto Visit = [&](int Level, int x, int z, Node& n) {
+        int Extent = HEIGHT_PYRAMID_LEAF << Level;
+        const glm::vec2& h = mLevels[Level].get(x, z);
+        float t0 = 0.0f, t1 = Best;
+        if (!ClipSlab(o.x, d.x, (float)(x * Extent), (float)std::min((x + 1) * Extent, mCells), t0, t1)) return false;
+        if (!ClipSlab(o.z, d.z, (float)(z * Extent), (float)std::min((z + 1) * Extent, mCells), t0, t1)) return false;
+        if (!ClipSlab(o.y, d.y, h.x, h.y, t0, t1)) return false;
+        n = { Level, x, z, t0, t1 };
+        return true;
+    };
+
+    int Root = (int)mLevels.size() - 1;
+    if (Visit(Root, 0, 0, Stack[Top])) Top++;
+
+    while (Top > 0) {
+        Node n = Stack[--Top];
+        if (n.tNear > Best) continue;
+
+        if (n.Level == 0) {
+            float tHit;
+            if (RaycastLeaf(o, d, n.x, n.z, n.tNear, std::min(n.tFar, Best), tHit) && tHit <= Best) {
+                Best = tHit;
+                hit.Hit = true;
+            }
+            continue;
+        }
+
+        // children pushed far to near, so the nearest is taken next
+        Node Children[4];
+        int Count = 0;
+        int Size = (int)mLevels[n.Level - 1].raw();
+        for (int c = 0; c < 4; c++) {
+            int cx = 2 * n.x + (c & 1), cz = 2 * n.z + (c >> 1);
+            if (cx < Size && cz < Size && Visit(n.Level - 1, cx, cz, Children[Count])) Count++;
+        }
+        std::sort(Children, Children + Count, [](const Node& a, const Node& b) { return a.tNear > b.tNear; });
+        for (int i = 0; i < Count; i++) Stack[Top++] = Children[i];
+    }
+
+    if (hit.Hit) {
+        hit.Distance = Best;
+        hit.Pos = ray.Origin + Dir * Best;
+    }
+    return hit.Hit;
+}
+
+void HeightPyramid::Raycast(const TerrainRay* rays, TerrainRayHit* hits, int count) const {
+    ThreadPool::Global().ParallelFor(0, count, [&](int Begin, int End) {
+        for (int i = Begin; i < End; i++) Raycast(rays[i], hits[i]);
+    }, 64);
+}
+
+// 2D DDA over the cells of one leaf block between tNear and tFar
+bool HeightPyramid::RaycastLeaf(const glm::vec3& o, const glm::vec3& d, int BlockX, int BlockZ,
+                                float tNear, float tFar, float& tHit) const {
+    int x0 = BlockX * HEIGHT_PYRAMID_LEAF, x1 = std::min(x0 + HEIGHT_PYRAMID_LEAF, mCells);
+    int z0 = BlockZ * HEIGHT_PYRAMID_LEAF, z1 = std::min(z0 + HEIGHT_PYRAMID_LEAF, mCells);
+
+    float t = tNear;
+    int cx = glm::clamp((int)floorf(o.x + d.x * t), x0, x1 - 1);
+    int cz = glm::clamp((int)floorf(o.z + d.z * t), z0, z1 - 1);
+    int StepX = d.x > 0.0f ? 1 : -1, StepZ = d.z > 0.0f ? 1 : -1;
+    float tDeltaX = d.x != 0.0f ? fabsf(1.0f / d.x) : FLT_MAX;
+    float tDeltaZ = d.z != 0.0f ? fabsf(1.0f / d.z) : FLT_MAX;
+    float tMaxX = d.x != 0.0f ? ((float)(d.x > 0.0f ? cx + 1 : cx) - o.x) / d.x : FLT_MAX;
+    float tMaxZ = d.z != 0.0f ? ((float)(d.z > 0.0f ? cz + 1 : cz) - o.z) / d.z : FLT_MAX;
+
+    for (;;) {
+        float tExit = std::min(std::min(tMaxX, tMaxZ), tFar);
+        if (IntersectCell(o, d, cx, cz, t, tExit, tHit)) return true;
+        if (tExit >= tFar) return false;
+
+        t = tExit;
+        if (tMaxX < tMaxZ) {
+            cx += StepX;
+            tMaxX += tDeltaX;
+        } else {
+            cz += StepZ;
+            tMaxZ += tDeltaZ;
+        }
+        if (cx < x0 || cx >= x1 || cz < z0 || cz >= z1) return false;
+    }
+}
+
+// Along the ray the bilinear height of a cell is quadratic in t, so the first
+// crossing in [t0, t1] is a root of ray.y(t) - h(t).
+bool HeightPyramid::IntersectCell(const glm::vec3& o, const glm::vec3& d, int cx, int cz,
+                                  float t0, float t1, float& tHit) const {
+    double h00 = mTerrain->GetHeight(cx, cz);
+    double h10 = mTerrain->GetHeight(cx + 1, cz);
+    double h01 = mTerrain->GetHeight(cx, cz + 1);
+    double h11 = mTerrain->GetHeight(cx + 1, cz + 1);
+    double b = h10 - h00, c = h01 - h00, e = h00 - h10 - h01 + h11;
+    double u0 = o.x - cx, v0 = o.z - cz;
+    double du = d.x, dv = d.z;
+
+    double A = -e * du * dv;
+    double B = d.y - (b * du + c * dv + e * (u0 * dv + v0 * du));
+    double C = o.y - (h00 + b * u0 + c * v0 + e * u0 * v0);
+
+    // already at or below the surface where the ray enters the cell
+    if ((A * t0 + B) * t0 + C <= 0.0) {
+        tHit = t0;
+        return true;
+    }
+
+    double Roots[2];
+    int NumRoots = 0;
+    if (fabs(A) < 1e-12) {
+        if (B != 0.0) Roots[NumRoots++] = -C / B;
+    } else {
+        double Disc = B * B - 4.0 * A * C;
+        if (Disc < 0.0) return false;
+        double q = -0.5 * (B + (B >= 0.0 ? sqrt(Disc) : -sqrt(Disc)));
+        Roots[NumRoots++] = q / A;
+        if (q != 0.0) Roots[NumRoots++] = C / q;
+    }
+
+    bool Found = false;
+    double Best = t1;
+    for (int i = 0; i < NumRoots; i++) {
+        if (Roots[i] >= t0 && Roots[i] <= Best) {
+            Best = Roots[i];
+            Found = true;
+        }
+    }
+    if (Found) tHit = (float)Best;
+    return Found;
+}
@@ -0,0 +1,70 @@
+#ifndef __HEIGHT_PYRAMID_H__
+#define __HEIGHT_PYRAMID_H__
+
+#include <vector>
+#include <float.h>
+#include <glm/glm.hpp>
+
+#include "core/qgearray.h"
+
+class Terrain;
+
+#define HEIGHT_PYRAMID_LEAF 4      // cells per side of a level 0 node
+
+typedef struct TerrainRay {
+    glm::vec3 Origin;               // terrain local space, x/z in world units
+    glm::vec3 Dir;                  // does not have to be normalized
+    float MaxDistance = FLT_MAX;
+} TerrainRay;
+
+typedef struct TerrainRayHit {
+    bool Hit = false;
+    float Distance = 0.0f;          // along the normalized direction
+    glm::vec3 Pos = glm::vec3(0.0f);
+} TerrainRayHit;
+
+/*
+ * Min/max height quadtree over the heightmap cells. Level 0 stores the (min, max)
+ * of HEIGHT_PYRAMID_LEAF x HEIGHT_PYRAMID_LEAF cell blocks, every level above
+ * halves both sizes up to a single node. Rays descend front to back and skip
+ * whole subtrees whose box they miss, so a query visits O(log n) nodes before the
+ * cells of the first leaf it reaches are tested against the bilinear surface.
+ *
+ * Read only after Build: any number of threads can query at the same time.
+ */
+class HeightPyramid {
+public:
+    HeightPyramid() {};
+    ~HeightPyramid() = default;
+
+    // heights through pTerrain->GetHeightRow, no GL calls, can run on any thread
+    void Build(const Terrain* pTerrain);
+    void Destroy() { mLevels.clear(); mTerrain = nullptr; }
+    bool IsBuilt() const { return !mLevels.empty(); }
+    size_t getBytes() const;
+    // level 0 nodes span HEIGHT_PYRAMID_LEAF cells, each level above twice as many
+    int getNumLevels() const { return (int)mLevels.size(); }
+    int getLevelSize(int Level) const { return (int)mLevels[Level].raw(); }
+    // (min, max) height of node (x, z) of a level
+    const glm::vec2& GetBounds(int Level, int x, int z) const { return mLevels[Level].get(x, z); }
+
+    // (x, z) in grid units, clamped to the map
+    float GetHeightInterpolated(float x, float z) const;
+    bool Raycast(const TerrainRay& ray, TerrainRayHit& hit) const;
+    // splits the rays over the thread pool
+    void Raycast(const TerrainRay* rays, TerrainRayHit* hits, int count) const;
+
+private:
+    bool RaycastLeaf(const glm::vec3& o, const glm::vec3& d, int BlockX, int BlockZ,
+                     float tNear, float tFar, float& tHit) const;
+    bool IntersectCell(const glm::vec3& o, const glm::vec3& d, int cx, int cz,
+                       float t0, float t1, float& tHit) const;
+
+    const Terrain* mTerrain = nullptr;
+    int mSize = 0;                  // samples per side
+    int mCells = 0;                 // mSize - 1
+    float mWorldScale = 1.0f;
+    std::vector<Array2d<glm::vec2>> mLevels;
+};
+
+#endif // !__HEIGHT_PYRAMID_H__
@@ -0,0 +1,235 @@
+#include "heightmap_file.h"
+#include "core/qgehash.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+static int TileShiftOf(int TileSize) {
+    int shift = 0;
+    while ((1 << shift) < TileSize) shift++;
+    return shift;
+}
+
+bool HeightMapFile::Open(const char* path) {
+    Close();
+    if (!mFile.Open(path)) {
+        printf("%s:%d - can't map '%s'\n", __FILE__, __LINE__, path);
+        return false;
+    }
+
+    const HeightMapHeader* header = (const HeightMapHeader*)mFile.data();
+    if (mFile.size() < sizeof(HeightMapHeader) || memcmp(header->Magic, HEIGHTMAP_FILE_MAGIC, 4) != 0)
+        return OpenLegacy(path);
+
+    if (header->Version != HEIGHTMAP_FILE_VERSION) {
+        printf("%s:%d - '%s' has unsupported version %u\n", __FILE__, __LINE__, path, header->Version);
+        Close();
+        return false;
+    }
+
+    uint32_t ts = header->TileSize;
+    if (ts == 0 || (ts & (ts - 1)) != 0 || header->Format > HEIGHTMAP_FORMAT_U16 ||
+        header->NumTilesX != (header->Width + ts - 1) / ts || header->NumTilesZ != (header->Depth + ts - 1) / ts) {
+        printf("%s:%d - '%s' has a corrupted header\n", __FILE__, __LINE__, path);
+        Close();
+        return false;
+    }
+
+    size_t NumTiles = (size_t)header->NumTilesX * header->NumTilesZ;
+    size_t TileBytes = (size_t)ts * ts * (header->Format == HEIGHTMAP_FORMAT_F32 ? sizeof(float) : sizeof(uint16_t));
+    if (header->TableOffset + NumTiles * sizeof(HeightMapTile) > mFile.size()) {
+        printf("%s:%d - '%s' is truncated\n", __FILE__, __LINE__, path);
+        Close();
+        return false;
+    }
+
+    // only the header and the tile table are touched here, samples stay on disk until used
+    const HeightMapTile* tiles = (const HeightMapTile*)(mFile.data() + header->TableOffset);
+    for (size_t i = 0; i < NumTiles; i++) {
+        if (tiles[i].Offset + TileBytes > mFile.size()) {
+            printf("%s:%d - '%s' is truncated\n", __FILE__, __LINE__, path);
+            Close();
+            return false;
+        }
+    }
+
+    mTiles = tiles;
+    mFormat = (HeightMapFormat)header->Format;
+    mWidth = (int)header->Width;
+    mDepth = (int)header->Depth;
+    mTileSize = (int)ts;
+    mTileShift = TileShiftOf(mTileSize);
+    mTileMask = mTileSize - 1;
+    mNumTilesX = (int)header->NumTilesX;
+    mNumTilesZ = (int)header->NumTilesZ;
+    mMinH = header->MinHeight;
+    mMaxH = header->MaxHeight;
+    mContentHash = header->ContentHash;
+    return true;
+}
+
+bool HeightMapFile::OpenLegacy(const char* path) {
+    size_t size = mFile.size();
+    if (size % sizeof(float) != 0) {
+        printf("%s:%d - '%s' does not contain an whole number of floats (size %zu)\n", __FILE__, __LINE__, path, size);
+        Close();
+        return false;
+    }
+
+    int TerrainSize = (int)sqrtf((float)size / (float)sizeof(float));
+    if ((size_t)TerrainSize * TerrainSize != size / sizeof(float)) {
+        printf("%s:%d - '%s' does not contain a square height map - size %zu\n", __FILE__, __LINE__, path, size);
+        Close();
+        return false;
+    }
+
+    mSamples = (const float*)mFile.data();
+    mFormat = HEIGHTMAP_FORMAT_F32;
+    mWidth = mDepth = TerrainSize;
+    mContentHash = 0;
+    return true;
+}
+
+void HeightMapFile::Close() {
+    mFile.Close();
+    mSamples = nullptr;
+    mTiles = nullptr;
+    mWidth = mDepth = 0;
+    mTileSize = mTileShift = mTileMask = 0;
+    mNumTilesX = mNumTilesZ = 0;
+    mMinH = mMaxH = 0.0f;
+    mContentHash = 0;
+}
+
+void HeightMapFile::ReadRegion(int x0, int z0, int Width, int Depth, float* dst) const {
+    assert(x0 >= 0 && z0 >= 0 && x0 + Width <= mWidth && z0 + Depth <= mDepth);
+
+    if (mTiles == nullptr) {
+        for (int x = 0; x < Width; x++)
+            memcpy(dst + (size_t)x * Depth, mSamples + (size_t)(x0 + x) * mDepth + z0, Depth * sizeof(float));
+        return;
+    }
+
+    // walk tile by tile so each tile's pages are touched once
+    for (int x = x0; x < x0 + Width; ) {
+        int TileX = x >> mTileShift;
+        int xEnd = std::min((TileX + 1) << mTileShift, x0 + Width);
+        for (int z = z0; z < z0 + Depth; ) {
+            int TileZ = z >> mTileShift;
+            int zEnd = std::min((TileZ + 1) << mTileShift, z0 + Depth);
+            const HeightMapTile& tile = GetTile(TileX, TileZ);
+            const void* p = GetTileData(TileX, TileZ);
+            for (int tx = x; tx < xEnd; tx++) {
+                size_t local = ((size_t)(tx & mTileMask) << mTileShift) + (z & mTileMask);
+                float* out = dst + (size_t)(tx - x0) * Depth + (z - z0);
+                if (mFormat == HEIGHTMAP_FORMAT_F32) {
+                    memcpy(out, (const float*)p + local, (zEnd - z) * sizeof(float));
+                } else {
+                    const uint16_t* q = (const uint16_t*)p + local;
+                    float scale = (tile.MaxHeight - tile.MinHeight) * (1.0f / 65535.0f);
+                    for (int i = 0; i < zEnd - z; i++) out[i] = tile.MinHeight + (float)q[i] * scale;
+                }
+            }
+            z = zEnd;
+        }
+        x = xEnd;
+    }
+}
+
+bool HeightMapFile::Save(const char* path, const float* heights, int Width, int Depth,
+                         HeightMapFormat Format, int TileSize) {
+    if (TileSize <= 0 || (TileSize & (TileSize - 1)) != 0) {
+        printf("%s:%d - tile size must be a power of two (%d)\n", __FILE__, __LINE__, TileSize);
+        return false;
+    }
+
+    HeightMapHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, HEIGHTMAP_FILE_MAGIC, 4);
+    header.Version = HEIGHTMAP_FILE_VERSION;
+    header.Width = Width;
+    header.Depth = Depth;
+    header.TileSize = TileSize;
+    header.Format = Format;
+    header.NumTilesX = (Width + TileSize - 1) / TileSize;
+    header.NumTilesZ = (Depth + TileSize - 1) / TileSize;
+    header.TableOffset = sizeof(HeightMapHeader);
+
+    size_t NumTiles = (size_t)header.NumTilesX * header.NumTilesZ;
+    size_t SampleSize = Format == HEIGHTMAP_FORMAT_F32 ? sizeof(float) : sizeof(uint16_t);
+    size_t TileBytes = (size_t)TileSize * TileSize * SampleSize;
+    size_t DataOffset = header.TableOffset + NumTiles * sizeof(HeightMapTile);
+    DataOffset = (DataOffset + HEIGHTMAP_DATA_ALIGNMENT - 1) / HEIGHTMAP_DATA_ALIGNMENT * HEIGHTMAP_DATA_ALIGNMENT;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        printf("%s:%d - error opening '%s'\n", __FILE__, __LINE__, path);
+        return false;
+    }
+
+    // header and table are rewritten once the tiles are known, tiles are streamed out
+    std::vector<HeightMapTile> tiles(NumTiles);
+    std::vector<char> padding(DataOffset - sizeof(HeightMapHeader), 0);
+    file.write((const char*)&header, sizeof(header));
+    file.write(padding.data(), padding.size());
+
+    std::vector<float> samples((size_t)TileSize * TileSize);
+    std::vector<unsigned char> out(TileBytes);
+    header.MinHeight = heights[0];
+    header.MaxHeight = heights[0];
+    uint64_t hash = HashValue(header.Width);
+    hash = HashValue(header.Depth, hash);
+
+    for (uint32_t TileX = 0; TileX < header.NumTilesX; TileX++) {
+        for (uint32_t TileZ = 0; TileZ < header.NumTilesZ; TileZ++) {
+            size_t index = (size_t)TileX * header.NumTilesZ + TileZ;
+            HeightMapTile& tile = tiles[index];
+            tile.Offset = DataOffset + index * TileBytes;
+
+            // gather the tile, clamping the padding to the last row/column
+            float minH = heights[(size_t)TileX * TileSize * Depth + TileZ * TileSize];
+            float maxH = minH;
+            for (int lx = 0; lx < TileSize; lx++) {
+                int x = std::min((int)TileX * TileSize + lx, Width - 1);
+                for (int lz = 0; lz < TileSize; lz++) {
+                    int z = std::min((int)TileZ * TileSize + lz, Depth - 1);
+                    float h = heights[(size_t)x * Depth + z];
+                    samples[lx * TileSize + lz] = h;
+                    minH = std::min(minH, h);
+                    maxH = std::max(maxH, h);
+                }
+            }
+            tile.MinHeight = minH;
+            tile.MaxHeight = maxH;
+            header.MinHeight = std::min(header.MinHeight, minH);
+            header.MaxHeight = std::max(header.MaxHeight, maxH);
+
+            if (Format == HEIGHTMAP_FORMAT_F32) {
+                memcpy(out.data(), samples.data(), TileBytes);
+            } else {
+                float range = maxH - minH;
+                float scale = range > 0.0f ? 65535.0f / range : 0.0f;
+                uint16_t* q = (uint16_t*)out.data();
+                for (size_t i = 0; i < samples.size(); i++)
+                    q[i] = (uint16_t)std::min(65535.0f, (samples[i] - minH) * scale + 0.5f);
+            }
+            hash = HashBytes(out.data(), TileBytes, hash);
+            file.write((const char*)out.data(), TileBytes);
+        }
+    }
+    header.ContentHash = hash;
+
+    file.seekp(0);
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)tiles.data(), NumTiles * sizeof(HeightMapTile));
+    if (!file) {
+        printf("%s:%d - error writing '%s'\n", __FILE__, __LINE__, path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,111 @@
+#ifndef __HEIGHTMAP_FILE_H__
+#define __HEIGHTMAP_FILE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "core/qgemmap.h"
+
+#define HEIGHTMAP_FILE_MAGIC        "QGHM"
+#define HEIGHTMAP_FILE_VERSION      1
+#define HEIGHTMAP_DEFAULT_TILE_SIZE 64      // 64 * 64 * 4 = 16KB, a whole number of pages
+#define HEIGHTMAP_DATA_ALIGNMENT    4096
+
+enum HeightMapFormat {
+    HEIGHTMAP_FORMAT_F32 = 0,   // raw floats
+    HEIGHTMAP_FORMAT_U16 = 1    // 16-bit quantized against the tile's min/max
+};
+
+/*
+ * File layout (little endian):
+ *   HeightMapHeader
+ *   HeightMapTile[NumTilesX * NumTilesZ]     at TableOffset
+ *   tile samples, page aligned               TileSize * TileSize samples per tile
+ * Tiles are x-major like Array2d (sample (x, z) is tile[x * TileSize + z]),
+ * edge tiles are padded by clamping so every tile has the same stride.
+ */
+struct HeightMapHeader {
+    char     Magic[4];
+    uint32_t Version;
+    uint32_t Width;         // samples along x
+    uint32_t Depth;         // samples along z
+    uint32_t TileSize;      // power of two
+    uint32_t Format;        // HeightMapFormat
+    uint32_t NumTilesX;
+    uint32_t NumTilesZ;
+    float    MinHeight;
+    float    MaxHeight;
+    uint64_t ContentHash;   // hash of the tile samples, identifies the heightmap
+    uint64_t TableOffset;
+};
+
+struct HeightMapTile {
+    uint64_t Offset;        // from the start of the file
+    float    MinHeight;
+    float    MaxHeight;
+};
+
+// Zero-copy view of a heightmap file. Supports the tiled container above and
+// the legacy headerless square float dump.
+class HeightMapFile {
+public:
+    HeightMapFile() {};
+    ~HeightMapFile() = default;
+
+    bool Open(const char* path);
+    void Close();
+    bool IsOpen() const { return mFile.IsOpen(); }
+
+    int GetWidth() const { return mWidth; }
+    int GetDepth() const { return mDepth; }
+    int GetTileSize() const { return mTileSize; }
+    int GetNumTilesX() const { return mNumTilesX; }
+    int GetNumTilesZ() const { return mNumTilesZ; }
+    HeightMapFormat GetFormat() const { return mFormat; }
+    bool IsTiled() const { return mTiles != nullptr; }
+    float GetMinHeight() const { return mMinH; }
+    float GetMaxHeight() const { return mMaxH; }
+    uint64_t GetContentHash() const { return mContentHash; }
+
+    inline float GetHeight(int x, int z) const;
+    const HeightMapTile& GetTile(int TileX, int TileZ) const { return mTiles[TileX * mNumTilesZ + TileZ]; }
+    // pointer into the mapping: const float* or const uint16_t* depending on GetFormat()
+    const void* GetTileData(int TileX, int TileZ) const { return mFile.data() + GetTile(TileX, TileZ).Offset; }
+    // copies a Width x Depth block starting at (x0, z0) into dst (x-major, dst[x * Depth + z])
+    void ReadRegion(int x0, int z0, int Width, int Depth, float* dst) const;
+
+    static bool Save(const char* path, const float* heights, int Width, int Depth,
+                     HeightMapFormat Format = HEIGHTMAP_FORMAT_F32, int TileSize = HEIGHTMAP_DEFAULT_TILE_SIZE);
+
+private:
+    MappedFile mFile;
+    const float* mSamples = nullptr;        // legacy untiled data
+    const HeightMapTile* mTiles = nullptr;
+    HeightMapFormat mFormat = HEIGHTMAP_FORMAT_F32;
+    int mWidth = 0;
+    int mDepth = 0;
+    int mTileSize = 0;
+    int mTileShift = 0;
+    int mTileMask = 0;
+    int mNumTilesX = 0;
+    int mNumTilesZ = 0;
+    float mMinH = 0.0f;
+    float mMaxH = 0.0f;
+    uint64_t mContentHash = 0;
+
+    bool OpenLegacy(const char* path);
+};
+
+inline float HeightMapFile::GetHeight(int x, int z) const {
+    if (mTiles == nullptr) return mSamples[(size_t)x * mDepth + z];
+
+    const HeightMapTile& tile = mTiles[(x >> mTileShift) * mNumTilesZ + (z >> mTileShift)];
+    size_t local = ((size_t)(x & mTileMask) << mTileShift) + (z & mTileMask);
+    const unsigned char* p = mFile.data() + tile.Offset;
+    if (mFormat == HEIGHTMAP_FORMAT_F32) return ((const float*)p)[local];
+
+    float scale = (tile.MaxHeight - tile.MinHeight) * (1.0f / 65535.0f);
+    return tile.MinHeight + (float)((const uint16_t*)p)[local] * scale;
+}
+
+#endif // !__HEIGHTMAP_FILE_H__
@@ -0,0 +1,104 @@
+#include "heightmap_noise.h"
+
+#include <math.h>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+// keep in step with asserts/shaders/heightmap_noise.comp
+
+uint32_t HeightHash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+static glm::vec2 Gradient(uint32_t ix, uint32_t iz, uint32_t Seed) {
+    uint32_t h = HeightHash(ix * 0x8da6b343U ^ HeightHash(iz * 0xd8163841U ^ Seed));
+    return glm::vec2((float)(h & 0xffffU), (float)(h >> 16)) / 32767.5f - 1.0f;
+}
+
+float GradientNoise(float x, float z, uint32_t Seed) {
+    float fx = floorf(x), fz = floorf(z);
+    uint32_t ix = (uint32_t)(int)fx, iz = (uint32_t)(int)fz;
+    float u = x - fx, v = z - fz;
+
+    float n00 = glm::dot(Gradient(ix, iz, Seed), glm::vec2(u, v));
+    float n10 = glm::dot(Gradient(ix + 1, iz, Seed), glm::vec2(u - 1.0f, v));
+    float n01 = glm::dot(Gradient(ix, iz + 1, Seed), glm::vec2(u, v - 1.0f));
+    float n11 = glm::dot(Gradient(ix + 1, iz + 1, Seed), glm::vec2(u - 1.0f, v - 1.0f));
+
+    // quintic fade
+    float su = u * u * u * (u * (u * 6.0f - 15.0f) + 10.0f);
+    float sv = v * v * v * (v * (v * 6.0f - 15.0f) + 10.0f);
+    float n0 = n00 + (n10 - n00) * su;
+    float n1 = n01 + (n11 - n01) * su;
+    return n0 + (n1 - n0) * sv;
+}
+
+float SynthesizeHeight(const HeightSynthParams& Params, int x, int z) {
+    float px = (float)x / (float)Params.Size * Params.Frequency;
+    float pz = (float)z / (float)Params.Size * Params.Frequency;
+    float Amp = 1.0f, AmpSum = 0.0f, Fbm = 0.0f, Ridge = 0.0f;
+    for (int o = 0; o < Params.Octaves; o++) {
+        float n = GradientNoise(px, pz, Params.Seed + (uint32_t)o * 0x9e3779b9U);
+        float r = 1.0f - fabsf(n) * 1.4f;
+        Fbm += Amp * n;
+        Ridge += Amp * r * r;
+        AmpSum += Amp;
+        px *= Params.Lacunarity;
+        pz *= Params.Lacunarity;
+        Amp *= Params.Gain;
+    }
+    // gradient noise stays within about +-0.7
+    float h = glm::clamp(Fbm / AmpSum * 0.7f + 0.5f, 0.0f, 1.0f);
+    h += (glm::clamp(Ridge / AmpSum, 0.0f, 1.0f) - h) * Params.Ridged;
+    return Params.MinHeight + h * (Params.MaxHeight - Params.MinHeight);
+}
+
+void SynthesizeHeights(const HeightSynthParams& Params, Array2d<float>& HeightMap, ThreadPool& pool) {
+    int Size = Params.Size;
+    HeightMap.set_all(Size, Size, 0.0f);
+    pool.ParallelFor(0, Size, [&](int xBegin, int xEnd) {
+        for (int x = xBegin; x < xEnd; x++) {
+            float* row = HeightMap[x];
+            for (int z = 0; z < Size; z++) row[z] = SynthesizeHeight(Params, x, z);
+        }
+    }, 8);
+    ThermalErosion(HeightMap, Params.ThermalIterations, Params.Talus, Params.ThermalRate, pool);
+}
+
+static inline float TalusFlux(float d, float Talus) {
+    return d > Talus ? d - Talus : (d < -Talus ? d + Talus : 0.0f);
+}
+
+void ThermalErosion(Array2d<float>& HeightMap, int Iterations, float Talus, float Rate, ThreadPool& pool) {
+    if (Iterations <= 0) return;
+    int Size = (int)HeightMap.raw();
+    Array2d<float> Temp(Size, Size);
+    Array2d<float>* Src = &HeightMap;
+    Array2d<float>* Dst = &Temp;
+
+    for (int i = 0; i < Iterations; i++) {
+        pool.ParallelFor(0, Size, [&](int xBegin, int xEnd) {
+            for (int x = xBegin; x < xEnd; x++) {
+                const float* cur = (*Src)[x];
+                const float* prev = (*Src)[x > 0 ? x - 1 : x];
+                const float* next = (*Src)[x < Size - 1 ? x + 1 : x];
+                float* out = (*Dst)[x];
+                for (int z = 0; z < Size; z++) {
+                    // off-map neighbours read the cell itself, which moves nothing
+                    float h = cur[z];
+                    float Flux = TalusFlux(prev[z] - h, Talus) + TalusFlux(next[z] - h, Talus) +
+                                 TalusFlux(cur[z > 0 ? z - 1 : z] - h, Talus) +
+                                 TalusFlux(cur[z < Size - 1 ? z + 1 : z] - h, Talus);
+                    out[z] = h + Rate * Flux;
+                }
+            }
+        }, 8);
+        std::swap(Src, Dst);
+    }
+    if (Src != &HeightMap) HeightMap = std::move(*Src);
+}
@@ -0,0 +1,47 @@
+#ifndef __HEIGHTMAP_NOISE_H__
+#define __HEIGHTMAP_NOISE_H__
+
+#include <stdint.h>
+
+#include "core/qgearray.h"
+#include "core/qgethreadpool.h"
+
+typedef struct HeightSynthParams {
+    int Size = 1025;
+    uint32_t Seed = 0;
+    int Octaves = 8;
+    float Frequency = 4.0f;         // base octave features across the map
+    float Lacunarity = 2.0f;
+    float Gain = 0.5f;
+    float Ridged = 0.0f;            // 0 fBm .. 1 ridged noise
+    float MinHeight = 0.0f;
+    float MaxHeight = 256.0f;
+    int ThermalIterations = 0;
+    float Talus = 0.25f;            // height difference to a neighbour that stays put
+    float ThermalRate = 0.2f;       // share of the excess moved per iteration, <= 0.25
+} HeightSynthParams;
+
+/*
+ * CPU reference of the heightmap_*.comp shaders, same hash, same noise and the same
+ * erosion step in the same order, so GPU results can be checked headless against
+ * it (to float rounding, the GPU may contract and reorder).
+ *
+ * Gradient noise with the gradients taken from an integer hash of the lattice
+ * point; octaves are summed as fBm and blended with ridged noise, both mapped to
+ * [MinHeight, MaxHeight] without a min/max pass. Thermal erosion moves
+ * Rate * (d - Talus) between every pair of 4-neighbours whose height difference d
+ * exceeds the talus; the flux of a pair depends only on the two heights, so the
+ * step is a pure gather that conserves mass.
+ */
+uint32_t HeightHash(uint32_t x);
+float GradientNoise(float x, float z, uint32_t Seed);
+// (x, z) sample of the map in [MinHeight, MaxHeight] before erosion
+float SynthesizeHeight(const HeightSynthParams& Params, int x, int z);
+
+// HeightMap becomes Size x Size
+void SynthesizeHeights(const HeightSynthParams& Params, Array2d<float>& HeightMap,
+                       ThreadPool& pool = ThreadPool::Global());
+void ThermalErosion(Array2d<float>& HeightMap, int Iterations, float Talus, float Rate,
+                    ThreadPool& pool = ThreadPool::Global());
+
+#endif // !__HEIGHTMAP_NOISE_H__
@@ -0,0 +1,131 @@
+#include "heightmap_synth.h"
+
+#include <string.h>
+
+void HeightmapSynthesizer::Init() {
+    mNoiseShader = Shader("..\\asserts\\shaders\\heightmap_noise.comp");
+    mThermalShader = Shader("..\\asserts\\shaders\\heightmap_thermal.comp");
+    glGenQueries(1, &mQuery);
+}
+
+void HeightmapSynthesizer::Destroy() {
+    if (mFence != nullptr) glDeleteSync(mFence);
+    mFence = nullptr;
+    if (mReadbackBuffer > 0) glDeleteBuffers(1, &mReadbackBuffer);
+    mReadbackBuffer = 0;
+    if (mTextures[0] > 0) glDeleteTextures(2, mTextures);
+    mTextures[0] = mTextures[1] = 0;
+    if (mQuery > 0) glDeleteQueries(1, &mQuery);
+    mQuery = 0;
+    mSize = 0;
+}
+
+void HeightmapSynthesizer::CreateTextures(int Size) {
+    if (mTextures[0] > 0) glDeleteTextures(2, mTextures);
+    glGenTextures(2, mTextures);
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, mTextures[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, Size, Size);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    mSize = Size;
+}
+
+GLuint HeightmapSynthesizer::Generate(const HeightSynthParams& Params) {
+    if (Params.Size != mSize) CreateTextures(Params.Size);
+    GLuint Groups = (GLuint)(mSize + 15) / 16;
+    if (!mQueryPending) glBeginQuery(GL_TIME_ELAPSED, mQuery);
+
+    mNoiseShader.use();
+    mNoiseShader.setInt("gSize", mSize);
+    glUniform1ui(glGetUniformLocation(mNoiseShader.ID, "gSeed"), Params.Seed);
+    mNoiseShader.setInt("gOctaves", Params.Octaves);
+    mNoiseShader.setFloat("gFrequency", Params.Frequency);
+    mNoiseShader.setFloat("gLacunarity", Params.Lacunarity);
+    mNoiseShader.setFloat("gGain", Params.Gain);
+    mNoiseShader.setFloat("gRidged", Params.Ridged);
+    mNoiseShader.setFloat("gMinHeight", Params.MinHeight);
+    mNoiseShader.setFloat("gMaxHeight", Params.MaxHeight);
+    mCurrent = 0;
+    glBindImageTexture(0, mTextures[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute(Groups, Groups, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    if (Params.ThermalIterations > 0) {
+        mThermalShader.use();
+        mThermalShader.setInt("gSize", mSize);
+        mThermalShader.setFloat("gTalus", Params.Talus);
+        mThermalShader.setFloat("gRate", Params.ThermalRate);
+        for (int i = 0; i < Params.ThermalIterations; i++) {
+            glBindImageTexture(0, mTextures[mCurrent], 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, mTextures[mCurrent ^ 1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute(Groups, Groups, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            mCurrent ^= 1;
+        }
+    }
+    // the result is sampled by the terrain shaders and read back through a buffer
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    if (!mQueryPending) {
+        glEndQuery(GL_TIME_ELAPSED);
+        mQueryPending = true;
+    }
+    return mTextures[mCurrent];
+}
+
+double HeightmapSynthesizer::getGpuMilliseconds() {
+    if (mQueryPending) {
+        GLint Available = 0;
+        glGetQueryObjectiv(mQuery, GL_QUERY_RESULT_AVAILABLE, &Available);
+        if (Available) {
+            GLuint64 Nanoseconds = 0;
+            glGetQueryObjectui64v(mQuery, GL_QUERY_RESULT, &Nanoseconds);
+            mGpuMilliseconds = (double)Nanoseconds / 1e6;
+            mQueryPending = false;
+        }
+    }
+    return mGpuMilliseconds;
+}
+
+void HeightmapSynthesizer::RequestReadback() {
+    if (mSize == 0) return;
+    size_t Bytes = (size_t)mSize * mSize * sizeof(float);
+    if (mReadbackBuffer == 0) glGenBuffers(1, &mReadbackBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, mReadbackBuffer);
+    if (mReadbackSize != mSize) glBufferData(GL_PIXEL_PACK_BUFFER, Bytes, nullptr, GL_STREAM_READ);
+    mReadbackSize = mSize;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, mTextures[mCurrent]);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, (void*)0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (mFence != nullptr) glDeleteSync(mFence);
+    mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool HeightmapSynthesizer::PollReadback(Array2d<float>& HeightMap) {
+    if (mFence == nullptr) return false;
+    GLenum Status = glClientWaitSync(mFence, 0, 0);
+    if (Status != GL_ALREADY_SIGNALED && Status != GL_CONDITION_SATISFIED) return false;
+    glDeleteSync(mFence);
+    mFence = nullptr;
+
+    // texture rows are x, so the buffer is the Array2d as is
+    size_t Bytes = (size_t)mReadbackSize * mReadbackSize * sizeof(float);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, mReadbackBuffer);
+    const void* p = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, Bytes, GL_MAP_READ_BIT);
+    if (p != nullptr) {
+        HeightMap = Array2d<float>(mReadbackSize, mReadbackSize);
+        memcpy(HeightMap.begin(), p, Bytes);
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return p != nullptr;
+}
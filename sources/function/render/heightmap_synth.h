@@ -0,0 +1,62 @@
+#ifndef __HEIGHTMAP_SYNTH_H__
+#define __HEIGHTMAP_SYNTH_H__
+
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "heightmap_noise.h"
+#include "core/qgearray.h"
+
+/*
+ * Heightmap synthesis on the GPU: heightmap_noise.comp writes the noise into an
+ * R32F texture and heightmap_thermal.comp runs the erosion steps, ping-ponging
+ * between two textures; nothing goes through the CPU. The result is laid out as
+ * Terrain::getHeightTexture (texel (z, x) = sample (x, z)).
+ *
+ * Reading the heights back is optional and never stalls: RequestReadback queues a
+ * copy into a pixel buffer behind a fence, PollReadback hands the heights over a
+ * few frames later once the fence has passed. The CPU reference for headless
+ * checks is SynthesizeHeights (heightmap_noise.h).
+ */
+class HeightmapSynthesizer {
+public:
+    HeightmapSynthesizer() {};
+    ~HeightmapSynthesizer() = default;
+
+    // GL thread from here on
+    void Init();
+    void Destroy();
+
+    // returns the height texture, valid until the next Generate with another size or Destroy
+    GLuint Generate(const HeightSynthParams& Params);
+    GLuint getHeightTexture() const { return mTextures[mCurrent]; }
+    int getSize() const { return mSize; }
+
+    // copies the current heights into a pixel buffer, replacing a pending request
+    void RequestReadback();
+    bool IsReadbackPending() const { return mFence != nullptr; }
+    // true once per request, when the copy has landed; HeightMap becomes Size x Size
+    bool PollReadback(Array2d<float>& HeightMap);
+
+    // GPU time of the last Generate, available a frame or two later
+    double getGpuMilliseconds();
+
+private:
+    void CreateTextures(int Size);
+
+    Shader mNoiseShader;
+    Shader mThermalShader;
+    GLuint mTextures[2] = { 0, 0 };
+    int mCurrent = 0;
+    int mSize = 0;
+
+    GLuint mReadbackBuffer = 0;
+    GLsync mFence = nullptr;
+    int mReadbackSize = 0;
+
+    GLuint mQuery = 0;
+    bool mQueryPending = false;
+    double mGpuMilliseconds = 0.0;
+};
+
+#endif // !__HEIGHTMAP_SYNTH_H__
@@ -1,5 +1,10 @@
 #include "lod_manager.h"
 
+#include <float.h>
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+
 int LODManager::InitLodManager(int PatchSize, int NumPatchesX, int NumPatchesZ, float WorldScale) {
     m_patchSize = PatchSize;
     m_numPatchesX = NumPatchesX;
@@ -14,6 +19,14 @@ int LODManager::InitLodManager(int PatchSize, int NumPatchesX, int NumPatchesZ,
     m_regions.resize(m_maxLOD + 1);
 
     CalcLodRegions();
+    m_lod.assign(NumPatchesX * NumPatchesZ, 0);
+    m_touched.assign(NumPatchesX * NumPatchesZ, 0);
+    m_updateStamp = 0;
+    m_mode = LOD_MODE_DISTANCE;
+    for (int i = 0; i < 4; i++) m_border[i].clear();
+    m_errors.clear();
+    m_errorDistances.clear();
+    Invalidate();
 
     return m_maxLOD;
 }
@@ -36,83 +49,274 @@ void LODManager::CalcMaxLOD() {
 
 
 void LODManager::Update(const glm::vec3& CameraPos) {
+    if (m_valid) {
+        UpdateIncremental(CameraPos);
+        return;
+    }
+
     UpdateLodMapPass1(CameraPos);
+    if (m_mode == LOD_MODE_SCREEN_ERROR) LimitNeighbourLods();
     UpdateLodMapPass2(CameraPos);
+    m_lastCameraPos = CameraPos;
+    m_valid = true;
+    m_numTouched = m_numPatchesX * m_numPatchesZ;
 }
 
 
 void LODManager::UpdateLodMapPass1(const glm::vec3& CameraPos) {
+    m_travel = 0.0;
+    m_deadlines = decltype(m_deadlines)();
+
+    for (int LodMapX = 0 ; LodMapX < m_numPatchesX ; LodMapX++) {
+        for (int LodMapZ = 0 ; LodMapZ < m_numPatchesZ ; LodMapZ++) {
+            float Slack;
+            int CoreLod = CalcCoreLod(LodMapX, LodMapZ, CameraPos, &Slack);
+
+            PatchLod* pPatchLOD = m_map.get_a(LodMapX, LodMapZ);
+            pPatchLOD->Core = CoreLod;
+            m_lod[LodMapX * m_numPatchesZ + LodMapZ] = CoreLod;
+            m_deadlines.push(Deadline(m_travel + Slack, LodMapX * m_numPatchesZ + LodMapZ));
+        }
+    }
+}
+
+
+void LODManager::UpdateIncremental(const glm::vec3& CameraPos) {
+    m_numTouched = 0;
+    if (++m_updateStamp == 0) {
+        // wrapped, forget the old marks
+        std::fill(m_touched.begin(), m_touched.end(), 0u);
+        m_updateStamp = 1;
+    }
+    float Moved = glm::distance(CameraPos, m_lastCameraPos);
+    if (Moved == 0.0f) return;
+    m_lastCameraPos = CameraPos;
+    m_travel += Moved;
+
+    // collect first: a patch sitting exactly on a band edge gets a zero slack
+    m_due.clear();
+    while (!m_deadlines.empty() && m_deadlines.top().first <= m_travel) {
+        m_due.push_back(m_deadlines.top().second);
+        m_deadlines.pop();
+    }
+
+    m_dirty.clear();
+    for (int Index : m_due) {
+        int LodMapX = Index / m_numPatchesZ;
+        int LodMapZ = Index % m_numPatchesZ;
+
+        float Slack;
+        int CoreLod = CalcCoreLod(LodMapX, LodMapZ, CameraPos, &Slack);
+        if (m_lod[Index] != CoreLod) {
+            m_lod[Index] = CoreLod;
+            m_map.get_a(LodMapX, LodMapZ)->Core = CoreLod;
+            m_dirty.push_back(Index);
+        }
+        m_deadlines.push(Deadline(m_travel + Slack, Index));
+        Touch(Index);
+    }
+
+    // neighbour limiting can spread a change over the whole map, redo it from scratch
+    if (m_mode == LOD_MODE_SCREEN_ERROR) {
+        if (m_dirty.empty()) return;
+        for (int i = 0; i < (int)m_lod.size(); i++)
+            m_map.get_a(i / m_numPatchesZ, i % m_numPatchesZ)->Core = m_lod[i];
+        LimitNeighbourLods();
+        UpdateLodMapPass2(CameraPos);
+        return;
+    }
+
+    // a core change only affects the patch's own flags and those of its four neighbours
+    for (int Index : m_dirty) {
+        int LodMapX = Index / m_numPatchesZ;
+        int LodMapZ = Index % m_numPatchesZ;
+        StitchPatch(LodMapX, LodMapZ);
+        if (LodMapX > 0) StitchPatch(LodMapX - 1, LodMapZ);
+        if (LodMapX < m_numPatchesX - 1) StitchPatch(LodMapX + 1, LodMapZ);
+        if (LodMapZ > 0) StitchPatch(LodMapX, LodMapZ - 1);
+        if (LodMapZ < m_numPatchesZ - 1) StitchPatch(LodMapX, LodMapZ + 1);
+    }
+}
+
+
+// core LOD from the distance band, Slack is the distance to the nearest band edge
+int LODManager::CalcCoreLod(int LodMapX, int LodMapZ, const glm::vec3& CameraPos, float* Slack) {
     int CenterStep = m_patchSize / 2;
+    int x = LodMapX * (m_patchSize - 1) + CenterStep;
+    int z = LodMapZ * (m_patchSize - 1) + CenterStep;
 
-    for (int LodMapZ = 0 ; LodMapZ < m_numPatchesZ ; LodMapZ++) {
-        for (int LodMapX = 0 ; LodMapX < m_numPatchesX ; LodMapX++) {
-            int x = LodMapX * (m_patchSize - 1) + CenterStep;
-            int z = LodMapZ * (m_patchSize - 1) + CenterStep;
+    glm::vec3 PatchCenter = glm::vec3(x * (float)m_worldScale, 0.0f, z * (float)m_worldScale);
 
-            glm::vec3 PatchCenter = glm::vec3(x * (float)m_worldScale, 0.0f, z * (float)m_worldScale);
+    float DistanceToCamera = glm::distance(CameraPos, PatchCenter);
 
-            float DistanceToCamera = glm::distance(CameraPos, PatchCenter);
+    if (m_mode == LOD_MODE_SCREEN_ERROR) {
+        // distances are non-decreasing with the LOD, take the coarsest one already reached
+        const float* Distances = &m_errorDistances[(LodMapX * m_numPatchesZ + LodMapZ) * (m_maxLOD + 1)];
+        int CoreLod = 0;
+        while (CoreLod < m_maxLOD && DistanceToCamera >= Distances[CoreLod + 1]) CoreLod++;
 
-            int CoreLod = DistanceToLod(DistanceToCamera);
+        float Near = CoreLod > 0 ? Distances[CoreLod] : -FLT_MAX;
+        float Far = CoreLod < m_maxLOD ? Distances[CoreLod + 1] : FLT_MAX;
+        *Slack = std::min(DistanceToCamera - Near, Far - DistanceToCamera);
+        return CoreLod;
+    }
 
-            PatchLod* pPatchLOD = m_map.get_a(LodMapX, LodMapZ);
-            pPatchLOD->Core = CoreLod;
+    int CoreLod = DistanceToLod(DistanceToCamera);
+
+    float Near = CoreLod > 0 ? (float)m_regions[CoreLod - 1] : -FLT_MAX;
+    float Far = CoreLod < m_maxLOD ? (float)m_regions[CoreLod] : FLT_MAX;
+    *Slack = std::min(DistanceToCamera - Near, Far - DistanceToCamera);
+
+    return CoreLod;
+}
+
+
+void LODManager::SetLodMode(LodMode Mode) {
+    if (Mode == LOD_MODE_SCREEN_ERROR && m_errors.empty()) {
+        printf("Screen-space error LOD needs the patch errors, staying in distance mode\n");
+        return;
+    }
+    m_mode = Mode;
+    Invalidate();
+}
+
+
+void LODManager::SetPatchErrors(const std::vector<float>& Errors) {
+    assert(Errors.size() == (size_t)m_numPatchesX * m_numPatchesZ * (m_maxLOD + 1));
+    m_errors = Errors;
+    CalcErrorDistances();
+    Invalidate();
+}
+
+
+void LODManager::SetScreenErrorParams(float PixelThreshold, float FovY, float ViewportHeight) {
+    if (PixelThreshold == m_pixelThreshold && FovY == m_fovY && ViewportHeight == m_viewportHeight) return;
+    m_pixelThreshold = PixelThreshold;
+    m_fovY = FovY;
+    m_viewportHeight = ViewportHeight;
+    CalcErrorDistances();
+    if (m_mode == LOD_MODE_SCREEN_ERROR) Invalidate();
+}
+
+
+void LODManager::CalcErrorDistances() {
+    m_errorDistances.resize(m_errors.size());
+    bool Valid = m_pixelThreshold > 0.0f && m_viewportHeight > 0.0f;
+    float K = Valid ? m_viewportHeight / (2.0f * tanf(m_fovY * 0.5f)) : 0.0f;
+
+    for (size_t Patch = 0; Patch < m_errors.size(); Patch += m_maxLOD + 1) {
+        float Error = 0.0f;
+        for (int Lod = 0; Lod <= m_maxLOD; Lod++) {
+            // keep the distances sorted even if a coarser level happens to fit better
+            Error = std::max(Error, m_errors[Patch + Lod]);
+            if (Valid) {
+                m_errorDistances[Patch + Lod] = Error * K / m_pixelThreshold;
+            } else {
+                m_errorDistances[Patch + Lod] = Error > 0.0f ? FLT_MAX : 0.0f;
+            }
+        }
+    }
+}
+
+
+// The stitching permutations only cover neighbours one LOD apart, so pull every
+// patch down to at most one more than any of its neighbours. Two raster passes
+// give the exact result (a chamfer distance transform). The map passes walk it
+// in memory order, LodMapX is the Array2d row.
+void LODManager::LimitNeighbourLods() {
+    for (int LodMapX = 0 ; LodMapX < m_numPatchesX ; LodMapX++) {
+        for (int LodMapZ = 0 ; LodMapZ < m_numPatchesZ ; LodMapZ++) {
+            int& Core = m_map[LodMapX][LodMapZ].Core;
+            if (LodMapX > 0) Core = std::min(Core, m_map.get(LodMapX - 1, LodMapZ).Core + 1);
+            if (LodMapZ > 0) Core = std::min(Core, m_map.get(LodMapX, LodMapZ - 1).Core + 1);
+        }
+    }
+
+    for (int LodMapX = m_numPatchesX - 1 ; LodMapX >= 0 ; LodMapX--) {
+        for (int LodMapZ = m_numPatchesZ - 1 ; LodMapZ >= 0 ; LodMapZ--) {
+            int& Core = m_map[LodMapX][LodMapZ].Core;
+            if (LodMapX < m_numPatchesX - 1) Core = std::min(Core, m_map.get(LodMapX + 1, LodMapZ).Core + 1);
+            if (LodMapZ < m_numPatchesZ - 1) Core = std::min(Core, m_map.get(LodMapX, LodMapZ + 1).Core + 1);
         }
     }
 }
 
 
 void LODManager::UpdateLodMapPass2(const glm::vec3& CameraPos) {
-    int Step = m_patchSize / 2;
+    for (int LodMapX = 0 ; LodMapX < m_numPatchesX ; LodMapX++) {
+        for (int LodMapZ = 0 ; LodMapZ < m_numPatchesZ ; LodMapZ++) {
+            StitchPatch(LodMapX, LodMapZ);
+        }
+    }
+}
 
-    for (int LodMapZ = 0 ; LodMapZ < m_numPatchesZ ; LodMapZ++) {
-        for (int LodMapX = 0 ; LodMapX < m_numPatchesX ; LodMapX++) {
-            int CoreLod = m_map.get(LodMapX, LodMapZ).Core;
 
-            int IndexLeft   = LodMapX;
-            int IndexRight  = LodMapX;
-            int IndexTop    = LodMapZ;
-            int IndexBottom = LodMapZ;
+void LODManager::StitchPatch(int LodMapX, int LodMapZ) {
+    PatchLod& Patch = m_map[LodMapX][LodMapZ];
+    int CoreLod = Patch.Core;
 
-            if (LodMapX > 0) {
-                IndexLeft--;
+    if (LodMapX > 0) {
+        Patch.Left = m_map.get(LodMapX - 1, LodMapZ).Core > CoreLod ? 1 : 0;
+    } else if (!m_border[LOD_BORDER_LEFT].empty()) {
+        Patch.Left = m_border[LOD_BORDER_LEFT][LodMapZ] > CoreLod ? 1 : 0;
+    }
 
-                if (m_map.get(IndexLeft, LodMapZ).Core > CoreLod) {
-                    m_map[LodMapX][LodMapZ].Left = 1;
-                } else {
-                    m_map[LodMapX][LodMapZ].Left = 0;
-                }
-            }
+    if (LodMapX < m_numPatchesX - 1) {
+        Patch.Right = m_map.get(LodMapX + 1, LodMapZ).Core > CoreLod ? 1 : 0;
+    } else if (!m_border[LOD_BORDER_RIGHT].empty()) {
+        Patch.Right = m_border[LOD_BORDER_RIGHT][LodMapZ] > CoreLod ? 1 : 0;
+    }
 
-            if (LodMapX < m_numPatchesX - 1) {
-                IndexRight++;
+    if (LodMapZ > 0) {
+        Patch.Bottom = m_map.get(LodMapX, LodMapZ - 1).Core > CoreLod ? 1 : 0;
+    } else if (!m_border[LOD_BORDER_BOTTOM].empty()) {
+        Patch.Bottom = m_border[LOD_BORDER_BOTTOM][LodMapX] > CoreLod ? 1 : 0;
+    }
 
-                if (m_map.get(IndexRight, LodMapZ).Core > CoreLod) {
-                    m_map[LodMapX][LodMapZ].Right = 1;
-                } else {
-                    m_map[LodMapX][LodMapZ].Right = 0;
-                }
-            }
+    if (LodMapZ < m_numPatchesZ - 1) {
+        Patch.Top = m_map.get(LodMapX, LodMapZ + 1).Core > CoreLod ? 1 : 0;
+    } else if (!m_border[LOD_BORDER_TOP].empty()) {
+        Patch.Top = m_border[LOD_BORDER_TOP][LodMapX] > CoreLod ? 1 : 0;
+    }
 
-            if (LodMapZ > 0) {
-                IndexBottom--;
+    Touch(LodMapX * m_numPatchesZ + LodMapZ);
+}
 
-                if (m_map.get(LodMapX, IndexBottom).Core > CoreLod) {
-                    m_map[LodMapX][LodMapZ].Bottom = 1;
-                } else {
-                    m_map[LodMapX][LodMapZ].Bottom = 0;
-                }
-            }
 
-            if (LodMapZ < m_numPatchesZ - 1) {
-                IndexTop++;
+// a patch re-evaluated and then re-stitched, or stitched for several dirty
+// neighbours, still counts once per Update
+void LODManager::Touch(int Index) {
+    if (m_touched[Index] == m_updateStamp) return;
+    m_touched[Index] = m_updateStamp;
+    m_numTouched++;
+}
 
-                if (m_map.get(LodMapX, IndexTop).Core > CoreLod) {
-                    m_map[LodMapX][LodMapZ].Top = 1;
-                } else {
-                    m_map[LodMapX][LodMapZ].Top = 0;
-                }
-            }
+
+void LODManager::SetBorderLods(LodBorder Border, const std::vector<int>& Cores) {
+    bool Vertical = Border == LOD_BORDER_LEFT || Border == LOD_BORDER_RIGHT;
+    assert(Cores.empty() || (int)Cores.size() == (Vertical ? m_numPatchesZ : m_numPatchesX));
+    if (Cores == m_border[Border]) return;
+    m_border[Border] = Cores;
+
+    if (Cores.empty()) {
+        // back to an open edge
+        for (int i = 0; i < (Vertical ? m_numPatchesZ : m_numPatchesX); i++) {
+            PatchLod& Patch = Border == LOD_BORDER_LEFT   ? m_map[0][i] :
+                              Border == LOD_BORDER_RIGHT  ? m_map[m_numPatchesX - 1][i] :
+                              Border == LOD_BORDER_BOTTOM ? m_map[i][0] : m_map[i][m_numPatchesZ - 1];
+            int& Flag = Border == LOD_BORDER_LEFT ? Patch.Left : Border == LOD_BORDER_RIGHT ? Patch.Right :
+                        Border == LOD_BORDER_BOTTOM ? Patch.Bottom : Patch.Top;
+            Flag = 0;
+        }
+        return;
+    }
+
+    for (int i = 0; i < (int)Cores.size(); i++) {
+        switch (Border) {
+        case LOD_BORDER_LEFT:   StitchPatch(0, i); break;
+        case LOD_BORDER_RIGHT:  StitchPatch(m_numPatchesX - 1, i); break;
+        case LOD_BORDER_BOTTOM: StitchPatch(i, 0); break;
+        case LOD_BORDER_TOP:    StitchPatch(i, m_numPatchesZ - 1); break;
         }
     }
 }
@@ -4,18 +4,49 @@
 #include "core/qgearray.h"
 
 #include <vector>
+#include <queue>
 #include <glm/glm.hpp>
 #include <iostream>
 
 #define Z_FAR 5000.0f
 
+enum LodBorder {
+    LOD_BORDER_LEFT   = 0,  // x == 0
+    LOD_BORDER_RIGHT  = 1,  // x == NumPatchesX - 1
+    LOD_BORDER_BOTTOM = 2,  // z == 0
+    LOD_BORDER_TOP    = 3   // z == NumPatchesZ - 1
+};
+
+enum LodMode {
+    LOD_MODE_DISTANCE     = 0,  // fixed distance bands up to Z_FAR
+    LOD_MODE_SCREEN_ERROR = 1   // coarsest LOD whose projected height error is under a pixel threshold
+};
+
 class LODManager {
 public:
     LODManager() {};
     ~LODManager() = default;
     int InitLodManager(int PatchSize, int NumPatchesX, int NumPatchesZ, float WorldScale);
 
+    // Incremental: only patches whose distance band may have changed since the
+    // last call are re-evaluated, and only their neighbourhood is re-stitched.
     void Update(const glm::vec3& CameraPos);
+    // next Update recomputes every patch
+    void Invalidate() { m_valid = false; }
+    // patches re-evaluated or re-stitched by the last Update, each counted once
+    int GetNumTouched() const { return m_numTouched; }
+
+    void SetLodMode(LodMode Mode);
+    LodMode GetLodMode() const { return m_mode; }
+    // max vertical error of every patch at every LOD, Errors[(PatchX * NumPatchesZ + PatchZ) * (MaxLOD + 1) + Lod]
+    void SetPatchErrors(const std::vector<float>& Errors);
+    // FovY in radians, ViewportHeight in pixels; no-op when nothing changed
+    void SetScreenErrorParams(float PixelThreshold, float FovY, float ViewportHeight);
+
+    // Core LODs of the patches across one edge of the map (another grid's edge row,
+    // NumPatchesZ entries for left/right, NumPatchesX for bottom/top) so the edge
+    // patches stitch against them. An empty vector means no neighbour.
+    void SetBorderLods(LodBorder Border, const std::vector<int>& Cores);
 
     struct PatchLod {
         int Core   = 0;
@@ -34,6 +65,12 @@ private:
     void CalcMaxLOD();
     void UpdateLodMapPass1(const glm::vec3& CameraPos);
     void UpdateLodMapPass2(const glm::vec3& CameraPos);
+    void UpdateIncremental(const glm::vec3& CameraPos);
+    int CalcCoreLod(int LodMapX, int LodMapZ, const glm::vec3& CameraPos, float* Slack);
+    void StitchPatch(int LodMapX, int LodMapZ);
+    void Touch(int Index);
+    void CalcErrorDistances();
+    void LimitNeighbourLods();
 
     int DistanceToLod(float Distance);
 
@@ -45,6 +82,32 @@ private:
 
     Array2d<PatchLod> m_map;
     std::vector<int> m_regions;
+
+    LodMode m_mode = LOD_MODE_DISTANCE;
+    std::vector<float> m_errors;
+    // Screen-space error mode: LOD l of a patch is allowed from distance
+    // m_errorDistances[patch * (m_maxLOD + 1) + l] = error * K / threshold on,
+    // with K = ViewportHeight / (2 tan(FovY / 2)) the pixels per unit at distance 1
+    std::vector<float> m_errorDistances;
+    float m_pixelThreshold = 0.0f;
+    float m_fovY = 0.0f;
+    float m_viewportHeight = 0.0f;
+    std::vector<int> m_lod;                     // per patch LOD before neighbour limiting
+    std::vector<int> m_border[4];               // see SetBorderLods
+
+    // A patch's distance to the camera changes at most as fast as the camera moves,
+    // so its LOD is stable until the camera has travelled the distance to the nearest
+    // band edge (or error distance). Deadlines are kept on the total camera path length.
+    typedef std::pair<double, int> Deadline;     // (travel, LodMapX * m_numPatchesZ + LodMapZ)
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> m_deadlines;
+    std::vector<int> m_due;
+    std::vector<int> m_dirty;
+    glm::vec3 m_lastCameraPos = glm::vec3(0.0f);
+    double m_travel = 0.0;
+    bool m_valid = false;
+    int m_numTouched = 0;
+    std::vector<uint32_t> m_touched;            // per patch, m_updateStamp of the last Update that counted it
+    uint32_t m_updateStamp = 0;
 };
 
 #endif // !__LOG_MANAGER_H__
\ No newline at end of file
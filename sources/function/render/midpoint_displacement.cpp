@@ -0,0 +1,81 @@
+#include "midpoint_displacement.h"
+#include "core/qgemath.h"
+
+#include <math.h>
+
+// rows of a pass are handed out in chunks of roughly this many cells
+#define MPD_CELLS_PER_CHUNK 4096
+
+// templated on the layout, Array2d and TiledArray2d share get/get_a
+template<typename HeightArray>
+static void DiamondPass(HeightArray& HeightMap, int N, int RectSize, uint32_t Level, float CurHeight, 
+                        uint32_t Seed, ThreadPool& pool) {
+    int Half = RectSize / 2;
+    int NumRows = N / RectSize;
+    int CellsPerRow = N / RectSize;
+
+    pool.ParallelFor(0, NumRows, [&](int RowBegin, int RowEnd) {
+        for (int row = RowBegin; row < RowEnd; row++) {
+            int x = row * RectSize;
+            for (int z = 0; z < N; z += RectSize) {
+                float Avg = (HeightMap.get(x, z) + HeightMap.get(x, z + RectSize) + 
+                             HeightMap.get(x + RectSize, z) + HeightMap.get(x + RectSize, z + RectSize)) / 4.0f;
+                *HeightMap.get_a(x + Half, z + Half) = 
+                    Avg + CounterRandomFloatRange(-CurHeight, CurHeight, Seed, Level, x + Half, z + Half);
+            }
+        }
+    }, std::max(1, MPD_CELLS_PER_CHUNK / CellsPerRow));
+}
+
+template<typename HeightArray>
+static void SquarePass(HeightArray& HeightMap, int N, int RectSize, uint32_t Level, float CurHeight, 
+                       uint32_t Seed, ThreadPool& pool) {
+    int Half = RectSize / 2;
+    int NumRows = N / Half + 1;
+    int CellsPerRow = N / RectSize + 1;
+
+    // writes only the edge midpoints, reads only corners and diamond centers
+    pool.ParallelFor(0, NumRows, [&](int RowBegin, int RowEnd) {
+        for (int row = RowBegin; row < RowEnd; row++) {
+            int x = row * Half;
+            int zStart = (row & 1) ? 0 : Half;
+            for (int z = zStart; z <= N; z += RectSize) {
+                float Sum = 0.0f;
+                int Count = 0;
+                if (x >= Half)     { Sum += HeightMap.get(x - Half, z); Count++; }
+                if (x + Half <= N) { Sum += HeightMap.get(x + Half, z); Count++; }
+                if (z >= Half)     { Sum += HeightMap.get(x, z - Half); Count++; }
+                if (z + Half <= N) { Sum += HeightMap.get(x, z + Half); Count++; }
+                *HeightMap.get_a(x, z) = Sum / (float)Count + CounterRandomFloatRange(-CurHeight, CurHeight, Seed, Level, x, z);
+            }
+        }
+    }, std::max(1, MPD_CELLS_PER_CHUNK / CellsPerRow));
+}
+
+template<typename HeightArray>
+static void Generate(HeightArray& HeightMap, int Size, float Roughness, uint32_t Seed, ThreadPool& pool) {
+    assert(IsMidpointDisplacementSize(Size));
+
+    int N = Size - 1;
+    float CurHeight = (float)N / 2.0f;
+    float HeightReduce = powf(2.0f, -Roughness);
+    uint32_t Level = 0;
+
+    for (int RectSize = N; RectSize > 1; RectSize >>= 1) {
+        DiamondPass(HeightMap, N, RectSize, Level, CurHeight, Seed, pool);
+        SquarePass(HeightMap, N, RectSize, Level, CurHeight, Seed, pool);
+
+        Level++;
+        CurHeight *= HeightReduce;
+    }
+}
+
+void MidpointDisplacementParallel(Array2d<float>& HeightMap, int Size, float Roughness, uint32_t Seed, 
+                                  ThreadPool& pool) {
+    Generate(HeightMap, Size, Roughness, Seed, pool);
+}
+
+void MidpointDisplacementParallel(TiledArray2d<float>& HeightMap, int Size, float Roughness, uint32_t Seed, 
+                                  ThreadPool& pool) {
+    Generate(HeightMap, Size, Roughness, Seed, pool);
+}
@@ -0,0 +1,27 @@
+#ifndef __MIDPOINT_DISPLACEMENT_H__
+#define __MIDPOINT_DISPLACEMENT_H__
+
+#include <stdint.h>
+
+#include "core/qgearray.h"
+#include "core/qgetiledarray.h"
+#include "core/qgethreadpool.h"
+
+// True when Size - 1 is a power of two (513, 1025, ...), the sizes the parallel
+// generator supports.
+inline bool IsMidpointDisplacementSize(int Size) {
+    int n = Size - 1;
+    return n >= 2 && (n & (n - 1)) == 0;
+}
+
+// Diamond-square on a Size x Size map (HeightMap must already be Size x Size and zeroed).
+// Each diamond and square pass is split by rows across the pool and every offset is
+// drawn from a counter-based PRNG keyed on (Seed, level, x, z), so the result is
+// bit-identical for any number of threads. Heights are not normalized.
+void MidpointDisplacementParallel(Array2d<float>& HeightMap, int Size, float Roughness, uint32_t Seed,
+                                  ThreadPool& pool = ThreadPool::Global());
+// same heights in the tiled layout, for kernels that walk the map in both directions
+void MidpointDisplacementParallel(TiledArray2d<float>& HeightMap, int Size, float Roughness, uint32_t Seed,
+                                  ThreadPool& pool = ThreadPool::Global());
+
+#endif // !__MIDPOINT_DISPLACEMENT_H__
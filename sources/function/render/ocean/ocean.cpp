@@ -3,100 +3,43 @@
 
 extern GLint maxanisotropy;
 
-static float Phillips(const glm::vec2& k, const glm::vec2& w, float V, float A) {
-	float L = (V * V) / 9.81f;	// largest possible wave for wind speed V
-	float l = L / 1000.0f;					// supress waves smaller than this
-
-	float kdotw = glm::dot(k, w);
-	float k2 = glm::dot(k, k);			// squared length of wave vector k
-
-	// k^6 because k must be normalized
-	float P_h = A * (expf(-1.0f / (k2 * L * L))) / (k2 * k2 * k2) * (kdotw * kdotw);
-
-	if (kdotw < 0.0f) {
-		// wave is moving against wind direction w
-		P_h *= 0.07f;
-	}
-
-	return P_h * expf(-k2 * l * l);
-}
-
-bool Ocean::Init() {
-    static std::mt19937 gen;
-    static std::normal_distribution<> gaussian(0.0, 1.0);
+bool Ocean::Init(const OceanParams& Params) {
+	if (!Params.Validate()) return false;
+	params = Params;
+	const int N = params.DispMapSize;
 
 	// generate initial spectrum and frequencies
-	glm::vec2 k;
-	float L = PATCH_SIZE;
-
     glGenTextures(1, &init_spectrum);
 	glBindTexture(GL_TEXTURE_2D, init_spectrum);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, DISP_MAP_SIZE + 1, DISP_MAP_SIZE + 1);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, N + 1, N + 1);
 
     glGenTextures(1, &frequencies);
 	glBindTexture(GL_TEXTURE_2D, frequencies);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, DISP_MAP_SIZE + 1, DISP_MAP_SIZE + 1);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, N + 1, N + 1);
 
-	// n, m should be be in [-N / 2, N / 2]
-	int start = DISP_MAP_SIZE / 2;
-
-	// NOTE: in order to be symmetric, this must be (N + 1) x (N + 1) in size
-	// Complex* h0data = new Complex[(DISP_MAP_SIZE + 1) * (DISP_MAP_SIZE + 1)];
-	std::complex<float>* h0data = new std::complex<float>[(DISP_MAP_SIZE + 1) * (DISP_MAP_SIZE + 1)];
-	float* wdata = new float[(DISP_MAP_SIZE + 1) * (DISP_MAP_SIZE + 1)];
-	{
-		glm::vec2 w = WIND_DIRECTION;
-		glm::vec2 wn;
-		float V = WIND_SPEED;
-		float A = AMPLITUDE_CONSTANT;
-
-		wn = glm::normalize(w);
-
-		for (int m = 0; m <= DISP_MAP_SIZE; ++m) {
-            
-			k.y = (TWO_PI * (start - m)) / L;
-
-			for (int n = 0; n <= DISP_MAP_SIZE; ++n) {
-				k.x = (TWO_PI * (start - n)) / L;
-				
-				int index = m * (DISP_MAP_SIZE + 1) + n;
-				float sqrt_P_h = 0;
-
-				if (k.x != 0.0f || k.y != 0.0f)
-					sqrt_P_h = sqrtf(Phillips(k, wn, V, A));
-
-				h0data[index] = std::complex<float>((float)(sqrt_P_h * gaussian(gen) * ONE_OVER_SQRT_2), 
-													(float)(sqrt_P_h * gaussian(gen) * ONE_OVER_SQRT_2));
-
-				// dispersion relation \omega^2(k) = gk
-				wdata[index] = sqrtf(GRAV_ACCELERATION * glm::length(k));
-			}
-		}
-	}
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DISP_MAP_SIZE + 1, DISP_MAP_SIZE + 1, GL_RED, GL_FLOAT, wdata);
+	std::vector<std::complex<float>> h0data;
+	std::vector<float> wdata;
+	LoadOceanSpectrum(h0data, wdata, params, std::mt19937::default_seed, cacheDir);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, N + 1, N + 1, GL_RED, GL_FLOAT, &wdata[0]);
 
 	glBindTexture(GL_TEXTURE_2D, init_spectrum);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DISP_MAP_SIZE + 1, DISP_MAP_SIZE + 1, GL_RG, GL_FLOAT, h0data);
-
-    delete[] wdata;
-    delete[] h0data;
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, N + 1, N + 1, GL_RG, GL_FLOAT, &h0data[0]);
 
-	// create other spectrum textures
-	glGenTextures(2, updated);
-	glBindTexture(GL_TEXTURE_2D, updated[0]);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, DISP_MAP_SIZE, DISP_MAP_SIZE);
+	// create other spectrum textures, one layer per spectrum so a single dispatch
+	// transforms them all
+	glGenTextures(1, &spectra);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, spectra);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RG32F, N, N, OCEAN_NUM_SPECTRA);
 
-	glBindTexture(GL_TEXTURE_2D, updated[1]);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, DISP_MAP_SIZE, DISP_MAP_SIZE);
-
-	glGenTextures(1, &tempdata);
-	glBindTexture(GL_TEXTURE_2D, tempdata);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, DISP_MAP_SIZE, DISP_MAP_SIZE);
+	glGenTextures(1, &tempspectra);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tempspectra);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RG32F, N, N, OCEAN_NUM_SPECTRA);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
 	// create displacement map
 	glGenTextures(1, &displacement);
 	glBindTexture(GL_TEXTURE_2D, displacement);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, DISP_MAP_SIZE, DISP_MAP_SIZE);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, N, N);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -106,7 +49,7 @@ bool Ocean::Init() {
 	// create gradient & folding map
 	glGenTextures(1, &gradients);
 	glBindTexture(GL_TEXTURE_2D, gradients);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, DISP_MAP_SIZE, DISP_MAP_SIZE);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, N, N);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -116,13 +59,23 @@ bool Ocean::Init() {
 
     glBindTexture(GL_TEXTURE_2D, 0);
 
+	// displacement readback for QueryHeights
+	glGenBuffers(OCEAN_READBACK_SLOTS, readbackBuffers);
+	for (int i = 0; i < OCEAN_READBACK_SLOTS; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)N * N * sizeof(glm::vec4), nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	snapshot.set_all(N, N, glm::vec4(0.0f));
+
 	// create mesh and LOD levels (could use tess shader in the future)
 	OceanVertexElement decl[] = {
 		{ 0, 0, GLDECLTYPE_FLOAT3, GLDECLUSAGE_POSITION, 0 },
 		{ 0xff, 0, 0, 0, 0 }
 	};
-	numlods = Log2OfPow2(MESH_SIZE);
-	if (!GLCreateMesh((MESH_SIZE + 1) * (MESH_SIZE + 1), IndexCounts[numlods], OMESH_32BIT, decl, &oceanMesh)) return false;
+	const int M = params.MeshSize;
+	numlods = Log2OfPow2(M);
+	if (!GLCreateMesh((M + 1) * (M + 1), CalcIndexCount(), OMESH_32BIT, decl, &oceanMesh)) return false;
 
 	glm::vec3* vdata = nullptr;
 	uint32_t* idata = nullptr;
@@ -135,9 +88,9 @@ bool Ocean::Init() {
 	}
 	{
 		// vertex data
-		for (int z = 0; z <= MESH_SIZE; z++) {
-			for (int x = 0; x <= MESH_SIZE; x++) {
-				int index = z * (MESH_SIZE + 1) + x;
+		for (int z = 0; z <= M; z++) {
+			for (int x = 0; x <= M; x++) {
+				int index = z * (M + 1) + x;
 				vdata[index].x = (float)x;
 				vdata[index].y = (float)z;
 				vdata[index].z = 0.0f;
@@ -152,26 +105,29 @@ bool Ocean::Init() {
 	oceanMesh->SetAttributeTable(subsettable, numSubsets);
 	delete[] subsettable;
 
-	// Shader
-	spectrumShader = new Shader("..\\asserts\\shaders\\spectrum.comp");
+	// Shader, the compute passes are specialized for the map size
+	char defines[256];
+	snprintf(defines, sizeof(defines), "#define DISP_MAP_SIZE %d\n#define LOG2_DISP_MAP_SIZE %u\n#define PATCH_SIZE %f\n",
+			 N, Log2OfPow2(N), params.PatchSize);
+	spectrumShader = new Shader("..\\asserts\\shaders\\spectrum.comp", defines);
     spectrumShader->use();
     spectrumShader->setInt("tilde_h0", 0);
     spectrumShader->setInt("frequencies", 1);
     spectrumShader->setInt("tilde_h", 2);
     spectrumShader->setInt("tilde_D", 3);
 
-    fftShader = new Shader("..\\asserts\\shaders\\fft.comp");
+    fftShader = new Shader("..\\asserts\\shaders\\fft.comp", defines);
 	fftShader->use();
 	fftShader->setInt("readbuff", 0);
 	fftShader->setInt("writebuff", 1);
 
-    displacementShader = new Shader("..\\asserts\\shaders\\displacement.comp");
+    displacementShader = new Shader("..\\asserts\\shaders\\displacement.comp", defines);
     displacementShader->use();
     displacementShader->setInt("heightmap", 0);
 	displacementShader->setInt("choppyfield", 1);
 	displacementShader->setInt("displacement", 2);
 
-	gradientShader = new Shader("..\\asserts\\shaders\\gradient.comp");
+	gradientShader = new Shader("..\\asserts\\shaders\\gradient.comp", defines);
 	gradientShader->use();
 	gradientShader->setInt("displacement", 0);
 	gradientShader->setInt("gradients", 1);
@@ -192,9 +148,9 @@ bool Ocean::Init() {
 	envmap = loadCubemap(std::string("..\\asserts\\images\\ocean_env"));
 
 	// quadtree
-	float ocean_extent = PATCH_SIZE * (1 << FURTHEST_COVER);
+	float ocean_extent = params.PatchSize * (1 << params.FurthestCover);
 	glm::vec2 ocean_start(-0.5f * ocean_extent, -0.5f * ocean_extent);
-	tree.Initialize(ocean_start, ocean_extent, (int)numlods, MESH_SIZE, PATCH_SIZE, MAX_COVERAGE, (float)(1960 * 1080));
+	tree.Initialize(ocean_start, ocean_extent, (int)numlods, M, params.PatchSize, params.MaxCoverage, (float)(1960 * 1080));
 
 	return true;
 }
@@ -202,34 +158,39 @@ bool Ocean::Init() {
 void Ocean::Render(glm::mat4 world, glm::mat4 proj, Camera& camera, double Elapsed) {
 	static float time = 0.0f;
 
-    spectrumShader->use();
-    spectrumShader->setFloat("time", time);
-    glBindImageTexture(0, init_spectrum, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
-    glBindImageTexture(1, frequencies, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
-    glBindImageTexture(2, updated[0], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
-    glBindImageTexture(3, updated[1], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
-    glDispatchCompute(DISP_MAP_SIZE / 16, DISP_MAP_SIZE / 16, 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-
-	// transform spectra to time domain
-    FourierTransform(updated[0]);
-    FourierTransform(updated[1]);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-
-	// calculate displacement map
-    displacementShader->use();
-	glBindImageTexture(0, updated[0], 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
-	glBindImageTexture(1, updated[1], 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
-	glBindImageTexture(2, displacement, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-    glDispatchCompute(DISP_MAP_SIZE / 16, DISP_MAP_SIZE / 16, 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-
-	// calculate normal & folding map
-	gradientShader->use();
-	glBindImageTexture(0, displacement, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
-	glBindImageTexture(1, gradients, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA16F);
-    glDispatchCompute(DISP_MAP_SIZE / 16, DISP_MAP_SIZE / 16, 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	if (useCpu) {
+		UpdateOnCpu(time);
+	} else {
+	    spectrumShader->use();
+	    spectrumShader->setFloat("time", time);
+	    glBindImageTexture(0, init_spectrum, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+	    glBindImageTexture(1, frequencies, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+	    glBindImageTexture(2, spectra, 0, GL_FALSE, OCEAN_SPECTRUM_HEIGHT, GL_WRITE_ONLY, GL_RG32F);
+	    glBindImageTexture(3, spectra, 0, GL_FALSE, OCEAN_SPECTRUM_CHOPPY, GL_WRITE_ONLY, GL_RG32F);
+	    glDispatchCompute(params.DispMapSize / 16, params.DispMapSize / 16, 1);
+	    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		// transform spectra to time domain
+	    FourierTransform();
+	    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		// calculate displacement map
+	    displacementShader->use();
+		glBindImageTexture(0, spectra, 0, GL_FALSE, OCEAN_SPECTRUM_HEIGHT, GL_READ_ONLY, GL_RG32F);
+		glBindImageTexture(1, spectra, 0, GL_FALSE, OCEAN_SPECTRUM_CHOPPY, GL_READ_ONLY, GL_RG32F);
+		glBindImageTexture(2, displacement, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	    glDispatchCompute(params.DispMapSize / 16, params.DispMapSize / 16, 1);
+	    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		// calculate normal & folding map
+		gradientShader->use();
+		glBindImageTexture(0, displacement, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
+		glBindImageTexture(1, gradients, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	    glDispatchCompute(params.DispMapSize / 16, params.DispMapSize / 16, 1);
+	    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		ReadbackDisplacement(time);
+	}
 
 	glBindTexture(GL_TEXTURE_2D, gradients);
 	glGenerateMipmap(GL_TEXTURE_2D);
@@ -252,8 +213,8 @@ void Ocean::Render(glm::mat4 world, glm::mat4 proj, Camera& camera, double Elaps
 	glm::vec2 w = WIND_DIRECTION;
 	int pattern[4];
 	GLuint subset = 0;
-	uvparams.x = 1.0f / PATCH_SIZE;
-	uvparams.y = 0.5f / DISP_MAP_SIZE;
+	uvparams.x = 1.0f / params.PatchSize;
+	uvparams.y = 0.5f / params.DispMapSize;
 	perlin_offset.x = -w.x * time * 0.06f;
 	perlin_offset.y = -w.y * time * 0.06f;
 	oceanShader->use();
@@ -271,15 +232,15 @@ void Ocean::Render(glm::mat4 world, glm::mat4 proj, Camera& camera, double Elaps
 	glBindTexture(GL_TEXTURE_2D, gradients);
 
 	#if 0
-	float levelsize = (float)(MESH_SIZE >> 0);
-	float ocean_extent = PATCH_SIZE * (1 << FURTHEST_COVER);
+	float levelsize = (float)(params.MeshSize >> 0);
+	float ocean_extent = params.PatchSize * (1 << params.FurthestCover);
 	glm::vec2 ocean_start(-0.5f * ocean_extent, -0.5f * ocean_extent);
 	float scale = ocean_extent / levelsize;
 	local_traf = glm::scale(local_traf, glm::vec3(scale, scale, 0.0f));
 	world = glm::translate(world, glm::vec3(ocean_start[0], 0.0f, ocean_start[1]));
 	world = world * flipYZ;
-	uvparams.z = ocean_start[0] / PATCH_SIZE;
-	uvparams.w = ocean_start[1] / PATCH_SIZE;
+	uvparams.z = ocean_start[0] / params.PatchSize;
+	uvparams.w = ocean_start[1] / params.PatchSize;
 	oceanShader->setMat4("matLocal", local_traf);
 	oceanShader->setMat4("matWorld", world);
 	oceanShader->setVec4("uvParams", uvparams);
@@ -288,15 +249,15 @@ void Ocean::Render(glm::mat4 world, glm::mat4 proj, Camera& camera, double Elaps
 
 	#if 1
 	tree.Traverse([&](const QuadTree::Node& node) {
-		float levelsize = (float)(MESH_SIZE >> node.lod);
+		float levelsize = (float)(params.MeshSize >> node.lod);
 		float scale = node.length / levelsize;
 		local_traf = glm::scale(local_traf, glm::vec3(scale, scale, 0.0f));
 		world = glm::translate(world, glm::vec3(node.start[0], 0.0f, node.start[1]));
 		world = glm::translate(world, glm::vec3(300.0f, 0.0f, 300.0f));
 		world = world * flipYZ;
 
-		uvparams.z = node.start[0] / PATCH_SIZE;
-		uvparams.w = node.start[1] / PATCH_SIZE;
+		uvparams.z = node.start[0] / params.PatchSize;
+		uvparams.w = node.start[1] / params.PatchSize;
 
 		oceanShader->use();
 		oceanShader->setMat4("matLocal", local_traf);
@@ -315,26 +276,142 @@ void Ocean::Render(glm::mat4 world, glm::mat4 proj, Camera& camera, double Elaps
 	time += Elapsed;
 }
 
-void Ocean::FourierTransform(GLuint spectrum) {
+void Ocean::UpdateOnCpu(float time) {
+	if (!cpuInit) {
+		std::vector<std::complex<float>> h0data;
+		std::vector<float> wdata;
+		LoadOceanSpectrum(h0data, wdata, params, std::mt19937::default_seed, cacheDir);
+		cpuSim.Init(params, h0data, wdata);
+		cpuInit = true;
+	}
+	cpuSim.Update(time);
+	cpuTime = time;
+
+	glBindTexture(GL_TEXTURE_2D, displacement);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, params.DispMapSize, params.DispMapSize, GL_RGBA, GL_FLOAT, cpuSim.getDisplacement().begin());
+	glBindTexture(GL_TEXTURE_2D, gradients);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, params.DispMapSize, params.DispMapSize, GL_RGBA, GL_FLOAT, cpuSim.getGradients().begin());
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Ocean::ReadbackDisplacement(float time) {
+	// newest finished copy is kept for QueryHeights to map, older finished ones are dropped
+	for (int k = 0; k < OCEAN_READBACK_SLOTS; k++) {
+		int i = (readbackNext + k) % OCEAN_READBACK_SLOTS;
+		if (readbackFences[i] == 0) continue;
+		if (glClientWaitSync(readbackFences[i], 0, 0) == GL_TIMEOUT_EXPIRED) break;
+		glDeleteSync(readbackFences[i]);
+		readbackFences[i] = 0;
+		readbackReady = i;
+	}
+
+	// nobody asked for heights lately, stop copying and forget the old snapshot
+	if (readbackFrames == 0) {
+		readbackReady = -1;
+		hasSnapshot = false;
+		return;
+	}
+	readbackFrames--;
+
+	// queue this frame's copy; when every slot is still in flight (or holds the copy
+	// waiting to be mapped) the GPU is behind and the frame is skipped rather than
+	// waited for
+	if (readbackFences[readbackNext] == 0 && readbackNext != readbackReady) {
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[readbackNext]);
+		glBindTexture(GL_TEXTURE_2D, displacement);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, (void*)0);
+		readbackFences[readbackNext] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		readbackTimes[readbackNext] = time;
+		readbackNext = (readbackNext + 1) % OCEAN_READBACK_SLOTS;
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool Ocean::QueryHeights(const glm::vec2* Positions, float* Heights, int Count) {
+	if (useCpu && !cpuInit) return false;
+	if (!useCpu) {
+		readbackFrames = OCEAN_READBACK_IDLE;
+		// the copy finished in an earlier frame, mapping it does not stall
+		if (readbackReady >= 0) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[readbackReady]);
+			size_t bytes = (size_t)params.DispMapSize * params.DispMapSize * sizeof(glm::vec4);
+			void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+			if (data != nullptr) {
+				memcpy(snapshot.begin(), data, bytes);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				snapshotTime = readbackTimes[readbackReady];
+				hasSnapshot = true;
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			readbackReady = -1;
+		}
+		if (!hasSnapshot) return false;
+	}
+	const Array2d<glm::vec4>& source = useCpu ? cpuSim.getDisplacement() : snapshot;
+	for (int i = 0; i < Count; i++) Heights[i] = OceanSurfaceHeight(source, params.PatchSize, Positions[i].x, Positions[i].y);
+	return true;
+}
+
+bool Ocean::QueryHeights(const std::vector<glm::vec2>& Positions, std::vector<float>& Heights) {
+	std::vector<float> result(Positions.size());
+	if (!Positions.empty() && !QueryHeights(&Positions[0], &result[0], (int)Positions.size())) return false;
+	Heights.swap(result);
+	return true;
+}
+
+// work group (row, layer), both passes cover every layer of the spectra array
+void Ocean::FourierTransform() {
 	fftShader->use();
 	fftShader->setInt("readbuff", 0);
 	fftShader->setInt("writebuff", 1);
 
 	// horizontal pass
-	glBindImageTexture(0, spectrum, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
-	glBindImageTexture(1, tempdata, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
-	glDispatchCompute(DISP_MAP_SIZE, 1, 1);
+	glBindImageTexture(0, spectra, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+	glBindImageTexture(1, tempspectra, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
+	glDispatchCompute(params.DispMapSize, OCEAN_NUM_SPECTRA, 1);
 	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
 	// vertical pass
-	glBindImageTexture(0, tempdata, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
-	glBindImageTexture(1, spectrum, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
-	glDispatchCompute(DISP_MAP_SIZE, 1, 1);
+	glBindImageTexture(0, tempspectra, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+	glBindImageTexture(1, spectra, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
+	glDispatchCompute(params.DispMapSize, OCEAN_NUM_SPECTRA, 1);
+}
+
+// index count of GenerateLODLevels: every subset's inner strip plus the boundary
+// triangles of its coarser edges, each edge fan less the corners it shares
+GLuint Ocean::CalcIndexCount() const {
+	auto edge = [](int degree, int side0, int side1, int levelsize) -> GLuint {
+		if (degree >= levelsize) return 0;
+		return 3 * (degree + levelsize) - 3 * (side0 < levelsize) - 3 * (side1 < levelsize);
+	};
+
+	GLuint count = 0;
+	for (uint32_t level = 0; level < numlods - 2; ++level) {
+		int levelsize = params.MeshSize >> level;
+		int mindegree = levelsize >> 3;
+
+		for (int l = levelsize; l > mindegree; l >>= 1) {
+			for (int r = levelsize; r > mindegree; r >>= 1) {
+				for (int b = levelsize; b > mindegree; b >>= 1) {
+					for (int t = levelsize; t > mindegree; t >>= 1) {
+						int width = ((r == levelsize) ? levelsize : levelsize - 1) - ((l == levelsize) ? 0 : 1);
+						int height = ((b == levelsize) ? levelsize : levelsize - 1) - ((t == levelsize) ? 0 : 1);
+						count += height * (2 * width + 3);
+						count += edge(t, l, r, levelsize) + edge(l, t, b, levelsize) + edge(r, t, b, levelsize) + edge(b, l, r, levelsize);
+					}
+				}
+			}
+		}
+	}
+	return count;
 }
 
 void Ocean::GenerateLODLevels(OceanAttribute** subsettable, GLuint* numsubsets, uint32_t* idata) {
 #define CALC_INNER_INDEX(x, z) \
-	((top + (z)) * (MESH_SIZE + 1) + left + (x))
+	((top + (z)) * (params.MeshSize + 1) + left + (x))
 // END
 
 	assert(subsettable);
@@ -349,7 +426,7 @@ void Ocean::GenerateLODLevels(OceanAttribute** subsettable, GLuint* numsubsets,
 	OceanAttribute* subset = 0;
 
 	for (uint32_t level = 0; level < numlods - 2; ++level) {
-		int levelsize = MESH_SIZE >> level;
+		int levelsize = params.MeshSize >> level;
 		int mindegree = levelsize >> 3;
 
 		for (int left_degree = levelsize; left_degree > mindegree; left_degree >>= 1) {
@@ -434,7 +511,7 @@ void Ocean::GenerateLODLevels(OceanAttribute** subsettable, GLuint* numsubsets,
 
 GLuint Ocean::GenerateBoundaryMesh(int deg_left, int deg_top, int deg_right, int deg_bottom, int levelsize, uint32_t* idata) {
 #define CALC_BOUNDARY_INDEX(x, z) \
-	((z) * (MESH_SIZE + 1) + (x))
+	((z) * (params.MeshSize + 1) + (x))
 // END
 
 	GLuint numwritten = 0;
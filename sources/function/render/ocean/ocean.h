@@ -9,40 +9,50 @@
 #include "mesh.h"
 #include "core/qgemath.h"
 #include "quadtree.h"
+#include "spectrum.h"
+#include "ocean_cpu.h"
 #include "../camera.h"
 
-#define DISP_MAP_SIZE		512					// 1024 max
-#define MESH_SIZE			256					// [64, 256] (or calculate index count for other levels)
-#define GRAV_ACCELERATION	9.81f				// m/s^2
-#define PATCH_SIZE			20.0f				// m
-#define FURTHEST_COVER		8					// full ocean size = PATCH_SIZE * (1 << FURTHEST_COVER)
-#define MAX_COVERAGE		64.0f				// pixel limit for a distant patch to be rendered
-#define WIND_DIRECTION		{ -0.4f, -0.9f }
-#define WIND_SPEED			6.5f				// m/s
-#define AMPLITUDE_CONSTANT	(0.45f * 1e-3f)		// for the (modified) Phillips spectrum
+#define OCEAN_READBACK_SLOTS	3					// displacement copies in flight for QueryHeights
+#define OCEAN_READBACK_IDLE		8					// frames without QueryHeights before the copies stop
 
-static const int IndexCounts[] = {
-	0,
-	0,
-	0,
-	0,
-	0,
-	0,
-	961920,		// 64x64
-	3705084,	// 128x128
-	14500728	// 256x256
-};
+// layers of the time-dependent spectra array, further cascades go after these
+#define OCEAN_SPECTRUM_HEIGHT	0					// tilde_h
+#define OCEAN_SPECTRUM_CHOPPY	1					// tilde_D
+#define OCEAN_NUM_SPECTRA		2
 
 class Ocean {
 public:
     Ocean() {}
     ~Ocean() {}
-    bool Init();
+    // directory for the cached initial spectrum (see LoadOceanSpectrum), before Init
+    void setCacheDir(const std::string& dir) { cacheDir = dir; }
+    // false when Params do not validate
+    bool Init(const OceanParams& Params = OceanParams());
+    const OceanParams& getParams() const { return params; }
     void Render(glm::mat4 world, glm::mat4 proj, Camera& camera, double Elapsed);
     unsigned int getDisplacementID() { return displacement; }
+    // runs the wave simulation on the CPU and uploads the fields instead of dispatching
+    // the compute shaders, for drivers without GL 4.3
+    void setCpuSimulation(bool enable) { useCpu = enable; }
+    bool getCpuSimulation() const { return useCpu; }
+
+    // wave heights at Count ocean-plane positions (x, z) in meters, the plane the
+    // quadtree is laid out on; uv as in ocean.vs (xz * uvParams.x + uvParams.y).
+    // Served from a copy of the displacement map one or two frames old, read back
+    // through a ring of PBOs, so it never waits for the GPU. The copies only run
+    // while queries keep coming (OCEAN_READBACK_IDLE frames), and the finished PBO
+    // is mapped here rather than every frame, so call it on the GL thread. Only the
+    // FFT waves are sampled, not the Perlin detail ocean.vs blends in far away.
+    // Returns false and leaves Heights alone until the first copy has arrived,
+    // including the first frames after queries resume.
+    bool QueryHeights(const glm::vec2* Positions, float* Heights, int Count);
+    bool QueryHeights(const std::vector<glm::vec2>& Positions, std::vector<float>& Heights);
+    // simulation time of the heights QueryHeights returns
+    float getSnapshotTime() const { return useCpu ? cpuTime : snapshotTime; }
 
 private:
-    unsigned int init_spectrum, frequencies, updated[2], tempdata, displacement, gradients;
+    unsigned int init_spectrum, frequencies, spectra, tempspectra, displacement, gradients;
     unsigned int perlin_noise, envmap;
     Shader* spectrumShader;
     Shader* fftShader;
@@ -52,9 +62,29 @@ private:
     oMesh* oceanMesh;
     QuadTree tree;
 
+    OceanParams params;
     uint32_t numlods = 0;
+    std::string cacheDir;
+    bool useCpu = false;
+    bool cpuInit = false;
+    OceanSimulatorCPU cpuSim;
+    float cpuTime = 0.0f;
+
+    // displacement readback, a slot is free when its fence is 0
+    unsigned int readbackBuffers[OCEAN_READBACK_SLOTS];
+    GLsync readbackFences[OCEAN_READBACK_SLOTS] = {};
+    float readbackTimes[OCEAN_READBACK_SLOTS] = {};
+    int readbackNext = 0;
+    int readbackReady = -1;                 // newest finished slot, not yet mapped
+    int readbackFrames = 0;                 // frames left before the copies stop
+    Array2d<glm::vec4> snapshot;
+    float snapshotTime = 0.0f;
+    bool hasSnapshot = false;
 
-    void FourierTransform(GLuint spectrum);
+    void FourierTransform();
+    void UpdateOnCpu(float time);
+    void ReadbackDisplacement(float time);
+    GLuint CalcIndexCount() const;
     void GenerateLODLevels(OceanAttribute** subsettable, GLuint* numsubsets, uint32_t* idata);
     GLuint GenerateBoundaryMesh(int deg_left, int deg_top, int deg_right, int deg_bottom, int levelsize, uint32_t* idata);
     unsigned int TextureFromFile(const char* path);
@@ -0,0 +1,201 @@
+#include "ocean_cpu.h"
+#include "core/qgesimd.h"
+
+#include <math.h>
+#include <algorithm>
+
+// columns per FFT task, 2 x 64 floats per row stay in L1 across the stages
+#define OCEAN_FFT_BLOCK 64
+
+void OceanSimulatorCPU::Init(const OceanParams& Params, uint32_t Seed) {
+    std::vector<std::complex<float>> H0;
+    std::vector<float> Omega;
+    GenerateOceanSpectrum(H0, Omega, Params, Seed);
+    Init(Params, H0, Omega);
+}
+
+void OceanSimulatorCPU::Init(const OceanParams& Params, const std::vector<std::complex<float>>& H0, const std::vector<float>& Omega) {
+    const int N = Params.DispMapSize;
+    mN = N;
+    mPatchSize = Params.PatchSize;
+    mH0 = H0;
+    mOmega = Omega;
+
+    mLog2N = 0;
+    while ((1 << mLog2N) < N) mLog2N++;
+    mTwiddleRe.resize(N);
+    mTwiddleIm.resize(N);
+    for (int k = 0; k < N; k++) {
+        double theta = 2.0 * 3.14159265358979323846 * k / N;
+        mTwiddleRe[k] = (float)cos(theta);
+        mTwiddleIm[k] = (float)sin(theta);
+    }
+    mBitReverse.resize(N);
+    for (int i = 0; i < N; i++) {
+        int r = 0;
+        for (int b = 0; b < mLog2N; b++) r |= ((i >> b) & 1) << (mLog2N - 1 - b);
+        mBitReverse[i] = r;
+    }
+
+    mHeightRe.set_all(N, N, 0.0f);
+    mHeightIm.set_all(N, N, 0.0f);
+    mChoppyRe.set_all(N, N, 0.0f);
+    mChoppyIm.set_all(N, N, 0.0f);
+    mTempRe.set_all(N, N, 0.0f);
+    mTempIm.set_all(N, N, 0.0f);
+    mDisplacement.set_all(N, N, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    mGradients.set_all(N, N, glm::vec4(0.0f));
+}
+
+void OceanSimulatorCPU::Update(float Time, ThreadPool& pool) {
+    const int N = mN;
+
+    // spectrum.comp
+    pool.ParallelFor(0, N, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; y++) {
+            float* hRe = mHeightRe[y];
+            float* hIm = mHeightIm[y];
+            float* dRe = mChoppyRe[y];
+            float* dIm = mChoppyIm[y];
+            for (int x = 0; x < N; x++) {
+                std::complex<float> h0_k = mH0[y * (N + 1) + x];
+                std::complex<float> h0_mk = mH0[(N - y) * (N + 1) + (N - x)];
+                float w_k = mOmega[y * (N + 1) + x];
+                float cos_wt = cosf(w_k * Time);
+                float sin_wt = sinf(w_k * Time);
+
+                float hr = cos_wt * (h0_k.real() + h0_mk.real()) - sin_wt * (h0_k.imag() + h0_mk.imag());
+                float hi = cos_wt * (h0_k.imag() - h0_mk.imag()) + sin_wt * (h0_k.real() - h0_mk.real());
+
+                glm::vec2 k((float)(N / 2 - x), (float)(N / 2 - y));
+                float kn2 = glm::dot(k, k);
+                glm::vec2 nk = kn2 > 1e-12f ? k / sqrtf(kn2) : glm::vec2(0.0f);
+
+                hRe[x] = hr;
+                hIm[x] = hi;
+                // Dt_x + i Dt_z
+                dRe[x] = hi * nk.x + hr * nk.y;
+                dIm[x] = -hr * nk.x + hi * nk.y;
+            }
+        }
+    }, 16);
+
+    FourierTransform(mHeightRe, mHeightIm, pool);
+    FourierTransform(mChoppyRe, mChoppyIm, pool);
+
+    // displacement.comp
+    pool.ParallelFor(0, N, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; y++) {
+            glm::vec4* out = mDisplacement[y];
+            for (int x = 0; x < N; x++) {
+                float sign = ((x + y) & 1) ? -1.0f : 1.0f;
+                out[x] = glm::vec4(sign * mChoppyRe.get(y, x) * CHOPPY_LAMBDA, sign * mHeightRe.get(y, x),
+                                   sign * mChoppyIm.get(y, x) * CHOPPY_LAMBDA, 1.0f);
+            }
+        }
+    }, 16);
+
+    // gradient.comp
+    const float InvTileSize = N / mPatchSize;
+    const float TileSizeX2 = mPatchSize * 2.0f / N;
+    pool.ParallelFor(0, N, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; y++) {
+            const glm::vec4* bottom = mDisplacement[(y - 1) & (N - 1)];
+            const glm::vec4* cur = mDisplacement[y];
+            const glm::vec4* top = mDisplacement[(y + 1) & (N - 1)];
+            glm::vec4* out = mGradients[y];
+            for (int x = 0; x < N; x++) {
+                const glm::vec4& left = cur[(x - 1) & (N - 1)];
+                const glm::vec4& right = cur[(x + 1) & (N - 1)];
+                glm::vec2 dDx = (glm::vec2(right.x, right.z) - glm::vec2(left.x, left.z)) * InvTileSize;
+                glm::vec2 dDy = (glm::vec2(top[x].x, top[x].z) - glm::vec2(bottom[x].x, bottom[x].z)) * InvTileSize;
+                float J = (1.0f + dDx.x) * (1.0f + dDy.y) - dDx.y * dDy.x;
+                out[x] = glm::vec4(left.y - right.y, bottom[x].y - top[x].y, TileSizeX2, J);
+            }
+        }
+    }, 16);
+}
+
+// fft.comp reads a column and writes it as a row, twice
+void OceanSimulatorCPU::FourierTransform(Array2d<float>& Re, Array2d<float>& Im, ThreadPool& pool) {
+    const int N = mN;
+    for (int pass = 0; pass < 2; pass++) {
+        pool.ParallelFor(0, N / OCEAN_FFT_BLOCK, [&](int bBegin, int bEnd) {
+            TransformColumns(Re, Im, bBegin * OCEAN_FFT_BLOCK, bEnd * OCEAN_FFT_BLOCK);
+        });
+        Transpose(Re, mTempRe, pool);
+        Transpose(Im, mTempIm, pool);
+        std::swap(Re, mTempRe);
+        std::swap(Im, mTempIm);
+    }
+}
+
+void OceanSimulatorCPU::TransformColumns(Array2d<float>& Re, Array2d<float>& Im, int x0, int x1) const {
+    const int N = mN;
+    size_t Width = (size_t)(x1 - x0);
+
+    for (int y = 0; y < N; y++) {
+        int r = mBitReverse[y];
+        if (r <= y) continue;
+        std::swap_ranges(Re[y] + x0, Re[y] + x1, Re[r] + x0);
+        std::swap_ranges(Im[y] + x0, Im[y] + x1, Im[r] + x0);
+    }
+
+    int s = 1;
+    if (mLog2N & 1) {
+        // the odd stage first: m = 2, twiddle W^0
+        for (int i = 0; i < N; i += 2) SimdButterfly2(Re[i] + x0, Im[i] + x0, Re[i + 1] + x0, Im[i + 1] + x0, Width, 1.0f, 0.0f);
+        s = 2;
+    }
+    for (; s < mLog2N; s += 2) {
+        // stages s and s + 1: group 4h, h = half of stage s' group
+        int h = 1 << (s - 1);
+        int Step1 = N / (2 * h), Step2 = N / (4 * h);
+        for (int i = 0; i < N; i += 4 * h) {
+            for (int j = 0; j < h; j++) {
+                float* RowRe[4] = { Re[i + j] + x0, Re[i + j + h] + x0, Re[i + j + 2 * h] + x0, Re[i + j + 3 * h] + x0 };
+                float* RowIm[4] = { Im[i + j] + x0, Im[i + j + h] + x0, Im[i + j + 2 * h] + x0, Im[i + j + 3 * h] + x0 };
+                SimdButterfly4(RowRe, RowIm, Width, mTwiddleRe[j * Step1], mTwiddleIm[j * Step1],
+                               mTwiddleRe[j * Step2], mTwiddleIm[j * Step2]);
+            }
+        }
+    }
+}
+
+void OceanSimulatorCPU::Transpose(const Array2d<float>& Src, Array2d<float>& Dst, ThreadPool& pool) const {
+    const int N = mN;
+    const int Block = 32;
+    pool.ParallelFor(0, N / Block, [&](int bBegin, int bEnd) {
+        for (int by = bBegin * Block; by < bEnd * Block; by += Block) {
+            for (int bx = 0; bx < N; bx += Block) {
+                for (int y = by; y < by + Block; y++) {
+                    const float* src = Src[y];
+                    for (int x = bx; x < bx + Block; x++) Dst[x][y] = src[x];
+                }
+            }
+        }
+    });
+}
+
+glm::vec3 SampleOceanDisplacement(const Array2d<glm::vec4>& Displacement, float PatchSize, float x, float z) {
+    const int N = (int)Displacement.col();
+    float u = x / PatchSize * N, v = z / PatchSize * N;
+    float fu = floorf(u), fv = floorf(v);
+    float tu = u - fu, tv = v - fv;
+    int x0 = (int)fu & (N - 1), y0 = (int)fv & (N - 1);
+    int x1 = (x0 + 1) & (N - 1), y1 = (y0 + 1) & (N - 1);
+    glm::vec4 d0 = glm::mix(Displacement.get(y0, x0), Displacement.get(y0, x1), tu);
+    glm::vec4 d1 = glm::mix(Displacement.get(y1, x0), Displacement.get(y1, x1), tu);
+    return glm::vec3(glm::mix(d0, d1, tv));
+}
+
+float OceanSurfaceHeight(const Array2d<glm::vec4>& Displacement, float PatchSize, float x, float z) {
+    // find p with p + D(p).xz = (x, z)
+    glm::vec2 p(x, z);
+    glm::vec3 d = SampleOceanDisplacement(Displacement, PatchSize, p.x, p.y);
+    for (int i = 0; i < 3; i++) {
+        p = glm::vec2(x, z) - glm::vec2(d.x, d.z);
+        d = SampleOceanDisplacement(Displacement, PatchSize, p.x, p.y);
+    }
+    return d.y;
+}
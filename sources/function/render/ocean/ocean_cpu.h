@@ -0,0 +1,79 @@
+#ifndef __OCEAN_CPU_H__
+#define __OCEAN_CPU_H__
+
+#include <vector>
+#include <complex>
+#include <glm/glm.hpp>
+
+#include "spectrum.h"
+#include "core/qgearray.h"
+#include "core/qgethreadpool.h"
+
+/*
+ * CPU twin of the ocean compute pipeline (spectrum.comp -> fft.comp x 2 ->
+ * displacement.comp -> gradient.comp), from the same h0/w data as Ocean::Init.
+ * Used where no compute shaders run: buoyancy on a server, headless checks and
+ * machines without GL 4.3. Fields match the GPU ones to float rounding.
+ *
+ * The FFT is the GPU one (unnormalized, e^{+i}, sign correction in the displacement
+ * step) done as two column passes with a transpose after each. A column pass keeps
+ * complex values split into re/im rows and runs the butterflies across a block of
+ * columns at once, so every SIMD lane is a separate transform sharing one twiddle;
+ * stages go two at a time (radix-2^2) plus one radix-2 stage when log2 N is odd.
+ * Column blocks and the other per-texel steps are spread over the thread pool.
+ *
+ * Fields are DispMapSize^2, texel (x, y) at get(y, x) as in the textures; image x
+ * runs along world x and image y along world z, one texel per PatchSize / N.
+ */
+// bilinear, wrapped lookup into an N x N displacement field (texel (x, y) at get(y, x))
+// tiling PatchSize meters, at (x, z) in meters; the texel centres sit where ocean.vs
+// samples them
+glm::vec3 SampleOceanDisplacement(const Array2d<glm::vec4>& Displacement, float PatchSize, float x, float z);
+// height of the displaced surface above (x, z); the choppy waves move the samples
+// sideways, so the lookup position is corrected a few times
+float OceanSurfaceHeight(const Array2d<glm::vec4>& Displacement, float PatchSize, float x, float z);
+
+class OceanSimulatorCPU {
+public:
+    OceanSimulatorCPU() {};
+    ~OceanSimulatorCPU() = default;
+
+    void Init(const OceanParams& Params = OceanParams(), uint32_t Seed = std::mt19937::default_seed);
+    // H0 and Omega from GenerateOceanSpectrum with the same Params
+    void Init(const OceanParams& Params, const std::vector<std::complex<float>>& H0, const std::vector<float>& Omega);
+    int getSize() const { return mN; }
+    float getPatchSize() const { return mPatchSize; }
+
+    // the fields at Time seconds, blocks until done
+    void Update(float Time, ThreadPool& pool = ThreadPool::Global());
+
+    // (Dx * lambda, h, Dz * lambda, 1), as the displacement texture
+    const Array2d<glm::vec4>& getDisplacement() const { return mDisplacement; }
+    // (dh, dh, 2 * texel size, Jacobian), as the gradients texture
+    const Array2d<glm::vec4>& getGradients() const { return mGradients; }
+
+    glm::vec3 SampleDisplacement(float x, float z) const { return SampleOceanDisplacement(mDisplacement, mPatchSize, x, z); }
+    float GetSurfaceHeight(float x, float z) const { return OceanSurfaceHeight(mDisplacement, mPatchSize, x, z); }
+
+private:
+    void FourierTransform(Array2d<float>& Re, Array2d<float>& Im, ThreadPool& pool);
+    void TransformColumns(Array2d<float>& Re, Array2d<float>& Im, int x0, int x1) const;
+    void Transpose(const Array2d<float>& Src, Array2d<float>& Dst, ThreadPool& pool) const;
+
+    std::vector<std::complex<float>> mH0;
+    std::vector<float> mOmega;
+    std::vector<float> mTwiddleRe;          // W_N^k = e^{2 pi i k / N}
+    std::vector<float> mTwiddleIm;
+    std::vector<int> mBitReverse;
+    int mN = 0;
+    int mLog2N = 0;
+    float mPatchSize = 0.0f;
+
+    Array2d<float> mHeightRe, mHeightIm;    // tilde_h
+    Array2d<float> mChoppyRe, mChoppyIm;    // tilde_D, Dx in re, Dz in im
+    Array2d<float> mTempRe, mTempIm;
+    Array2d<glm::vec4> mDisplacement;
+    Array2d<glm::vec4> mGradients;
+};
+
+#endif // !__OCEAN_CPU_H__
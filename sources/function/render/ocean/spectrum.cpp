@@ -0,0 +1,175 @@
+#include "spectrum.h"
+#include "core/qgemath.h"
+#include "core/qgehash.h"
+#include "core/qgethreadpool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+#include <fstream>
+
+struct OceanSpectrumCacheHeader {
+	char     Magic[4];
+	uint32_t Version;
+	uint64_t Key;
+	uint32_t Size;			// DispMapSize
+	uint32_t Seed;
+	uint64_t FileSize;
+};
+
+float Phillips(const glm::vec2& k, const glm::vec2& w, float V, float A) {
+	float L = (V * V) / 9.81f;	// largest possible wave for wind speed V
+	float l = L / 1000.0f;					// supress waves smaller than this
+
+	float kdotw = glm::dot(k, w);
+	float k2 = glm::dot(k, k);			// squared length of wave vector k
+
+	// k^6 because k must be normalized
+	float P_h = A * (expf(-1.0f / (k2 * L * L))) / (k2 * k2 * k2) * (kdotw * kdotw);
+
+	if (kdotw < 0.0f) {
+		// wave is moving against wind direction w
+		P_h *= 0.07f;
+	}
+
+	return P_h * expf(-k2 * l * l);
+}
+
+static bool IsPow2(int x) { return x > 0 && (x & (x - 1)) == 0; }
+
+bool OceanParams::Validate() const {
+	if (!IsPow2(DispMapSize) || DispMapSize < 64 || DispMapSize > 1024) {
+		printf("%s:%d - DispMapSize %d is not a power of two in [64, 1024]\n", __FILE__, __LINE__, DispMapSize);
+		return false;
+	}
+	if (!IsPow2(MeshSize) || MeshSize < 16 || MeshSize > 256) {
+		printf("%s:%d - MeshSize %d is not a power of two in [16, 256]\n", __FILE__, __LINE__, MeshSize);
+		return false;
+	}
+	if (!(PatchSize > 0.0f) || FurthestCover < 1 || FurthestCover > 16) {
+		printf("%s:%d - bad PatchSize %f or FurthestCover %d\n", __FILE__, __LINE__, PatchSize, FurthestCover);
+		return false;
+	}
+	return true;
+}
+
+void GenerateOceanSpectrum(std::vector<std::complex<float>>& H0, std::vector<float>& Omega, const OceanParams& Params, uint32_t Seed) {
+	const int N = Params.DispMapSize;
+	float L = Params.PatchSize;
+	// n, m should be be in [-N / 2, N / 2]
+	int start = N / 2;
+
+	// NOTE: in order to be symmetric, this must be (N + 1) x (N + 1) in size
+	H0.resize((N + 1) * (N + 1));
+	Omega.resize((N + 1) * (N + 1));
+
+	glm::vec2 w = WIND_DIRECTION;
+	glm::vec2 wn = glm::normalize(w);
+	float V = WIND_SPEED;
+	float A = AMPLITUDE_CONSTANT;
+
+	ThreadPool::Global().ParallelFor(0, N + 1, [&](int mBegin, int mEnd) {
+		glm::vec2 k;
+		for (int m = mBegin; m < mEnd; ++m) {
+			std::seed_seq seq{ Seed, (uint32_t)m };
+			std::mt19937 gen(seq);
+			std::normal_distribution<> gaussian(0.0, 1.0);
+			k.y = (TWO_PI * (start - m)) / L;
+
+			for (int n = 0; n <= N; ++n) {
+				k.x = (TWO_PI * (start - n)) / L;
+
+				int index = m * (N + 1) + n;
+				float sqrt_P_h = 0;
+
+				if (k.x != 0.0f || k.y != 0.0f)
+					sqrt_P_h = sqrtf(Phillips(k, wn, V, A));
+
+				// real part first, the order of the two draws is part of the stream
+				float re = (float)(sqrt_P_h * gaussian(gen) * ONE_OVER_SQRT_2);
+				float im = (float)(sqrt_P_h * gaussian(gen) * ONE_OVER_SQRT_2);
+				H0[index] = std::complex<float>(re, im);
+
+				// dispersion relation \omega^2(k) = gk
+				Omega[index] = sqrtf(GRAV_ACCELERATION * glm::length(k));
+			}
+		}
+	}, 8);
+}
+
+static uint64_t CalcSpectrumKey(const OceanParams& Params, uint32_t Seed) {
+	glm::vec2 w = WIND_DIRECTION;
+	uint64_t Key = HashValue((uint32_t)OCEAN_SPECTRUM_CACHE_VERSION);
+	Key = HashValue((uint32_t)Params.DispMapSize, Key);
+	Key = HashValue(Seed, Key);
+	Key = HashValue(Params.PatchSize, Key);
+	Key = HashValue(w, Key);
+	Key = HashValue(WIND_SPEED, Key);
+	Key = HashValue(AMPLITUDE_CONSTANT, Key);
+	Key = HashValue(GRAV_ACCELERATION, Key);
+	return Key;
+}
+
+void LoadOceanSpectrum(std::vector<std::complex<float>>& H0, std::vector<float>& Omega, const OceanParams& Params,
+                       uint32_t Seed, const std::string& CacheDir) {
+	if (CacheDir.empty()) {
+		GenerateOceanSpectrum(H0, Omega, Params, Seed);
+		return;
+	}
+
+	const int N = Params.DispMapSize;
+	const size_t Count = (size_t)(N + 1) * (N + 1);
+	const size_t H0Bytes = Count * sizeof(std::complex<float>);
+	const size_t OmegaBytes = Count * sizeof(float);
+	uint64_t Key = CalcSpectrumKey(Params, Seed);
+	char name[64];
+	snprintf(name, sizeof(name), "/ocean_%016llx.qgos", (unsigned long long)Key);
+	std::string path = CacheDir + name;
+
+	{
+		std::ifstream file(path, std::ios::binary);
+		OceanSpectrumCacheHeader header;
+		if (file.read((char*)&header, sizeof(header))) {
+			if (memcmp(header.Magic, OCEAN_SPECTRUM_CACHE_MAGIC, 4) == 0 && header.Version == OCEAN_SPECTRUM_CACHE_VERSION &&
+				header.Key == Key && header.Size == (uint32_t)N && header.Seed == Seed &&
+				header.FileSize == sizeof(header) + H0Bytes + OmegaBytes) {
+				H0.resize(Count);
+				Omega.resize(Count);
+				if (file.read((char*)&H0[0], H0Bytes) && file.read((char*)&Omega[0], OmegaBytes)) return;
+			}
+			printf("Ignoring stale ocean spectrum cache '%s'\n", path.c_str());
+		}
+	}
+
+	GenerateOceanSpectrum(H0, Omega, Params, Seed);
+
+	// written next to the final name and renamed, as the terrain cache
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+	OceanSpectrumCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, OCEAN_SPECTRUM_CACHE_MAGIC, 4);
+	header.Version = OCEAN_SPECTRUM_CACHE_VERSION;
+	header.Key = Key;
+	header.Size = N;
+	header.Seed = Seed;
+	header.FileSize = sizeof(header) + H0Bytes + OmegaBytes;
+
+	std::string TempPath = path + ".tmp";
+	{
+		std::ofstream file(TempPath, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			printf("%s:%d - error opening '%s'\n", __FILE__, __LINE__, TempPath.c_str());
+			return;
+		}
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)&H0[0], H0Bytes);
+		file.write((const char*)&Omega[0], OmegaBytes);
+		if (!file) {
+			printf("%s:%d - error writing '%s'\n", __FILE__, __LINE__, TempPath.c_str());
+			return;
+		}
+	}
+	std::filesystem::rename(TempPath, path, ec);
+	if (ec) printf("%s:%d - error renaming '%s'\n", __FILE__, __LINE__, TempPath.c_str());
+}
@@ -0,0 +1,50 @@
+#ifndef __OCEAN_SPECTRUM_H__
+#define __OCEAN_SPECTRUM_H__
+
+#include <stdint.h>
+#include <complex>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#define GRAV_ACCELERATION	9.81f				// m/s^2
+#define WIND_DIRECTION		{ -0.4f, -0.9f }
+#define WIND_SPEED			6.5f				// m/s
+#define AMPLITUDE_CONSTANT	(0.45f * 1e-3f)		// for the (modified) Phillips spectrum
+#define CHOPPY_LAMBDA		1.3f				// displacement.comp
+
+#define OCEAN_SPECTRUM_CACHE_MAGIC		"QGOS"
+#define OCEAN_SPECTRUM_CACHE_VERSION	1
+
+// Ocean resolution, picked per machine and fixed at Ocean::Init. The sizes reach the
+// compute shaders as #defines (see Ocean::Init).
+struct OceanParams {
+	int DispMapSize = 512;			// FFT size, power of two in [64, 1024] (fft.comp is one work group per row)
+	float PatchSize = 20.0f;		// m covered by one displacement tile
+	int MeshSize = 256;				// quads along a quadtree node, power of two in [16, 256]
+	int FurthestCover = 8;			// full ocean size = PatchSize * (1 << FurthestCover)
+	float MaxCoverage = 64.0f;		// pixel limit for a distant patch to be rendered
+
+	// prints the first bad value
+	bool Validate() const;
+};
+
+// (modified) Phillips spectrum for wave vector k, wind direction w (normalized), wind speed V
+float Phillips(const glm::vec2& k, const glm::vec2& w, float V, float A);
+
+// Initial spectrum h0 and dispersion w of the ocean, (N + 1)^2 samples each for
+// N = DispMapSize, index m * (N + 1) + n for k = 2 pi (N / 2 - (n, m)) / PatchSize. Shared by
+// the compute pipeline (Ocean::Init) and OceanSimulatorCPU, the same Seed gives the
+// same waves on both. Rows are spread over the thread pool, each with its own
+// random stream seeded from (Seed, row), so the result does not depend on the split.
+void GenerateOceanSpectrum(std::vector<std::complex<float>>& H0, std::vector<float>& Omega,
+                           const OceanParams& Params, uint32_t Seed = std::mt19937::default_seed);
+
+// GenerateOceanSpectrum through a cache file in CacheDir (empty disables it), keyed by
+// the seed, DispMapSize, PatchSize and the constants above. The file is a small
+// header followed by H0 and Omega as they sit in memory.
+void LoadOceanSpectrum(std::vector<std::complex<float>>& H0, std::vector<float>& Omega,
+                       const OceanParams& Params, uint32_t Seed, const std::string& CacheDir);
+
+#endif // !__OCEAN_SPECTRUM_H__
@@ -0,0 +1,276 @@
+#include "paged_terrain.h"
+#include "frustum.h"
+
+#include <float.h>
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+
+bool PagedTerrain::Open(const char* path, float WorldScale, int TileSize, int PatchSize, size_t MemoryBudget) {
+    Close();
+    if (!mFile.Open(path)) return false;
+
+    int w = mFile.GetWidth();
+    int d = mFile.GetDepth();
+    if ((w - 1) % (TileSize - 1) != 0 || (d - 1) % (TileSize - 1) != 0 || (TileSize - 1) % (PatchSize - 1) != 0) {
+        printf("%s:%d - '%s' (%d x %d) can't be split in tiles of %d with patches of %d\n", __FILE__, __LINE__,
+                path, w, d, TileSize, PatchSize);
+        mFile.Close();
+        return false;
+    }
+
+    mWorldScale = WorldScale;
+    mTileSize = TileSize;
+    mPatchSize = PatchSize;
+    mNumTilesX = (w - 1) / (TileSize - 1);
+    mNumTilesZ = (d - 1) / (TileSize - 1);
+    mBudget = MemoryBudget;
+    mTiles.clear();
+    mTiles.resize(mNumTilesX * mNumTilesZ);
+    printf("Paged terrain %d x %d, %d x %d tiles of %d, budget %zu MB (%zu tiles)\n", w, d, mNumTilesX, mNumTilesZ,
+            TileSize, MemoryBudget >> 20, MemoryBudget / TileBytes());
+
+    mStop = false;
+    mLoader = std::thread([this] { LoaderLoop(); });
+    return true;
+}
+
+void PagedTerrain::Close() {
+    StopLoader();
+    for (PageTile& tile : mTiles) DestroyTile(tile);
+    mTiles.clear();
+    for (auto& loaded : mLoaded) loaded.second->destroy();
+    mLoaded.clear();
+    mQueue.clear();
+    mFile.Close();
+    mNumResident = mNumPending = 0;
+    mResidentBytes = 0;
+}
+
+void PagedTerrain::loadTiles(const std::vector<std::pair<std::string, std::string>>& paths) {
+    std::shared_ptr<TerrainMaterial> material = std::make_shared<TerrainMaterial>();
+    if (!material->Load(paths)) return;
+    material->setHeightBands(mFile.GetMinHeight(), mFile.GetMaxHeight());
+    setMaterial(material);
+}
+
+void PagedTerrain::setMaterial(const std::shared_ptr<TerrainMaterial>& material) {
+    std::lock_guard<std::mutex> lock(mMutex);   // the loader hands it to new tiles
+    mMaterial = material;
+}
+
+// heights + GeoMipGrid vertices, what a resident tile costs
+size_t PagedTerrain::TileBytes() const {
+    size_t VertexBytes = mVertexFormat == TERRAIN_VERTEX_COMPACT ? sizeof(CompactVertex) : 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
+    size_t PyramidBytes = (size_t)mTileSize * mTileSize * sizeof(glm::vec2) / (HEIGHT_PYRAMID_LEAF * HEIGHT_PYRAMID_LEAF) * 4 / 3;
+    return (size_t)mTileSize * mTileSize * (sizeof(float) + VertexBytes) + PyramidBytes;
+}
+
+void PagedTerrain::Update(const glm::vec3& CameraPos) {
+    if (!IsOpen()) return;
+
+    // nearest tiles within the load radius, as many as the budget allows
+    std::vector<std::pair<float, int>> Candidates;
+    float TileWorldSize = (mTileSize - 1) * mWorldScale;
+    for (int TileX = 0; TileX < mNumTilesX; TileX++) {
+        for (int TileZ = 0; TileZ < mNumTilesZ; TileZ++) {
+            glm::vec3 Min = TileOffset(TileX, TileZ);
+            float dx = std::max(std::max(Min.x - CameraPos.x, CameraPos.x - (Min.x + TileWorldSize)), 0.0f);
+            float dz = std::max(std::max(Min.z - CameraPos.z, CameraPos.z - (Min.z + TileWorldSize)), 0.0f);
+            float Distance = sqrtf(dx * dx + dz * dz);
+            mTiles[TileX * mNumTilesZ + TileZ].Wanted = false;
+            if (Distance < mLoadRadius) Candidates.push_back(std::make_pair(Distance, TileX * mNumTilesZ + TileZ));
+        }
+    }
+    std::sort(Candidates.begin(), Candidates.end());
+    size_t MaxTiles = std::max<size_t>(mBudget / TileBytes(), 1);
+    for (size_t i = 0; i < Candidates.size() && i < MaxTiles; i++) mTiles[Candidates[i].second].Wanted = true;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mLoaderCamera = CameraPos;
+        for (int i = 0; i < (int)mTiles.size(); i++) {
+            PageTile& tile = mTiles[i];
+            if (tile.Wanted && tile.State == TILE_UNLOADED) {
+                mQueue.push_back(i);
+                tile.State = TILE_QUEUED;
+            } else if (!tile.Wanted && tile.State == TILE_QUEUED) {
+                // still waiting: forget it; being loaded: dropped when it arrives
+                auto it = std::find(mQueue.begin(), mQueue.end(), i);
+                if (it != mQueue.end()) {
+                    mQueue.erase(it);
+                    tile.State = TILE_UNLOADED;
+                }
+            }
+        }
+    }
+    mCond.notify_one();
+
+    for (PageTile& tile : mTiles) {
+        if (!tile.Wanted && tile.State == TILE_RESIDENT) DestroyTile(tile);
+    }
+
+    // a few uploads per frame keep the frame time flat
+    std::vector<std::pair<int, std::unique_ptr<Terrain>>> Ready;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        int count = std::min((int)mLoaded.size(), mMaxUploadsPerFrame);
+        for (int i = 0; i < count; i++) Ready.push_back(std::move(mLoaded[i]));
+        mLoaded.erase(mLoaded.begin(), mLoaded.begin() + count);
+    }
+    for (auto& loaded : Ready) {
+        PageTile& tile = mTiles[loaded.first];
+        if (tile.State != TILE_QUEUED) {
+            loaded.second->destroy();
+            continue;
+        }
+        if (!tile.Wanted) {
+            loaded.second->destroy();
+            tile.State = TILE_UNLOADED;
+            continue;
+        }
+        tile.terrain = std::move(loaded.second);
+        tile.terrain->uploadTile();
+        tile.State = TILE_RESIDENT;
+    }
+
+    mNumResident = mNumPending = 0;
+    mResidentBytes = 0;
+    for (PageTile& tile : mTiles) {
+        if (tile.State == TILE_RESIDENT) {
+            mNumResident++;
+            mResidentBytes += tile.terrain->getMemoryBytes();
+        } else if (tile.State == TILE_QUEUED) {
+            mNumPending++;
+        }
+    }
+}
+
+void PagedTerrain::Draw(Shader& shader, const glm::vec3& CameraPos, const glm::mat4& ViewProj, const glm::mat4& Model) {
+    if (!IsOpen()) return;
+
+    shader.use();
+    shader.setFloat("gMinHeight", mFile.GetMinHeight());
+    shader.setFloat("gMaxHeight", mFile.GetMaxHeight());
+    if (mMaterial) mMaterial->Bind(shader);
+
+    Frustum frustum(ViewProj);
+    float TileWorldSize = (mTileSize - 1) * mWorldScale;
+    std::vector<int> Visible;
+    for (int i = 0; i < (int)mTiles.size(); i++) {
+        if (mTiles[i].State != TILE_RESIDENT) continue;
+        glm::vec3 Offset = TileOffset(i / mNumTilesZ, i % mNumTilesZ);
+        glm::vec3 Min(Offset.x, mFile.GetMinHeight(), Offset.z);
+        glm::vec3 Max(Offset.x + TileWorldSize, mFile.GetMaxHeight(), Offset.z + TileWorldSize);
+        if (frustum.IsBoxVisible(Min, Max)) Visible.push_back(i);
+    }
+
+    // LODs of every visible tile first, so the tile edges can be stitched to their neighbours
+    for (int i : Visible) {
+        glm::vec3 Offset = TileOffset(i / mNumTilesZ, i % mNumTilesZ);
+        mTiles[i].terrain->getGrid().UpdateLod(CameraPos - Offset);
+    }
+    for (int i : Visible) StitchTileBorders(i / mNumTilesZ, i % mNumTilesZ);
+
+    for (int i : Visible) {
+        glm::vec3 Offset = TileOffset(i / mNumTilesZ, i % mNumTilesZ);
+        glm::mat4 Translate = glm::translate(glm::mat4(1.0f), Offset);
+        shader.setMat4("model", Model * Translate);
+        mTiles[i].terrain->setShaderParams(shader);
+        mTiles[i].terrain->getGrid().Draw(CameraPos - Offset, ViewProj * Translate);
+    }
+}
+
+void PagedTerrain::StitchTileBorders(int TileX, int TileZ) {
+    GeoMipGrid& grid = mTiles[TileX * mNumTilesZ + TileZ].terrain->getGrid();
+    int NumPatchesX = grid.getNumPatchesX();
+    int NumPatchesZ = grid.getNumPatchesZ();
+
+    auto Neighbour = [this](int x, int z) -> GeoMipGrid* {
+        if (x < 0 || x >= mNumTilesX || z < 0 || z >= mNumTilesZ) return nullptr;
+        PageTile& tile = mTiles[x * mNumTilesZ + z];
+        return tile.State == TILE_RESIDENT ? &tile.terrain->getGrid() : nullptr;
+    };
+
+    std::vector<int> Cores;
+    GeoMipGrid* n = Neighbour(TileX - 1, TileZ);
+    Cores.clear();
+    for (int z = 0; n != nullptr && z < NumPatchesZ; z++) Cores.push_back(n->getLodManager().GetPatchLod(NumPatchesX - 1, z).Core);
+    grid.getLodManager().SetBorderLods(LOD_BORDER_LEFT, Cores);
+
+    n = Neighbour(TileX + 1, TileZ);
+    Cores.clear();
+    for (int z = 0; n != nullptr && z < NumPatchesZ; z++) Cores.push_back(n->getLodManager().GetPatchLod(0, z).Core);
+    grid.getLodManager().SetBorderLods(LOD_BORDER_RIGHT, Cores);
+
+    n = Neighbour(TileX, TileZ - 1);
+    Cores.clear();
+    for (int x = 0; n != nullptr && x < NumPatchesX; x++) Cores.push_back(n->getLodManager().GetPatchLod(x, NumPatchesZ - 1).Core);
+    grid.getLodManager().SetBorderLods(LOD_BORDER_BOTTOM, Cores);
+
+    n = Neighbour(TileX, TileZ + 1);
+    Cores.clear();
+    for (int x = 0; n != nullptr && x < NumPatchesX; x++) Cores.push_back(n->getLodManager().GetPatchLod(x, 0).Core);
+    grid.getLodManager().SetBorderLods(LOD_BORDER_TOP, Cores);
+}
+
+void PagedTerrain::DestroyTile(PageTile& tile) {
+    if (tile.terrain) tile.terrain->destroy();
+    tile.terrain.reset();
+    tile.State = TILE_UNLOADED;
+}
+
+void PagedTerrain::LoaderLoop() {
+    for (;;) {
+        int Index;
+        std::shared_ptr<TerrainMaterial> material;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCond.wait(lock, [this] { return mStop || !mQueue.empty(); });
+            if (mStop) return;
+
+            // nearest queued tile to the latest camera position
+            float TileWorldSize = (mTileSize - 1) * mWorldScale;
+            auto best = mQueue.begin();
+            float BestDistance = FLT_MAX;
+            for (auto it = mQueue.begin(); it != mQueue.end(); ++it) {
+                glm::vec3 Center = TileOffset(*it / mNumTilesZ, *it % mNumTilesZ) + glm::vec3(0.5f * TileWorldSize, 0.0f, 0.5f * TileWorldSize);
+                float Distance = glm::distance(glm::vec2(Center.x, Center.z), glm::vec2(mLoaderCamera.x, mLoaderCamera.z));
+                if (Distance < BestDistance) {
+                    BestDistance = Distance;
+                    best = it;
+                }
+            }
+            Index = *best;
+            mQueue.erase(best);
+            material = mMaterial;
+        }
+
+        int TileX = Index / mNumTilesZ;
+        int TileZ = Index % mNumTilesZ;
+        Array2d<float> heights(mTileSize, mTileSize);
+        mFile.ReadRegion(TileX * (mTileSize - 1), TileZ * (mTileSize - 1), mTileSize, mTileSize, heights.begin());
+
+        std::unique_ptr<Terrain> terrain(new Terrain());
+        terrain->setWorldScale(mWorldScale);
+        terrain->setTexScale(mTexScale);
+        terrain->setVertexFormat(mVertexFormat);
+        terrain->setCompactIndices(mCompactIndices);
+        terrain->setMaterial(material);
+        // one texture period per tile keeps the UVs continuous across tile edges
+        terrain->setTexOrigin(glm::vec2((float)(TileX * (mTileSize - 1)), (float)(TileZ * (mTileSize - 1))), (float)(mTileSize - 1));
+        terrain->buildTile(std::move(heights), mPatchSize);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mLoaded.push_back(std::make_pair(Index, std::move(terrain)));
+    }
+}
+
+void PagedTerrain::StopLoader() {
+    if (!mLoader.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mCond.notify_all();
+    mLoader.join();
+}
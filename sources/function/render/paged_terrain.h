@@ -0,0 +1,109 @@
+#ifndef __PAGED_TERRAIN_H__
+#define __PAGED_TERRAIN_H__
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "terrain.h"
+#include "heightmap_file.h"
+
+/*
+ * Terrain streamed from a heightmap file that does not have to fit in memory.
+ * The map is cut into TileSize x TileSize tiles (neighbours share their edge
+ * row/column), each tile is a small Terrain with its own GeoMipGrid. All tiles
+ * share one GeoMipIndexTable.
+ *
+ * Tiles within the load radius are read and built on a background I/O thread,
+ * nearest first, and uploaded on the GL thread a few per frame. Tiles that fall
+ * out of range, or beyond the memory budget, are dropped.
+ */
+class PagedTerrain {
+public:
+    PagedTerrain() {};
+    ~PagedTerrain() { StopLoader(); }
+
+    // (map size - 1) must be a multiple of (TileSize - 1), (TileSize - 1) of (PatchSize - 1)
+    bool Open(const char* path, float WorldScale, int TileSize, int PatchSize, size_t MemoryBudget);
+    void Close();
+    bool IsOpen() const { return mFile.IsOpen(); }
+
+    // a TerrainMaterial with the height bands spread over the file's height range (after Open)
+    void loadTiles(const std::vector<std::pair<std::string, std::string>>& paths);
+    // shared with the tiles loaded from now on
+    void setMaterial(const std::shared_ptr<TerrainMaterial>& material);
+    void setTexScale(float scale) { mTexScale = scale; }     // before Open
+    void setVertexFormat(TerrainVertexFormat Format) { mVertexFormat = Format; }     // before Open
+    void setCompactIndices(bool enable) { mCompactIndices = enable; }     // before Open
+    void setLoadRadius(float radius) { mLoadRadius = radius; }
+    void setMaxUploadsPerFrame(int count) { mMaxUploadsPerFrame = count; }
+
+    // CameraPos in the terrain's local space: queues loads, uploads finished tiles, evicts
+    void Update(const glm::vec3& CameraPos);
+    // ViewProj = projection * view * Model; each tile draws with Model * its offset
+    void Draw(Shader& shader, const glm::vec3& CameraPos, const glm::mat4& ViewProj, const glm::mat4& Model);
+
+    int getNumResidentTiles() const { return mNumResident; }
+    int getNumPendingTiles() const { return mNumPending; }
+    size_t getResidentBytes() const { return mResidentBytes; }
+    glm::vec2 getCenterPos() const {
+        return glm::vec2(mFile.GetWidth() / 2 * mWorldScale, mFile.GetDepth() / 2 * mWorldScale);
+    }
+
+private:
+    enum TileState {
+        TILE_UNLOADED,
+        TILE_QUEUED,        // waiting for the loader or being read and built
+        TILE_RESIDENT       // uploaded
+    };
+
+    struct PageTile {
+        TileState State = TILE_UNLOADED;
+        bool Wanted = false;
+        std::unique_ptr<Terrain> terrain;
+    };
+
+    glm::vec3 TileOffset(int TileX, int TileZ) const {
+        return glm::vec3(TileX * (mTileSize - 1) * mWorldScale, 0.0f, TileZ * (mTileSize - 1) * mWorldScale);
+    }
+    size_t TileBytes() const;
+    void LoaderLoop();
+    void StopLoader();
+    void DestroyTile(PageTile& tile);
+    void StitchTileBorders(int TileX, int TileZ);
+
+    HeightMapFile mFile;
+    float mWorldScale = 1.0f;
+    float mTexScale = 1.0f;
+    TerrainVertexFormat mVertexFormat = TERRAIN_VERTEX_FULL;
+    bool mCompactIndices = false;
+    float mLoadRadius = 4000.0f;
+    int mTileSize = 0;
+    int mPatchSize = 0;
+    int mNumTilesX = 0;
+    int mNumTilesZ = 0;
+    size_t mBudget = 0;
+    int mMaxUploadsPerFrame = 1;
+    std::vector<PageTile> mTiles;       // TileX * mNumTilesZ + TileZ
+    std::shared_ptr<TerrainMaterial> mMaterial;
+
+    int mNumResident = 0;
+    int mNumPending = 0;
+    size_t mResidentBytes = 0;
+
+    // shared with the loader thread
+    std::thread mLoader;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::deque<int> mQueue;
+    std::vector<std::pair<int, std::unique_ptr<Terrain>>> mLoaded;
+    glm::vec3 mLoaderCamera = glm::vec3(0.0f);
+    bool mStop = false;
+};
+
+#endif // !__PAGED_TERRAIN_H__
@@ -62,7 +62,48 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
     if (geometryPath != nullptr) glDeleteShader(geometry);
 }
 
-Shader::Shader(const char* computePath) {
+Shader::Shader(const char* vertexPath, const char* tessControlPath, const char* tessEvalPath, const char* fragmentPath) {
+    unsigned int vertex = compileStage(vertexPath, GL_VERTEX_SHADER, "VERTEX");
+    unsigned int control = compileStage(tessControlPath, GL_TESS_CONTROL_SHADER, "TESS_CONTROL");
+    unsigned int evaluation = compileStage(tessEvalPath, GL_TESS_EVALUATION_SHADER, "TESS_EVALUATION");
+    unsigned int fragment = compileStage(fragmentPath, GL_FRAGMENT_SHADER, "FRAGMENT");
+    ID = glCreateProgram();
+    glAttachShader(ID, vertex);
+    glAttachShader(ID, control);
+    glAttachShader(ID, evaluation);
+    glAttachShader(ID, fragment);
+    glLinkProgram(ID);
+    checkCompileErrors(ID, "PROGRAM");
+    glDeleteShader(vertex);
+    glDeleteShader(control);
+    glDeleteShader(evaluation);
+    glDeleteShader(fragment);
+}
+
+unsigned int Shader::compileStage(const char* path, GLenum stage, const std::string& type) {
+    std::string code;
+    std::ifstream file;
+    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try {
+        file.open(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        file.close();
+        code = stream.str();
+    }
+    catch (std::ifstream::failure& e) {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << " " << e.what() << std::endl;
+    }
+    const char* source = code.c_str();
+
+    unsigned int shader = glCreateShader(stage);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    checkCompileErrors(shader, type);
+    return shader;
+}
+
+Shader::Shader(const char* computePath, const std::string& defines) {
     std::string computeCode;
     std::ifstream cShaderFile;
     cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -76,6 +117,11 @@ Shader::Shader(const char* computePath) {
     catch (std::ifstream::failure& e) {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
     }
+    if (!defines.empty()) {
+        size_t pos = computeCode.find("#version");
+        if (pos != std::string::npos) pos = computeCode.find('\n', pos);
+        computeCode.insert(pos == std::string::npos ? 0 : pos + 1, defines);
+    }
     const char* cShaderCode = computeCode.c_str();
 
     unsigned int compute;
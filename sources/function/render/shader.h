@@ -13,8 +13,12 @@ public:
 	unsigned int ID;
 
 	Shader() {}
-	Shader(const char* computePath);
+	// defines ("#define NAME value\n" lines) go in right after the #version line, the
+	// source keeps its own values behind #ifndef
+	Shader(const char* computePath, const std::string& defines = std::string());
 	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
+	// GL 4.0 tessellation pipeline: vertex -> tess control -> tess evaluation -> fragment
+	Shader(const char* vertexPath, const char* tessControlPath, const char* tessEvalPath, const char* fragmentPath);
 	void use();  
 	
 	void setBool(const std::string& name, bool value) const;
@@ -32,6 +36,7 @@ public:
 
 private:
 	void checkCompileErrors(unsigned int shader, std::string type);
+	unsigned int compileStage(const char* path, GLenum stage, const std::string& type);
 };
 
 #endif // !__SHADER_H__
\ No newline at end of file
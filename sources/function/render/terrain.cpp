@@ -1,5 +1,6 @@
 #include "terrain.h"
 #include "core/qgemath.h"
+#include "midpoint_displacement.h"
 #include <stb/stb_image.h>
 
 #define QGERROR(msg)\
@@ -13,118 +14,206 @@ Terrain::Terrain(float WorldScale, const char* path) {
     mTriangleList.CreateTriangleList(mTerrainSize, mTerrainSize, this);
 }
 
-void Terrain::Draw(Shader& shader, const glm::vec3 CameraPos) {
+void Terrain::Draw(Shader& shader, const glm::vec3 CameraPos, const glm::mat4& ViewProj) {
     shader.use();
     shader.setFloat("gMinHeight", mMinH);
     shader.setFloat("gMaxHeight", mMaxH);
-    std::string name = "gTextureHeight";
-    for (int i = 0; i < Tiles.size(); i++) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        shader.setInt((name + std::to_string(i)).c_str(), i);
-        glBindTexture(GL_TEXTURE_2D, Tiles[i].id);
-    }
-    // mTriangleList.Draw(shader);
-    mGeoMipGrid.Draw(CameraPos);
+    if (mMaterial) mMaterial->Bind(shader);
+    setShaderParams(shader);
+    // mTriangleList.Draw(shader, this);
+    mGeoMipGrid.Draw(CameraPos, ViewProj);
 }
 
-void Terrain::LoadHightMap(const char* path) {
-    size_t size = 0;
-    unsigned char* p = (unsigned char*)ReadBinaryFile(path, size);
+void Terrain::DrawTessellated(Shader& shader, const glm::vec3 CameraPos, const glm::mat4& ViewProj) {
+    if (!mTessGrid.IsBuilt()) mTessGrid.Build(this);
+    shader.use();
+    shader.setFloat("gMinHeight", mMinH);
+    shader.setFloat("gMaxHeight", mMaxH);
+    if (mMaterial) mMaterial->Bind(shader);
+    setShaderParams(shader);
+    mTessGrid.Draw(shader, CameraPos, ViewProj, getHeightTexture());
+}
 
-    if (size % sizeof(float) != 0) {
-        printf("%s:%d - '%s' does not contain an whole number of floats (size %d)\n", __FILE__, __LINE__, path, size);
-        exit(0);
-    }
-    mTerrainSize = (int)sqrtf((float)size / (float)sizeof(float));
+void Terrain::DrawCdlod(Shader& shader, const glm::vec3 CameraPos, const glm::mat4& ViewProj) {
+    if (!mCdlodGrid.IsBuilt() && !mCdlodGrid.Build(this)) return;
+    mCdlodGrid.Select(CameraPos, ViewProj);
+    shader.use();
+    shader.setFloat("gMinHeight", mMinH);
+    shader.setFloat("gMaxHeight", mMaxH);
+    if (mMaterial) mMaterial->Bind(shader);
+    setShaderParams(shader);
+    mCdlodGrid.Draw(shader, CameraPos, getHeightTexture());
+}
 
-    if ((mTerrainSize * mTerrainSize) != (size / sizeof(float))) {
-        printf("%s:%d - '%s' does not contain a square height map - size %d\n", __FILE__, __LINE__, path, size);
-        exit(0);
+unsigned int Terrain::getHeightTexture() {
+    if (mHeightTexture > 0 || mTerrainSize == 0) return mHeightTexture;
+
+    // one row per x, so the texture is the Array2d rows
+    std::vector<float> Heights((size_t)mTerrainSize * mTerrainSize);
+    for (int x = 0; x < mTerrainSize; x++) {
+        float* row = &Heights[(size_t)x * mTerrainSize];
+        const float* src = GetHeightRow(x, row);
+        if (src != row) memcpy(row, src, mTerrainSize * sizeof(float));
     }
 
-    mHeightMap.set(mTerrainSize, mTerrainSize, (float*)p);
+    glGenTextures(1, &mHeightTexture);
+    glBindTexture(GL_TEXTURE_2D, mHeightTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, mTerrainSize, mTerrainSize, 0, GL_RED, GL_FLOAT, &Heights[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return mHeightTexture;
 }
 
-void Terrain::saveHeightMap(const char* path) {
-    size_t size = mTerrainSize * mTerrainSize * sizeof(float);
-    WriteBinaryFile(path, mHeightMap.begin(), size);
+void Terrain::InvalidateGpuHeights() {
+    if (mHeightTexture > 0) glDeleteTextures(1, &mHeightTexture);
+    mHeightTexture = 0;
+    mTessGrid.Destroy();
+    mCdlodGrid.Destroy();
 }
 
-char* ReadBinaryFile(const char* path, size_t& size) {
-    FILE* f = NULL;
-    errno_t err = fopen_s(&f, path, "rb");
-    if (!f) {
-        char buf[256] { 0 };
-        strerror_s(buf, sizeof(buf), err);
-        QGERROR(buf);
-        exit(0);
+void Terrain::setShaderParams(Shader& shader) const {
+    // terrain_compact.vs and terrain_tess.tes rebuild X/Z and the texture coordinates
+    // from grid positions
+    shader.setFloat("gWorldScale", mWorldScale);
+    shader.setFloat("gTexScale", mTexScale);
+    shader.setVec2("gTexOrigin", mTexOrigin);
+    shader.setFloat("gTexPeriod", GetTexPeriod());
+    if (mGeoMipGrid.getVertexFormat() == TERRAIN_VERTEX_COMPACT) {
+        shader.setInt("gGridWidth", mTerrainSize);
+        shader.setVec2("gHeightRange", mGeoMipGrid.getHeightRange());
     }
 
-    struct stat stat_buf;
-    int error = stat(path, &stat_buf);
-    if (error) {
-        char buf[256] { 0 };
-        strerror_s(buf, sizeof(buf), err);
-        QGERROR(buf);
-        return NULL;
-    }
-    size = stat_buf.st_size;
+    // Tex = TexScale * (TexOrigin + (x, z)) / TexPeriod -> texel centre of (x, z) in the splat map
+    float Size = (float)mTerrainSize;
+    glm::vec2 Scale(GetTexPeriod() / (mTexScale * Size));
+    glm::vec2 Offset = (glm::vec2(0.5f) - mTexOrigin) / Size;
+    shader.setVec4("gSplatTransform", glm::vec4(Scale, Offset));
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mSplatMap);
+}
 
-    char* p = (char*)malloc(size);
-    assert(p);
+void Terrain::LoadHightMap(const char* path) {
+    if (!mHeightFile.Open(path)) {
+        QGERROR("Error loading height map\n");
+        exit(0);
+    }
 
-    size_t bytes_read = fread(p, 1, size, f);
-    if (bytes_read != size) {
-        char buf[256] { 0 };
-        strerror_s(buf, sizeof(buf), err);
-        QGERROR(buf);
+    if (mHeightFile.GetWidth() != mHeightFile.GetDepth()) {
+        printf("%s:%d - '%s' does not contain a square height map - %d x %d\n", __FILE__, __LINE__, path, 
+                mHeightFile.GetWidth(), mHeightFile.GetDepth());
         exit(0);
     }
-    
-    fclose(f);
-    return p;
+
+    mTerrainSize = mHeightFile.GetWidth();
+    mHeightMap.destroy();
+    if (mHeightFile.IsTiled()) setMinMAxHeight(mHeightFile.GetMinHeight(), mHeightFile.GetMaxHeight());
+    mHeightPyramid.Build(this);
+    InvalidateGpuHeights();
 }
 
-void WriteBinaryFile(const char* path, const void* data, size_t& size) {
-    FILE* f = NULL;
-    errno_t err = fopen_s(&f, path, "wb"); 
-    if (!f) {
-        QGERROR((std::string("Error opening '%s'\n") + path).c_str());
-        exit(0);
+void Terrain::saveHeightMap(const char* path, HeightMapFormat format) {
+    if (mHeightFile.IsOpen()) {
+        Array2d<float> heights(mTerrainSize, mTerrainSize);
+        mHeightFile.ReadRegion(0, 0, mTerrainSize, mTerrainSize, heights.begin());
+        mHeightFile.Close();    // the file may be the one we are about to overwrite
+        HeightMapFile::Save(path, heights.begin(), mTerrainSize, mTerrainSize, format);
+        mHeightMap.set(mTerrainSize, mTerrainSize, heights.begin());
+        return;
     }
-    size_t bytes_written = fwrite(data, 1, size, f);
-    if (bytes_written != size) {
-        QGERROR("Error write file\n");
-        exit(0);
+    HeightMapFile::Save(path, mHeightMap.begin(), mTerrainSize, mTerrainSize, format);
+}
+
+void Terrain::buildTile(Array2d<float>&& heights, int PatchSize) {
+    assert(heights.raw() == heights.col());
+    mHeightFile.Close();
+    mTerrainSize = (int)heights.raw();
+    mPatchSize = PatchSize;
+    mHeightMap = std::move(heights);
+    mHeightMap.minmax(mMinH, mMaxH);
+    mHeightPyramid.Build(this);
+    mGeoMipGrid.Build(mTerrainSize, mTerrainSize, mPatchSize, this);
+    if (mMaterial) mMaterial->BuildSplatWeights(this, mSplatWeights);
+}
+
+void Terrain::uploadTile() {
+    size_t Budget = SIZE_MAX;
+    uploadTileStep(Budget);
+}
+
+bool Terrain::uploadTileStep(size_t& Budget) {
+    if (!mGeoMipGrid.UploadStep(Budget)) return false;
+
+    // the splat map goes up with the last vertex chunk
+    InvalidateGpuHeights();
+    if (mSplatMap > 0) glDeleteTextures(1, &mSplatMap);
+    mSplatMap = 0;
+    if (mMaterial && !mSplatWeights.empty()) {
+        mSplatMap = mMaterial->CreateSplatMap(mSplatWeights, mTerrainSize);
+        Budget -= std::min(Budget, mSplatWeights.size());
     }
-    fclose(f);
+    std::vector<unsigned char>().swap(mSplatWeights);
+    return true;
+}
+
+void Terrain::UpdateSplatMap() {
+    if (mSplatMap > 0) glDeleteTextures(1, &mSplatMap);
+    mSplatMap = 0;
+    if (!mMaterial || mTerrainSize == 0) return;
+
+    std::vector<unsigned char> Weights;
+    mMaterial->BuildSplatWeights(this, Weights);
+    mSplatMap = mMaterial->CreateSplatMap(Weights, mTerrainSize);
 }
 
 void Terrain::CreateMidpointDisplacement(int Size, float Roughness, float MinHeight, float MaxHeight) {
     if (Roughness < 0.0f) exit(0);
     mTerrainSize = Size;
+    mHeightFile.Close();
     setMinMAxHeight(MinHeight, MaxHeight);
     mHeightMap.set_all(Size, Size, 0.0f);
     CreateMidpointDisplacementF32(Roughness);
     mHeightMap.normalize(MinHeight, MaxHeight);
+    mHeightPyramid.Build(this);
+    InvalidateGpuHeights();
     mTriangleList.CreateTriangleList(mTerrainSize, mTerrainSize, this);
+    UpdateSplatMap();
 }
 
 void Terrain::CreateMidpointDisplacement(int Size, int PatchSize, float Roughness, float MinHeight, float MaxHeight) {
+    buildMidpointDisplacement(Size, PatchSize, Roughness, MinHeight, MaxHeight);
+    uploadTile();
+}
+
+void Terrain::buildMidpointDisplacement(int Size, int PatchSize, float Roughness, float MinHeight, float MaxHeight) {
     if (Roughness < 0.0f) exit(0);
     mTerrainSize = Size;
     mPatchSize = PatchSize;
+    mHeightFile.Close();
     setMinMAxHeight(MinHeight, MaxHeight);
     mHeightMap.set_all(Size, Size, 0.0f);
     CreateMidpointDisplacementF32(Roughness);
     mHeightMap.normalize(MinHeight, MaxHeight);
-    for (int i = 0; i < Size; i++) 
-        mHeightMap[0][i] = mHeightMap[Size - 1][i] = mHeightMap[i][0] = mHeightMap[i][Size - 1] = MinHeight;
+    SimdFill(mHeightMap[0], Size, MinHeight);
+    SimdFill(mHeightMap[Size - 1], Size, MinHeight);
+    for (int i = 1; i < Size - 1; i++) 
+        mHeightMap[i][0] = mHeightMap[i][Size - 1] = MinHeight;
+    mHeightPyramid.Build(this);
     // mTriangleList.CreateTriangleList(mTerrainSize, mTerrainSize, this);
-    mGeoMipGrid.Create(mTerrainSize, mTerrainSize, mPatchSize, this);
+    mGeoMipGrid.Build(mTerrainSize, mTerrainSize, mPatchSize, this);
+    if (mMaterial) mMaterial->BuildSplatWeights(this, mSplatWeights);
 }
 
 void Terrain::CreateMidpointDisplacementF32(float roughness) {
+    if (IsMidpointDisplacementSize(mTerrainSize)) {
+        MidpointDisplacementParallel(mHeightMap, mTerrainSize, roughness, mSeed);
+        return;
+    }
+
+    // serial fallback for sizes that are not 2^n + 1, draws from rand()
     int size = next_power_of2(mTerrainSize);
     float CurHeight = (float)size / 2.0f;
     float HeightReduce = pow(2.0f, -roughness);
@@ -141,8 +230,9 @@ void Terrain::CreateMidpointDisplacementF32(float roughness) {
 void Terrain::diamondStep(int RectSize, float CurHeight) {
     int HalfRectSize = RectSize / 2;
 
-    for (int y = 0 ; y < mTerrainSize; y += RectSize) {
-        for (int x = 0 ; x < mTerrainSize; x += RectSize) {
+    // x is the Array2d row, keep it in the outer loop
+    for (int x = 0 ; x < mTerrainSize; x += RectSize) {
+        for (int y = 0 ; y < mTerrainSize; y += RectSize) {
             int next_x = (x + RectSize) % mTerrainSize;
             int next_y = (y + RectSize) % mTerrainSize;
 
@@ -173,8 +263,8 @@ void Terrain::diamondStep(int RectSize, float CurHeight) {
 void Terrain::squareStep(int RectSize, float CurHeight) {
     int HalfRectSize = RectSize / 2;
 
-    for (int y = 0 ; y < mTerrainSize ; y += RectSize) {
-        for (int x = 0 ; x < mTerrainSize ; x += RectSize) {
+    for (int x = 0 ; x < mTerrainSize ; x += RectSize) {
+        for (int y = 0 ; y < mTerrainSize ; y += RectSize) {
             int next_x = (x + RectSize) % mTerrainSize;
             int next_y = (y + RectSize) % mTerrainSize;
 
@@ -209,8 +299,15 @@ void Terrain::squareStep(int RectSize, float CurHeight) {
 }
 
 void Terrain::loadTiles(const std::vector<std::pair<std::string, std::string>>& paths) {
-    for (int i = 0; i < paths.size(); i++) 
-        Tiles.push_back({TextureFromFile(paths[i].first), paths[i].second});
+    std::shared_ptr<TerrainMaterial> material = std::make_shared<TerrainMaterial>();
+    if (!material->Load(paths)) return;
+    material->setHeightBands(mMinH, mMaxH);
+    setMaterial(material);
+}
+
+void Terrain::setMaterial(const std::shared_ptr<TerrainMaterial>& material) {
+    mMaterial = material;
+    UpdateSplatMap();
 }
 
 unsigned int TextureFromFile(const std::string& path) {
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
@@ -15,60 +16,168 @@
 #include "core/qgearray.h"
 #include "terrain_trianglelist.h"
 #include "geomip_grid.h"
-
-typedef struct Tile {
-    unsigned int id;
-    std::string type;
-} Tile;
+#include "heightmap_file.h"
+#include "height_pyramid.h"
+#include "terrain_material.h"
+#include "tess_grid.h"
+#include "cdlod_grid.h"
 
 class Terrain {
 public:
+    Terrain() {};
     Terrain(float WorldScale, const char* path);
-    Terrain(float WorldScale, int PatchSize) {
+    Terrain(float WorldScale, int PatchSize, TerrainVertexFormat Format = TERRAIN_VERTEX_FULL) {
         mWorldScale = WorldScale;
         mPatchSize = PatchSize;
+        setVertexFormat(Format);
         CreateMidpointDisplacement(513, 33, 1.0f, 0.0f, 256.0f);
         mGeoMipGrid.Create(513, 513, 33, this);
     }
     ~Terrain() = default;
-    void Draw(Shader& shader, const glm::vec3 CameraPos);
+    void Draw(Shader& shader, const glm::vec3 CameraPos, const glm::mat4& ViewProj);
+    // builds the patch draw list on a worker thread, call before Draw in the same frame
+    void PrepareDraw(const glm::vec3 CameraPos, const glm::mat4& ViewProj) { mGeoMipGrid.PrepareDraw(CameraPos, ViewProj); }
+    // GPU tessellation path (GL 4.0, terrain_tess.* shaders), no PrepareDraw needed; the
+    // TessGrid is built on first use after the heights change
+    void DrawTessellated(Shader& shader, const glm::vec3 CameraPos, const glm::mat4& ViewProj);
+    void setTessParams(float PixelsPerEdge, float FovY, float ViewportHeight) {
+        mTessGrid.setScreenParams(PixelsPerEdge, FovY, ViewportHeight);
+    }
+    int getNumTessPatches() const { return mTessGrid.getNumPatches(); }
+    // CDLOD quadtree path (terrain_cdlod.vs), selection runs on the calling thread; needs
+    // (size - 1) = LeafCells * 2^n, built on first use after the heights change
+    void DrawCdlod(Shader& shader, const glm::vec3 CameraPos, const glm::mat4& ViewProj);
+    void setCdlodParams(float LodDistance, float MorphStart = 0.7f) { mCdlodGrid.setLodParams(LodDistance, MorphStart); }
+    float getCdlodMinLodDistance() const { return CdlodGrid::MinLodDistance(CDLOD_LEAF_CELLS, mWorldScale); }
+    int getNumCdlodNodes() const { return mCdlodGrid.getNumSelectedNodes(); }
+    int getNumCdlodNodesVisited() const { return mCdlodGrid.getNumVisitedNodes(); }
+    // R32F heights shared by the GPU paths, texel (z, x) holds sample (x, z); created on first use
+    unsigned int getHeightTexture();
+    const HeightPyramid& getHeightPyramid() const { return mHeightPyramid; }
     void destroy() {
+        if (mSplatMap > 0) glDeleteTextures(1, &mSplatMap);
+        mSplatMap = 0;
+        mHeightPyramid.Destroy();
         mHeightMap.destroy();
+        mHeightFile.Close();
         // mTriangleList.destroy();
         mGeoMipGrid.Destroy();
+        InvalidateGpuHeights();
+    }
+    float GetHeight(int x, int z) const { 
+        return mHeightFile.IsOpen() ? mHeightFile.GetHeight(x, z) : mHeightMap[x][z]; 
+    }
+    // bilinear, (x, z) in grid units; safe to call from any number of threads
+    float GetHeightInterpolated(float x, float z) const { return mHeightPyramid.GetHeightInterpolated(x, z); }
+    // rays in the terrain's local space, see HeightPyramid
+    bool Raycast(const TerrainRay& ray, TerrainRayHit& hit) const { return mHeightPyramid.Raycast(ray, hit); }
+    void Raycast(const TerrainRay* rays, TerrainRayHit* hits, int count) const { mHeightPyramid.Raycast(rays, hits, count); }
+    // heights (x, 0 .. size - 1); mapped terrains are decoded into scratch (size floats)
+    const float* GetHeightRow(int x, float* scratch) const {
+        if (!mHeightFile.IsOpen()) return mHeightMap[x];
+        mHeightFile.ReadRegion(x, 0, 1, mTerrainSize, scratch);
+        return scratch;
     }
-    float GetHeight(int x, int z) const { return mHeightMap[x][z]; }
     float GetWorldScale() const { return mWorldScale; }
     float GetTexScale() const { return mTexScale; }
     void setWorldScale(float scale) { mWorldScale = scale; }
     void setTexScale(float scale) { mTexScale = scale; }
+    // texture coordinates are TexScale * (TexOrigin + (x, z)) / TexPeriod, the period defaults to the size
+    void setTexOrigin(const glm::vec2& origin, float period) { mTexOrigin = origin; mTexPeriod = period; }
+    glm::vec2 GetTexOrigin() const { return mTexOrigin; }
+    float GetTexPeriod() const { return mTexPeriod > 0.0f ? mTexPeriod : (float)mTerrainSize; }
     int getSize() const { return mTerrainSize; }
+    // used by the next Create*/buildTile; TERRAIN_VERTEX_COMPACT must be drawn with terrain_compact.vs
+    void setVertexFormat(TerrainVertexFormat Format) {
+        mTriangleList.setVertexFormat(Format);
+        mGeoMipGrid.setVertexFormat(Format);
+    }
+    TerrainVertexFormat getVertexFormat() const { return mGeoMipGrid.getVertexFormat(); }
+    // cooked GeoMipGrid buffers are read from / written to this directory by the next Create*
+    void setCacheDir(const std::string& dir) { mGeoMipGrid.setCacheDir(dir); }
+    // 16-bit strip indices for the GeoMipGrid, used by the next Create*/buildTile
+    void setCompactIndices(bool enable) { mGeoMipGrid.setCompactIndices(enable); }
+    size_t getIndexBytesSaved() const { return mGeoMipGrid.getIndexBytesSaved(); }
     void CreateMidpointDisplacement(int Size, float Roughness, float MinHeight, float MaxHeight);
     void CreateMidpointDisplacement(int Size, int PatchSize, float Roughness, float MinHeight, float MaxHeight);
+    // CPU half of the above, no GL calls: finish with uploadTile()/uploadTileStep() on the GL thread
+    void buildMidpointDisplacement(int Size, int PatchSize, float Roughness, float MinHeight, float MaxHeight);
     void setMinMAxHeight(float minH, float maxH) { mMinH = minH; mMaxH = maxH; }
+    void setSeed(uint32_t seed) { mSeed = seed; }
+    // a TerrainMaterial with the height bands spread over setMinMAxHeight
     void loadTiles(const std::vector<std::pair<std::string, std::string>>& paths);
-    void saveHeightMap(const char* path);
+    // can be shared between terrains; the splat map is rebuilt whenever the heights change
+    void setMaterial(const std::shared_ptr<TerrainMaterial>& material);
+    std::shared_ptr<TerrainMaterial> getMaterial() const { return mMaterial; }
+    // per-terrain uniforms and the splat map (unit 1), for callers that draw the grid themselves
+    void setShaderParams(Shader& shader) const;
+    void saveHeightMap(const char* path, HeightMapFormat format = HEIGHTMAP_FORMAT_F32);
+    // CPU half of a paged tile: takes over the (square) heights and builds the grid
+    // and splat weights without GL calls; finish with uploadTile() on the GL thread
+    void buildTile(Array2d<float>&& heights, int PatchSize);
+    void uploadTile();
+    // uploadTile over several frames, at most about Budget bytes per call; true when done
+    bool uploadTileStep(size_t& Budget);
+    // world/texture scale, height bands, seed, material and grid settings, before a build
+    void CopySettings(const Terrain& other) {
+        mWorldScale = other.mWorldScale;
+        mTexScale = other.mTexScale;
+        mTexOrigin = other.mTexOrigin;
+        mTexPeriod = other.mTexPeriod;
+        mMinH = other.mMinH;
+        mMaxH = other.mMaxH;
+        mSeed = other.mSeed;
+        mMaterial = other.mMaterial;
+        mGeoMipGrid.CopySettings(other.mGeoMipGrid);
+    }
+    GeoMipGrid& getGrid() { return mGeoMipGrid; }
+    size_t getMemoryBytes() const { 
+        size_t SplatBytes = mMaterial ? (size_t)mTerrainSize * mTerrainSize * 4 * mMaterial->getNumSplatLayers() : 0;
+        return (size_t)mTerrainSize * mTerrainSize * sizeof(float) + mGeoMipGrid.getVertexBytes() + mHeightPyramid.getBytes() + SplatBytes + 
+               (mTessGrid.IsBuilt() ? mTessGrid.getBytes() : 0) + (mCdlodGrid.IsBuilt() ? mCdlodGrid.getBytes() : 0) +
+               (mHeightTexture > 0 ? (size_t)mTerrainSize * mTerrainSize * sizeof(float) : 0); 
+    }
     glm::vec2 getCenterPos() { return mGeoMipGrid.getCenterPos(); }
+    unsigned int getNormalMap() { return mGeoMipGrid.CreateNormalTexture(); }
+    void setHorizonCulling(bool enable) { mGeoMipGrid.setHorizonCulling(enable); }
+    int getNumDrawnPatches() const { return mGeoMipGrid.getNumDrawnPatches(); }
+    int getNumCulledPatches() const { return mGeoMipGrid.getNumCulledPatches(); }
+    int getNumLodPatchesTouched() const { return mGeoMipGrid.getNumLodPatchesTouched(); }
+    void setLodMode(LodMode Mode) { mGeoMipGrid.setLodMode(Mode); }
+    void setScreenErrorParams(float PixelThreshold, float FovY, float ViewportHeight) {
+        mGeoMipGrid.setScreenErrorParams(PixelThreshold, FovY, ViewportHeight);
+    }
 
 private:
     float mWorldScale = 1.0f;
     float mTexScale = 1.0f;
+    glm::vec2 mTexOrigin = glm::vec2(0.0f);
+    float mTexPeriod = 0.0f;
     int mTerrainSize = 0;
     Array2d<float> mHeightMap;
+    HeightMapFile mHeightFile;     // mapped heightmap, used instead of mHeightMap when open
     TriangleList mTriangleList;
     GeoMipGrid mGeoMipGrid;
-    float mMinH, mMaxH;
+    HeightPyramid mHeightPyramid;
+    TessGrid mTessGrid;
+    CdlodGrid mCdlodGrid;
+    unsigned int mHeightTexture = 0;
+    float mMinH = 0.0f, mMaxH = 0.0f;
     int mPatchSize = 0;
-    std::vector<Tile> Tiles;
+    uint32_t mSeed = 0;
+    std::shared_ptr<TerrainMaterial> mMaterial;
+    std::vector<unsigned char> mSplatWeights;   // between buildTile and uploadTile
+    unsigned int mSplatMap = 0;
 
     void LoadHightMap(const char* path);
+    void UpdateSplatMap();
+    // drops the height texture and the grids built from it
+    void InvalidateGpuHeights();
     void CreateMidpointDisplacementF32(float roughness);
     void diamondStep(int RectSize, float CurHeight);
     void squareStep(int RectSize, float CurHeight);
 };
 
-char* ReadBinaryFile(const char* path, size_t& size);
-void WriteBinaryFile(const char* path, const void* data, size_t& size);
 unsigned int TextureFromFile(const std::string& path);
 
 #endif // !__TERRAIN_H__
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef __TERRAIN_CACHE_H__
+#define __TERRAIN_CACHE_H__
+
+#include <stdint.h>
+
+#define TERRAIN_CACHE_MAGIC     "QGTC"
+#define TERRAIN_CACHE_VERSION   2
+#define TERRAIN_CACHE_ALIGN     16
+
+/*
+ * Cooked GeoMipGrid, written after the first build and mapped on later runs:
+ *   TerrainCacheHeader
+ *   vertex buffer         VertexBytes, in the grid's vertex format
+ *   index buffer          IndexBytes, GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+ *   LodInfo[MaxLOD + 1]
+ *   glm::vec2[NumPatchesX * NumPatchesZ]   patch (min, max) heights
+ * Blocks are stored as they sit in memory, each starting on a TERRAIN_CACHE_ALIGN
+ * boundary so the mapping can be read in place; the cache only has to be readable
+ * by the build that wrote it. Key covers the heights and every parameter the buffers
+ * depend on, a mismatch just rebuilds.
+ */
+struct TerrainCacheHeader {
+    char     Magic[4];
+    uint32_t Version;
+    uint64_t Key;
+    uint32_t Width;
+    uint32_t Depth;
+    uint32_t PatchSize;
+    uint32_t MaxLOD;
+    uint32_t VertexFormat;  // TerrainVertexFormat
+    uint32_t IndexType;     // GL_UNSIGNED_INT / GL_UNSIGNED_SHORT
+    float    HeightMin;     // GeoMipGrid::getHeightRange()
+    float    HeightRange;
+    uint64_t ListBytes;     // GeoMipIndexTable::mListBytes
+    uint64_t VertexOffset;
+    uint64_t VertexBytes;
+    uint64_t IndexOffset;
+    uint64_t IndexBytes;
+    uint64_t LodInfoOffset;
+    uint64_t BoundsOffset;
+    uint64_t FileSize;
+};
+static_assert(sizeof(TerrainCacheHeader) % TERRAIN_CACHE_ALIGN == 0, "the vertex block follows the header directly");
+
+inline uint64_t AlignTerrainCacheOffset(uint64_t Offset) {
+    return (Offset + TERRAIN_CACHE_ALIGN - 1) & ~(uint64_t)(TERRAIN_CACHE_ALIGN - 1);
+}
+
+#endif // !__TERRAIN_CACHE_H__
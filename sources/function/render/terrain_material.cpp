@@ -0,0 +1,136 @@
+#include "terrain_material.h"
+#include "terrain.h"
+#include "core/qgesimd.h"
+#include "core/qgethreadpool.h"
+
+#include <stb/stb_image.h>
+#include <algorithm>
+
+bool TerrainMaterial::Load(const std::vector<std::pair<std::string, std::string>>& paths) {
+    Destroy();
+    mNames.clear();
+    mSetupProgram = 0;
+    if (paths.empty()) return false;
+
+    int Width = 0, Height = 0;
+    std::vector<unsigned char> Layers;
+    for (int i = 0; i < (int)paths.size(); i++) {
+        int w, h, n;
+        unsigned char* data = stbi_load(paths[i].first.c_str(), &w, &h, &n, 4);
+        if (data == nullptr) {
+            std::cout << "Texture failed to load at path: " << paths[i].first << std::endl;
+            return false;
+        }
+        if (i == 0) {
+            Width = w;
+            Height = h;
+            Layers.resize((size_t)Width * Height * 4 * paths.size());
+        }
+
+        // nearest resize to the first image, layers of an array share one size
+        unsigned char* dst = &Layers[(size_t)i * Width * Height * 4];
+        for (int y = 0; y < Height; y++) {
+            int sy = (int)((int64_t)y * h / Height);
+            for (int x = 0; x < Width; x++) {
+                int sx = (int)((int64_t)x * w / Width);
+                memcpy(dst + ((size_t)y * Width + x) * 4, data + ((size_t)sy * w + sx) * 4, 4);
+            }
+        }
+        stbi_image_free(data);
+        mNames.push_back(paths[i].second);
+    }
+
+    int Levels = 1;
+    while ((std::max(Width, Height) >> Levels) > 0) Levels++;
+
+    glGenTextures(1, &mTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, Levels, GL_RGBA8, Width, Height, (GLsizei)mNames.size());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, Width, Height, (GLsizei)mNames.size(),
+                    GL_RGBA, GL_UNSIGNED_BYTE, &Layers[0]);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return true;
+}
+
+void TerrainMaterial::BuildSplatWeights(const Terrain* pTerrain, std::vector<unsigned char>& Weights) const {
+    int Size = pTerrain->getSize();
+    int NumMaterials = getNumMaterials();
+    size_t LayerTexels = (size_t)Size * Size;
+    Weights.assign(LayerTexels * getNumSplatLayers() * 4, 0);
+    if (NumMaterials == 0) return;
+
+    float BandWidth = (mMaxHeight - mMinHeight) / NumMaterials;
+    float InvTwoSpacing = 0.5f / pTerrain->GetWorldScale();
+
+    ThreadPool::Global().ParallelFor(0, Size, [&](int xBegin, int xEnd) {
+        std::vector<float> scratch(3 * Size);
+        std::vector<float> nx(Size), ny(Size), nz(Size);
+        std::vector<float> w(NumMaterials);
+        for (int x = xBegin; x < xEnd; x++) {
+            const float* prev = pTerrain->GetHeightRow(x > 0 ? x - 1 : 0, &scratch[0]);
+            const float* cur  = pTerrain->GetHeightRow(x, &scratch[Size]);
+            const float* next = pTerrain->GetHeightRow(x < Size - 1 ? x + 1 : x, &scratch[2 * Size]);
+            SimdHeightNormals(prev, cur, next, Size, InvTwoSpacing, &nx[0], &ny[0], &nz[0]);
+
+            for (int z = 0; z < Size; z++) {
+                // height bands: between two peaks the neighbouring materials cross-fade
+                std::fill(w.begin(), w.end(), 0.0f);
+                float Band = BandWidth > 0.0f ? (cur[z] - mMinHeight) / BandWidth - 1.0f : 0.0f;
+                if (Band <= 0.0f) {
+                    w[0] = 1.0f;
+                } else if (Band >= (float)(NumMaterials - 1)) {
+                    w[NumMaterials - 1] = 1.0f;
+                } else {
+                    int i = (int)Band;
+                    w[i] = 1.0f - (Band - (float)i);
+                    w[i + 1] = Band - (float)i;
+                }
+
+                if (mSlopeMaterial >= 0 && mSlopeMaterial < NumMaterials) {
+                    float Slope = 1.0f - ny[z];
+                    float t = glm::smoothstep(mMinSlope - mSlopeBlend, mMinSlope + mSlopeBlend, Slope);
+                    for (int m = 0; m < NumMaterials; m++) w[m] *= 1.0f - t;
+                    w[mSlopeMaterial] += t;
+                }
+
+                size_t Texel = (size_t)z * Size + x;
+                for (int m = 0; m < NumMaterials; m++) {
+                    Weights[((m / 4) * LayerTexels + Texel) * 4 + m % 4] = (unsigned char)(w[m] * 255.0f + 0.5f);
+                }
+            }
+        }
+    }, 8);
+}
+
+unsigned int TerrainMaterial::CreateSplatMap(const std::vector<unsigned char>& Weights, int Size) const {
+    unsigned int Texture;
+    glGenTextures(1, &Texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, Texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, Size, Size, getNumSplatLayers());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, Size, Size, getNumSplatLayers(),
+                    GL_RGBA, GL_UNSIGNED_BYTE, &Weights[0]);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return Texture;
+}
+
+void TerrainMaterial::Bind(Shader& shader) {
+    if (mSetupProgram != shader.ID) {
+        shader.setInt("gMaterials", 0);
+        shader.setInt("gSplatMap", 1);
+        shader.setInt("gNumMaterials", getNumMaterials());
+        mSetupProgram = shader.ID;
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+}
@@ -0,0 +1,66 @@
+#ifndef __TERRAIN_MATERIAL_H__
+#define __TERRAIN_MATERIAL_H__
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+#include "shader.h"
+
+class Terrain;
+
+/*
+ * Terrain textures packed into one GL_TEXTURE_2D_ARRAY, blended by a splat map.
+ *
+ * The splat map holds one weight per material, four materials per RGBA8 layer of
+ * a second texture array, so any number of materials costs two bindings. Weights
+ * come from height bands (material i peaks at MinHeight + (i + 1) * range / N and
+ * fades into its neighbours) and, optionally, a material that takes over on steep
+ * slopes. They are computed once per terrain when it is created.
+ *
+ * Texture units: materials on 0, splat map on 1 (terrain.fs).
+ */
+class TerrainMaterial {
+public:
+    TerrainMaterial() {};
+    ~TerrainMaterial() = default;
+
+    // every image is resized to the first one's size
+    bool Load(const std::vector<std::pair<std::string, std::string>>& paths);
+    void Destroy() {
+        if (mTexture > 0) glDeleteTextures(1, &mTexture);
+        mTexture = 0;
+    }
+    int getNumMaterials() const { return (int)mNames.size(); }
+    int getNumSplatLayers() const { return (getNumMaterials() + 3) / 4; }
+
+    void setHeightBands(float MinHeight, float MaxHeight) { mMinHeight = MinHeight; mMaxHeight = MaxHeight; }
+    // slope = 1 - normal.y; Material fades in over [MinSlope - Blend, MinSlope + Blend], -1 disables
+    void setSlopeMaterial(int Material, float MinSlope, float Blend) {
+        mSlopeMaterial = Material;
+        mMinSlope = MinSlope;
+        mSlopeBlend = Blend;
+    }
+
+    // RGBA8 weights, getNumSplatLayers() layers of Size x Size texels, texel (x, z) at
+    // z * Size + x. CPU only, can run on any thread.
+    void BuildSplatWeights(const Terrain* pTerrain, std::vector<unsigned char>& Weights) const;
+    unsigned int CreateSplatMap(const std::vector<unsigned char>& Weights, int Size) const;
+
+    // binds the material array; the samplers and the material count are set the
+    // first time a program is seen
+    void Bind(Shader& shader);
+
+private:
+    unsigned int mTexture = 0;
+    std::vector<std::string> mNames;
+    float mMinHeight = 0.0f;
+    float mMaxHeight = 256.0f;
+    int mSlopeMaterial = -1;
+    float mMinSlope = 0.5f;
+    float mSlopeBlend = 0.1f;
+    unsigned int mSetupProgram = 0;
+};
+
+#endif // !__TERRAIN_MATERIAL_H__
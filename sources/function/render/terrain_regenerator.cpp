@@ -0,0 +1,65 @@
+#include "terrain_regenerator.h"
+#include "core/qgethreadpool.h"
+
+void TerrainRegenerator::Request(const Terrain& Template, const TerrainGenParams& Params) {
+    mQueued = std::make_unique<Terrain>();
+    mQueued->CopySettings(Template);
+    mQueued->setSeed(Params.Seed);
+    mQueuedParams = Params;
+    mQueuedHeights = Array2d<float>();
+    if (!mBuilding.valid() && !mUploading) Start();
+}
+
+void TerrainRegenerator::Request(const Terrain& Template, Array2d<float>&& Heights, int PatchSize) {
+    mQueued = std::make_unique<Terrain>();
+    mQueued->CopySettings(Template);
+    mQueuedParams = TerrainGenParams();
+    mQueuedParams.Size = (int)Heights.raw();
+    mQueuedParams.PatchSize = PatchSize;
+    mQueuedHeights = std::move(Heights);
+    if (!mBuilding.valid() && !mUploading) Start();
+}
+
+void TerrainRegenerator::Start() {
+    mNext = std::move(mQueued);
+    mNextParams = mQueuedParams;
+    mNextHeights = std::move(mQueuedHeights);
+    Terrain* pTerrain = mNext.get();
+    TerrainGenParams Params = mNextParams;
+    Array2d<float>* pHeights = &mNextHeights;
+    JPH::ShapeRefC* pShape = mBuildHeightField ? &mNextShape : nullptr;
+    glm::vec3 Offset = mHeightFieldOffset;
+    mBuilding = ThreadPool::Global().Submit([pTerrain, Params, pHeights, pShape, Offset] {
+        if (pHeights->raw() > 0) {
+            pTerrain->buildTile(std::move(*pHeights), Params.PatchSize);
+        } else {
+            pTerrain->buildMidpointDisplacement(Params.Size, Params.PatchSize, Params.Roughness,
+                                                Params.MinHeight, Params.MaxHeight);
+        }
+        // transpose + HeightFieldShapeSettings::Create, kept off the swap frame
+        if (pShape) *pShape = PhysicsWorld::CreateHeightFieldShape(pTerrain, Offset);
+    });
+}
+
+std::unique_ptr<Terrain> TerrainRegenerator::Update(size_t UploadBudget) {
+    if (mBuilding.valid()) {
+        if (mBuilding.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return nullptr;
+        mBuilding.get();
+        if (mQueued) {
+            // stale before it reached the GPU, nothing to free but CPU memory
+            mNext.reset();
+            mNextShape = nullptr;
+            Start();
+            return nullptr;
+        }
+        mUploading = true;
+    }
+    if (!mUploading) return nullptr;
+
+    if (!mNext->uploadTileStep(UploadBudget)) return nullptr;
+    mUploading = false;
+    std::unique_ptr<Terrain> Finished = std::move(mNext);
+    mFinishedShape = std::move(mNextShape);
+    if (mQueued) Start();
+    return Finished;
+}
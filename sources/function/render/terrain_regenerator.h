@@ -0,0 +1,72 @@
+#ifndef __TERRAIN_REGENERATOR_H__
+#define __TERRAIN_REGENERATOR_H__
+
+#include <memory>
+#include <future>
+#include <stdint.h>
+
+#include "terrain.h"
+#include "physics/physics_world.h"
+
+typedef struct TerrainGenParams {
+    int Size = 513;
+    int PatchSize = 33;
+    float Roughness = 1.0f;
+    float MinHeight = 0.0f;
+    float MaxHeight = 256.0f;
+    uint32_t Seed = 0;
+} TerrainGenParams;
+
+/*
+ * Rebuilds a midpoint displacement terrain (or one from given heights) without
+ * stalling the render thread.
+ * Heights, pyramid, GeoMipGrid vertices/normals (or the cooked cache) and splat
+ * weights (and, when asked, the physics heightfield shape) are built on the
+ * thread pool into a separate Terrain, which is then
+ * uploaded a slice per frame. The live terrain keeps drawing until Update hands
+ * over the finished one, the caller swaps it in between two frames.
+ *
+ * Requests arriving while a build runs are coalesced, only the latest is built
+ * next and a build that is already stale when it finishes is never uploaded, so
+ * dragging a slider costs one build in flight at a time.
+ */
+class TerrainRegenerator {
+public:
+    TerrainRegenerator() {};
+    ~TerrainRegenerator() { if (mBuilding.valid()) mBuilding.wait(); }
+
+    // the new terrain copies Template's settings and material (see Terrain::CopySettings)
+    void Request(const Terrain& Template, const TerrainGenParams& Params);
+    // same, from ready heights (a HeightmapSynthesizer readback, a paged tile, ...)
+    void Request(const Terrain& Template, Array2d<float>&& Heights, int PatchSize);
+    // GL thread, once per frame: uploads up to UploadBudget bytes and returns the
+    // terrain once it is complete, nullptr otherwise
+    std::unique_ptr<Terrain> Update(size_t UploadBudget);
+    bool IsBusy() const { return mBuilding.valid() || mUploading || mQueued != nullptr; }
+
+    // builds also come with a Jolt heightfield, Offset is the world position of sample (0, 0)
+    void setBuildHeightField(bool Build, const glm::vec3& Offset = glm::vec3(0.0f)) {
+        mBuildHeightField = Build;
+        mHeightFieldOffset = Offset;
+    }
+    // heightfield of the terrain the last Update returned, for PhysicsWorld::SetTerrainShape
+    JPH::ShapeRefC takeHeightField() { return std::move(mFinishedShape); }
+
+private:
+    void Start();
+
+    std::unique_ptr<Terrain> mNext;         // being built or uploaded
+    TerrainGenParams mNextParams;
+    Array2d<float> mNextHeights;            // used instead of mNextParams when not empty
+    std::future<void> mBuilding;
+    bool mUploading = false;
+    std::unique_ptr<Terrain> mQueued;       // settings copied at request time
+    TerrainGenParams mQueuedParams;
+    Array2d<float> mQueuedHeights;
+    bool mBuildHeightField = false;
+    glm::vec3 mHeightFieldOffset = glm::vec3(0.0f);
+    JPH::ShapeRefC mNextShape;              // written by the build job
+    JPH::ShapeRefC mFinishedShape;
+};
+
+#endif // !__TERRAIN_REGENERATOR_H__
@@ -1,5 +1,6 @@
 #include "terrain_trianglelist.h"
 #include "terrain.h"
+#include "core/qgesimd.h"
 
 void TriangleList::CreateTriangleList(int width, int depth, const Terrain* pTerrain) {
     mWidth = width;
@@ -12,14 +13,18 @@ void TriangleList::CreateTriangleList(int width, int depth, const Terrain* pTerr
 }
 
 void TriangleList::setupTriangleList(const Terrain* pTerrain) {
-    Vertices.resize(mWidth * mDepth);
     int idx = 0;
-    for (int z = 0; z < mDepth; z++)
-        for (int x = 0; x < mWidth; x++) {
-            assert(idx < Vertices.size());
-            Vertices[idx++].InitVertex(pTerrain, x, z);
-        }
-    assert(idx == Vertices.size());
+    if (mVertexFormat == TERRAIN_VERTEX_COMPACT) {
+        setupCompactVertices(pTerrain);
+    } else {
+        Vertices.resize(mWidth * mDepth);
+        for (int z = 0; z < mDepth; z++)
+            for (int x = 0; x < mWidth; x++) {
+                assert(idx < Vertices.size());
+                Vertices[idx++].InitVertex(pTerrain, x, z);
+            }
+        assert(idx == Vertices.size());
+    }
 
     int NumQuads = (mWidth - 1) * (mDepth - 1);
     Indices.resize(NumQuads * 6);
@@ -56,18 +61,69 @@ void TriangleList::setupTriangleList(const Terrain* pTerrain) {
 
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(Vertex), &Vertices[0], GL_STATIC_DRAW);
-
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, Indices.size() * sizeof(unsigned int), &Indices[0], GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(void*)offsetof(Vertex, Tex));
+    if (mVertexFormat == TERRAIN_VERTEX_COMPACT) {
+        glBufferData(GL_ARRAY_BUFFER, CompactVertices.size() * sizeof(CompactVertex), &CompactVertices[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Normal));
+        std::vector<CompactVertex>().swap(CompactVertices);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(Vertex), &Vertices[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(void*)offsetof(Vertex, Tex));
+    }
+}
+
+// Same layout as GeoMipGrid's compact vertices: the vertex index z * mWidth + x
+// gives X/Z in terrain_compact.vs, only the height and the normal are stored.
+void TriangleList::setupCompactVertices(const Terrain* pTerrain) {
+    std::vector<float> scratch(3 * mDepth);
+    std::vector<float> nx(mDepth), ny(mDepth), nz(mDepth);
+
+    float MinH = 0.0f, MaxH = 0.0f;
+    for (int x = 0; x < mWidth; x++) {
+        float RowMin, RowMax;
+        SimdMinMax(pTerrain->GetHeightRow(x, &scratch[0]), mDepth, RowMin, RowMax);
+        MinH = x == 0 ? RowMin : std::min(MinH, RowMin);
+        MaxH = x == 0 ? RowMax : std::max(MaxH, RowMax);
+    }
+    mHeightRange = glm::vec2(MinH, MaxH - MinH);
+
+    CompactVertices.resize(mWidth * mDepth);
+    float InvTwoSpacing = 0.5f / pTerrain->GetWorldScale();
+    for (int x = 0; x < mWidth; x++) {
+        const float* prev = pTerrain->GetHeightRow(x > 0 ? x - 1 : 0, &scratch[0]);
+        const float* cur  = pTerrain->GetHeightRow(x, &scratch[mDepth]);
+        const float* next = pTerrain->GetHeightRow(x < mWidth - 1 ? x + 1 : x, &scratch[2 * mDepth]);
+        SimdHeightNormals(prev, cur, next, mDepth, InvTwoSpacing, &nx[0], &ny[0], &nz[0]);
+
+        for (int z = 0; z < mDepth; z++) {
+            CompactVertex& v = CompactVertices[z * mWidth + x];
+            v.Height = QuantizeHeight(cur[z], mHeightRange);
+            OctEncodeNormal(glm::vec3(nx[z], ny[z], nz[z]), v.Normal);
+        }
+    }
 }
 
-void TriangleList::Draw(Shader& shader) {
+void TriangleList::Draw(Shader& shader, const Terrain* pTerrain) {
+    if (mVertexFormat == TERRAIN_VERTEX_COMPACT) {
+        if (glGetUniformLocation(shader.ID, "gGridWidth") < 0) {
+            printf("%s:%d - compact triangle list drawn without terrain_compact.vs\n", __FILE__, __LINE__);
+            return;
+        }
+        shader.setInt("gGridWidth", mWidth);
+        shader.setVec2("gHeightRange", mHeightRange);
+        shader.setFloat("gWorldScale", pTerrain->GetWorldScale());
+        shader.setFloat("gTexScale", pTerrain->GetTexScale());
+        shader.setVec2("gTexOrigin", pTerrain->GetTexOrigin());
+        shader.setFloat("gTexPeriod", pTerrain->GetTexPeriod());
+    }
     glBindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, (mDepth - 1) * (mWidth - 1) * 6, GL_UNSIGNED_INT, NULL);
     glBindVertexArray(0);
@@ -6,6 +6,7 @@
 #include <glad/glad.h>
 
 #include "shader.h"
+#include "terrain_vertex.h"
 
 class Terrain;
 
@@ -14,7 +15,11 @@ public:
     TriangleList() {};
     ~TriangleList() = default;
     void CreateTriangleList(int width, int depth, const Terrain* pTerrain);
-    void Draw(Shader& shader);
+    // the compact format rebuilds X/Z and the texture coordinates from pTerrain's
+    // scale and texture parameters, as Terrain::setShaderParams does for GeoMipGrid
+    void Draw(Shader& shader, const Terrain* pTerrain);
+    // takes effect at the next CreateTriangleList; the compact format needs terrain_compact.vs
+    void setVertexFormat(TerrainVertexFormat Format) { mVertexFormat = Format; }
     void destroy() {
         if (VAO > 0) glDeleteVertexArrays(1, &VAO);
         if (VBO > 0) glDeleteBuffers(1, &VBO);
@@ -29,11 +34,15 @@ private:
     } Vertex;
 
     int mWidth, mDepth;
+    TerrainVertexFormat mVertexFormat = TERRAIN_VERTEX_FULL;
+    glm::vec2 mHeightRange = glm::vec2(0.0f);
     std::vector<Vertex> Vertices;
+    std::vector<CompactVertex> CompactVertices;
     std::vector<unsigned int> Indices;
     unsigned int VAO, VBO, EBO;
 
     void setupTriangleList(const Terrain* pTerrain);
+    void setupCompactVertices(const Terrain* pTerrain);
 };
 
 #endif // !__TERRAIN_TRIANGLE_LIST_H__
\ No newline at end of file
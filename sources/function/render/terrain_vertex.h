@@ -0,0 +1,56 @@
+#ifndef __TERRAIN_VERTEX_H__
+#define __TERRAIN_VERTEX_H__
+
+#include <stdint.h>
+#include <math.h>
+#include <glm/glm.hpp>
+
+enum TerrainVertexFormat {
+    TERRAIN_VERTEX_FULL    = 0,     // float position, texture coordinates (and normal)
+    TERRAIN_VERTEX_COMPACT = 1      // CompactVertex, use terrain_compact.vs
+};
+
+// 6 bytes. X/Z and the texture coordinates are rebuilt in terrain_compact.vs from
+// gl_VertexID (z * width + x, BaseVertex included), the height is quantized
+// between the grid's min and max height.
+typedef struct CompactVertex {
+    uint16_t Height;
+    int16_t  Normal[2];             // octahedral, +y hemisphere in the middle
+} CompactVertex;
+
+static_assert(sizeof(CompactVertex) == 6, "CompactVertex must stay tightly packed");
+
+// Octahedral normal encoding with y as the hemisphere axis, so up-facing terrain
+// normals get the most precision. terrain_compact.vs has the matching decode.
+inline void OctEncodeNormal(const glm::vec3& n, int16_t out[2]) {
+    float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    float u = n.x / l1;
+    float v = n.z / l1;
+    if (n.y < 0.0f) {
+        float fu = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float fv = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+    out[0] = (int16_t)roundf(glm::clamp(u, -1.0f, 1.0f) * 32767.0f);
+    out[1] = (int16_t)roundf(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+inline glm::vec3 OctDecodeNormal(const int16_t in[2]) {
+    float u = glm::max(in[0] / 32767.0f, -1.0f);
+    float v = glm::max(in[1] / 32767.0f, -1.0f);
+    glm::vec3 n(u, 1.0f - fabsf(u) - fabsf(v), v);
+    float t = glm::max(-n.y, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.z += n.z >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// HeightRange is (min, max - min)
+inline uint16_t QuantizeHeight(float h, const glm::vec2& HeightRange) {
+    if (HeightRange.y <= 0.0f) return 0;
+    float q = (h - HeightRange.x) / HeightRange.y * 65535.0f + 0.5f;
+    return (uint16_t)glm::clamp(q, 0.0f, 65535.0f);
+}
+
+#endif // !__TERRAIN_VERTEX_H__
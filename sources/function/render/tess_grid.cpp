@@ -0,0 +1,88 @@
+#include "tess_grid.h"
+#include "terrain.h"
+#include "core/qgesimd.h"
+#include "core/qgethreadpool.h"
+
+#include <algorithm>
+#include <float.h>
+#include <stddef.h>
+
+void TessGrid::Build(const Terrain* pTerrain, int PatchCells) {
+    Destroy();
+    mSize = pTerrain->getSize();
+    mWorldScale = pTerrain->GetWorldScale();
+    mPatchCells = std::min(std::max(PatchCells, 1), TESS_GRID_MAX_LEVEL);
+    if (mSize < 2) return;
+
+    int Cells = mSize - 1;
+    int NumPatchesX = (Cells + mPatchCells - 1) / mPatchCells;
+    mNumPatches = NumPatchesX * NumPatchesX;
+
+    std::vector<PatchVertex> Vertices((size_t)mNumPatches * 4);
+    ThreadPool::Global().ParallelFor(0, NumPatchesX, [&](int PatchBegin, int PatchEnd) {
+        for (int px = PatchBegin; px < PatchEnd; px++) {
+            int x0 = px * mPatchCells, x1 = std::min(x0 + mPatchCells, Cells);
+            std::vector<float> scratch(mSize);
+            std::vector<glm::vec2> Bounds(NumPatchesX, glm::vec2(FLT_MAX, -FLT_MAX));
+            for (int x = x0; x <= x1; x++) {
+                const float* row = pTerrain->GetHeightRow(x, &scratch[0]);
+                for (int pz = 0; pz < NumPatchesX; pz++) {
+                    int z0 = pz * mPatchCells, z1 = std::min(z0 + mPatchCells, Cells);
+                    float minH, maxH;
+                    SimdMinMax(row + z0, z1 - z0 + 1, minH, maxH);
+                    Bounds[pz].x = std::min(Bounds[pz].x, minH);
+                    Bounds[pz].y = std::max(Bounds[pz].y, maxH);
+                }
+            }
+
+            for (int pz = 0; pz < NumPatchesX; pz++) {
+                int z0 = pz * mPatchCells, z1 = std::min(z0 + mPatchCells, Cells);
+                // corners (x0, z0), (x1, z0), (x1, z1), (x0, z1): u runs along x, v along z
+                PatchVertex* v = &Vertices[((size_t)px * NumPatchesX + pz) * 4];
+                v[0].Grid = glm::vec2(x0, z0);
+                v[1].Grid = glm::vec2(x1, z0);
+                v[2].Grid = glm::vec2(x1, z1);
+                v[3].Grid = glm::vec2(x0, z1);
+                for (int i = 0; i < 4; i++) v[i].Bounds = Bounds[pz];
+            }
+        }
+    }, 1);
+
+    glGenVertexArrays(1, &mVAO);
+    glBindVertexArray(mVAO);
+    glGenBuffers(1, &mVB);
+    glBindBuffer(GL_ARRAY_BUFFER, mVB);
+    glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(PatchVertex), &Vertices[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(PatchVertex), (void*)offsetof(PatchVertex, Grid));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(PatchVertex), (void*)offsetof(PatchVertex, Bounds));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TessGrid::Destroy() {
+    if (mVB > 0) glDeleteBuffers(1, &mVB);
+    if (mVAO > 0) glDeleteVertexArrays(1, &mVAO);
+    mVB = 0;
+    mVAO = 0;
+    mNumPatches = 0;
+}
+
+void TessGrid::Draw(Shader& shader, const glm::vec3& CameraPos, const glm::mat4& ViewProj, GLuint HeightTexture) {
+    if (!IsBuilt()) return;
+    shader.setMat4("gViewProj", ViewProj);
+    shader.setVec3("gCameraPos", CameraPos);
+    shader.setFloat("gProjScale", mProjScale);
+    shader.setFloat("gPixelsPerEdge", mPixelsPerEdge);
+    shader.setFloat("gWorldScale", mWorldScale);
+    shader.setInt("gGridSize", mSize);
+    shader.setInt("gHeightMap", 2);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, HeightTexture);
+
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+    glBindVertexArray(mVAO);
+    glDrawArrays(GL_PATCHES, 0, mNumPatches * 4);
+    glBindVertexArray(0);
+}
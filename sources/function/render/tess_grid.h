@@ -0,0 +1,64 @@
+#ifndef __TESS_GRID_H__
+#define __TESS_GRID_H__
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+#include "shader.h"
+
+class Terrain;
+
+#define TESS_GRID_MAX_LEVEL 64      // GL_MAX_TESS_GEN_LEVEL is at least 64
+
+/*
+ * GL 4.x alternative to GeoMipGrid: the terrain is drawn as coarse GL_PATCHES of
+ * PatchCells x PatchCells cells and the tessellator adds the detail.
+ *
+ * terrain_tess.tcs picks the level of every patch edge from its projected size,
+ * using only the two corner samples of the edge, so the patches on both sides
+ * agree and no stitching is needed. terrain_tess.tes reads the heights (and the
+ * normals, by central differences) from the terrain's R32F height texture
+ * (Terrain::getHeightTexture). The CPU does no per-frame LOD work, patches outside
+ * the frustum get tess level 0.
+ */
+class TessGrid {
+public:
+    TessGrid() {};
+    ~TessGrid() = default;
+
+    // GL thread; PatchCells up to TESS_GRID_MAX_LEVEL, one triangle pair per cell at full detail
+    void Build(const Terrain* pTerrain, int PatchCells = TESS_GRID_MAX_LEVEL);
+    void Destroy();
+    bool IsBuilt() const { return mVAO > 0; }
+
+    // a tessellated edge aims at PixelsPerEdge pixels per segment
+    void setScreenParams(float PixelsPerEdge, float FovY, float ViewportHeight) {
+        mPixelsPerEdge = PixelsPerEdge;
+        mProjScale = ViewportHeight / (2.0f * tanf(FovY * 0.5f));
+    }
+
+    // expects terrain_tess.vs/.tcs/.tes; ViewProj includes the model matrix
+    void Draw(Shader& shader, const glm::vec3& CameraPos, const glm::mat4& ViewProj, GLuint HeightTexture);
+
+    int getNumPatches() const { return mNumPatches; }
+    size_t getBytes() const { return (size_t)mNumPatches * 4 * sizeof(PatchVertex); }
+
+private:
+    struct PatchVertex {
+        glm::vec2 Grid;         // corner in grid units
+        glm::vec2 Bounds;       // patch (min, max) height, for culling
+    };
+
+    int mSize = 0;
+    int mPatchCells = 0;
+    int mNumPatches = 0;
+    float mWorldScale = 1.0f;
+    float mPixelsPerEdge = 8.0f;
+    float mProjScale = 1000.0f;
+
+    GLuint mVAO = 0;
+    GLuint mVB = 0;
+};
+
+#endif // !__TESS_GRID_H__
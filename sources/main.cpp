@@ -31,7 +31,11 @@
 #include "function/render/model.h"
 #include "function/render/skybox.h"
 #include "function/render/terrain.h"
+#include "function/render/paged_terrain.h"
+#include "function/render/terrain_regenerator.h"
+#include "function/render/heightmap_synth.h"
 #include "function/render/ocean/ocean.h"
+#include "function/physics/physics_world.h"
 #include "core/qgetime.h"
 #include "core/qgetime.h"
 #include "animation/animator.h"
@@ -140,7 +144,10 @@ int main() {
 
     #if 1
     Ocean ocean;
-    ocean.Init();
+    // quality tier: DispMapSize 256 / 512 / 1024, MeshSize 64 - 256
+    OceanParams oceanParams;
+    ocean.setCacheDir("..\\asserts\\cache");
+    ocean.Init(oceanParams);
     #endif
 
     SkyBox skybox("..\\asserts\\images\\ocean_env");
@@ -149,9 +156,20 @@ int main() {
     skyboxShader.setInt("skybox", 0);
 
     #if 1
-    Terrain terrain(2.0f, 33);
-    terrain.setTexScale(4.0f);
-    Shader terrainShader("..\\asserts\\shaders\\terrain.vs", "..\\asserts\\shaders\\terrain.fs");
+    // compact vertices: 6 bytes each, position and UVs come from gl_VertexID in the shader
+    std::unique_ptr<Terrain> terrain = std::make_unique<Terrain>();
+    terrain->setVertexFormat(TERRAIN_VERTEX_COMPACT);
+    terrain->setCompactIndices(true);
+    terrain->setCacheDir("..\\asserts\\cache");
+    terrain->setWorldScale(2.0f);
+    terrain->CreateMidpointDisplacement(513, 33, 1.0f, 0.0f, 256.0f);
+    terrain->setTexScale(4.0f);
+    Shader terrainShader("..\\asserts\\shaders\\terrain_compact.vs", "..\\asserts\\shaders\\terrain.fs");
+    Shader terrainTessShader("..\\asserts\\shaders\\terrain_tess.vs", "..\\asserts\\shaders\\terrain_tess.tcs",
+                             "..\\asserts\\shaders\\terrain_tess.tes", "..\\asserts\\shaders\\terrain.fs");
+    Shader terrainCdlodShader("..\\asserts\\shaders\\terrain_cdlod.vs", "..\\asserts\\shaders\\terrain.fs");
+    // 0 GeoMipGrid, 1 GPU tessellation, 2 CDLOD
+    int terrainPath = 0;
     terrainShader.use();
     terrainShader.setVec3("gReversedLightDir", glm::vec3(0.0f, 1.0f, 0.0f));
     std::vector<std::pair<std::string, std::string>> Tiles;
@@ -159,13 +177,36 @@ int main() {
     Tiles.push_back({"..\\asserts\\images\\tile2.jpg", "tile2"});
     Tiles.push_back({"..\\asserts\\images\\tile3.png", "tile3"});
     Tiles.push_back({"..\\asserts\\images\\tile4.png", "tile4"});
-    terrain.setMinMAxHeight(0.0f, 256.0f);
-    terrain.loadTiles(Tiles);
+    terrain->setMinMAxHeight(0.0f, 256.0f);
+    std::shared_ptr<TerrainMaterial> terrainMaterial = std::make_shared<TerrainMaterial>();
+    terrainMaterial->Load(Tiles);
+    terrainMaterial->setHeightBands(0.0f, 256.0f);
+    terrainMaterial->setSlopeMaterial(1, 0.45f, 0.1f);     // tile2 on steep slopes
+    terrain->setMaterial(terrainMaterial);
+    // slider edits rebuild the terrain on the thread pool, the result is swapped in between frames
+    TerrainRegenerator terrainRegenerator;
+    // noise + erosion on the GPU, read back asynchronously and handed to terrainRegenerator
+    HeightmapSynthesizer heightmapSynth;
+    heightmapSynth.Init();
+    // streams a large tiled heightmap in place of the generated terrain when one is present
+    PagedTerrain pagedTerrain;
+    pagedTerrain.setTexScale(4.0f);
+    pagedTerrain.setVertexFormat(TERRAIN_VERTEX_COMPACT);
+    pagedTerrain.setCompactIndices(true);
+    bool usePagedTerrain = pagedTerrain.Open("..\\asserts\\others\\world.qghm", 2.0f, 513, 33, (size_t)512 << 20);
+    if (usePagedTerrain) pagedTerrain.loadTiles(Tiles);
     Shader terrainNormal("..\\asserts\\shaders\\tn.vs", "..\\asserts\\shaders\\tn.fs", "..\\asserts\\shaders\\tn.gs");
 
+    // terrain collision in the terrain's world placement, stepped off the main thread
+    PhysicsWorld physicsWorld;
+    physicsWorld.Init();
+    if (!usePagedTerrain) physicsWorld.SetTerrain(terrain.get(), glm::vec3(-512.0f, -300.0f, -512.0f));
+    // regenerated terrains bring their heightfield, only the body swap is left for the main thread
+    terrainRegenerator.setBuildHeightField(!usePagedTerrain, glm::vec3(-512.0f, -300.0f, -512.0f));
+
     printf("Camera: %f %f\n", camera.getPos()[0], camera.getPos()[2]);
-    printf("Terrain: %f %f\n", terrain.getCenterPos()[0], terrain.getCenterPos()[1]);
-    printf("Terrain's WorldScale: %f\n", terrain.GetWorldScale());
+    printf("Terrain: %f %f\n", terrain->getCenterPos()[0], terrain->getCenterPos()[1]);
+    printf("Terrain's WorldScale: %f\n", terrain->GetWorldScale());
     #endif
 
 	LARGE_INTEGER	qwTicksPerSec = { 0, 0 };
@@ -184,6 +225,33 @@ int main() {
         lastFrame = currentFrame;
         processInput(window);
 
+        // terrain LOD selection and culling run on a worker while the rest of the scene is drawn
+        glm::mat4 terrainProjection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 5000.0f);
+        glm::mat4 terrainModel = glm::translate(glm::mat4(1.0f), glm::vec3(-512.0f, -300.0f, -512.0f));
+        glm::vec3 terrainCameraPos = camera.getPos() + glm::vec3(512.0f, 300.0f, 512.0f);   // Terrain'Local Space
+        static float terrainPixelError = 2.0f;
+        Array2d<float> synthesized;
+        if (heightmapSynth.PollReadback(synthesized)) terrainRegenerator.Request(*terrain, std::move(synthesized), 33);
+        std::unique_ptr<Terrain> regenerated = terrainRegenerator.Update((size_t)4 << 20);
+        if (regenerated) {
+            terrain->destroy();
+            terrain = std::move(regenerated);
+            JPH::ShapeRefC heightField = terrainRegenerator.takeHeightField();
+            if (heightField != nullptr) physicsWorld.SetTerrainShape(heightField);
+        }
+        static float terrainPixelsPerEdge = 8.0f;
+        static float terrainLodDistance = 0.0f;
+        terrainLodDistance = std::max(terrainLodDistance, terrain->getCdlodMinLodDistance());
+        terrain->setScreenErrorParams(terrainPixelError, glm::radians(camera.fov), (float)SCR_HEIGHT);
+        terrain->setTessParams(terrainPixelsPerEdge, glm::radians(camera.fov), (float)SCR_HEIGHT);
+        terrain->setCdlodParams(terrainLodDistance);
+        if (usePagedTerrain) {
+            pagedTerrain.Update(terrainCameraPos);
+        } else if (terrainPath == 0) {
+            terrain->PrepareDraw(terrainCameraPos, terrainProjection * camera.GetViewMatrix() * terrainModel);
+        }
+        physicsWorld.Update(deltaTime);
+
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
@@ -250,23 +318,39 @@ int main() {
         terrainShader.use();
         view = camera.GetViewMatrix();
         terrainShader.setMat4("view", view);
-        projection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 5000.0f);
+        projection = terrainProjection;
         terrainShader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-512.0f, -300.0f, -512.0f)); 
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
+        model = terrainModel;
         terrainShader.setMat4("model", model);
         static float foo = 0.0f;
         foo += 0.002f;
         float y = std::min(-0.4f, cosf(foo));
         glm::vec3 LightDir(sinf(foo * 5.0f), -y, cosf(foo * 5.0f));
         terrainShader.setVec3("gReversedLightDir", LightDir);
-        terrain.Draw(terrainShader, camera.getPos() + glm::vec3(512.0f, 300.0f, 512.0f));  // Terrain'Local Space
+        if (usePagedTerrain) {
+            pagedTerrain.Draw(terrainShader, terrainCameraPos, projection * view * model, model);
+        } else if (terrainPath == 1) {
+            terrainTessShader.use();
+            terrainTessShader.setMat4("view", view);
+            terrainTessShader.setMat4("projection", projection);
+            terrainTessShader.setMat4("model", model);
+            terrainTessShader.setVec3("gReversedLightDir", LightDir);
+            terrain->DrawTessellated(terrainTessShader, terrainCameraPos, projection * view * model);
+        } else if (terrainPath == 2) {
+            terrainCdlodShader.use();
+            terrainCdlodShader.setMat4("view", view);
+            terrainCdlodShader.setMat4("projection", projection);
+            terrainCdlodShader.setMat4("model", model);
+            terrainCdlodShader.setVec3("gReversedLightDir", LightDir);
+            terrain->DrawCdlod(terrainCdlodShader, terrainCameraPos, projection * view * model);
+        } else {
+            terrain->Draw(terrainShader, terrainCameraPos, projection * view * model);
+        }
         terrainNormal.use();
         terrainNormal.setMat4("model", model);  
         terrainNormal.setMat4("view", view);
         terrainNormal.setMat4("projection", projection);
-        // terrain.Draw(terrainNormal, camera.getPos() + glm::vec3(512.0f, 300.0f, 512.0f));
+        // terrain->Draw(terrainNormal, camera.getPos() + glm::vec3(512.0f, 300.0f, 512.0f), projection * view * model);
         #endif 
 
         if (m_showImgui) {
@@ -277,8 +361,45 @@ int main() {
             static float maxHeight = 256.0f;
             static float Roughness = 1.0f;
             ImGui::Begin("Terrain"); 
-            ImGui::SliderFloat("MaxHeight", &maxHeight, 0.0f, 1000.0f);
-            ImGui::SliderFloat("Roughness", &Roughness, 0.0f, 1.0f);
+            static int Seed = 0;
+            bool Regenerate = ImGui::SliderFloat("MaxHeight", &maxHeight, 0.0f, 1000.0f);
+            Regenerate |= ImGui::SliderFloat("Roughness", &Roughness, 0.0f, 1.0f);
+            if (ImGui::Button("Generate")) {
+                Seed++;
+                Regenerate = true;
+            }
+            if (Regenerate) {
+                TerrainGenParams Params;
+                Params.Roughness = Roughness;
+                Params.MaxHeight = maxHeight;
+                Params.Seed = (uint32_t)Seed;
+                terrainRegenerator.Request(*terrain, Params);
+            }
+            if (terrainRegenerator.IsBusy()) ImGui::Text("Regenerating...");
+
+            static HeightSynthParams SynthParams;
+            ImGui::SliderInt("Octaves", &SynthParams.Octaves, 1, 12);
+            ImGui::SliderFloat("Ridged", &SynthParams.Ridged, 0.0f, 1.0f);
+            ImGui::SliderInt("Thermal iterations", &SynthParams.ThermalIterations, 0, 500);
+            ImGui::SliderFloat("Talus", &SynthParams.Talus, 0.05f, 2.0f);
+            if (ImGui::Button("Generate on GPU")) {
+                SynthParams.Seed = (uint32_t)++Seed;
+                SynthParams.MaxHeight = maxHeight;
+                heightmapSynth.Generate(SynthParams);
+                heightmapSynth.RequestReadback();
+            }
+            ImGui::Text("GPU synthesis %.2f ms", heightmapSynth.getGpuMilliseconds());
+            static bool CpuOcean = false;
+            if (ImGui::Checkbox("CPU ocean simulation", &CpuOcean)) ocean.setCpuSimulation(CpuOcean);
+            // a boat's worth of buoyancy probes, from last frame's waves
+            static std::vector<glm::vec2> OceanProbes;
+            static std::vector<float> OceanProbeHeights;
+            if (OceanProbes.empty()) {
+                for (int i = 0; i < 256; i++) OceanProbes.push_back(glm::vec2((float)(i % 16) * 0.5f, (float)(i / 16) * 0.5f));
+            }
+            if (ocean.QueryHeights(OceanProbes, OceanProbeHeights)) {
+                ImGui::Text("Ocean probes: height %.2f m at (0, 0), snapshot t = %.2f s", OceanProbeHeights[0], ocean.getSnapshotTime());
+            }
 
             static float Height0 = 64.0f;
             static float Height1 = 128.0f;
@@ -290,16 +411,43 @@ int main() {
             ImGui::SliderFloat("Height3", &Height3, 192.0f, 256.0f);
 
             /*
-            if (ImGui::Button("Generate")) {
-                terrain.destroy();
-                int Size = 513;
-                float MinHeight = 0.0f;
-                terrain.CreateMidpointDisplacement(Size, 33, Roughness, MinHeight, maxHeight);
-            }
             if (ImGui::Button("Save")) {
-                terrain.saveHeightMap("..\\asserts\\others\\heightmap.save");
+                terrain->saveHeightMap("..\\asserts\\others\\heightmap.save");
             }*/
 
+            static bool HorizonCulling = false;
+            if (ImGui::Checkbox("Horizon culling", &HorizonCulling))
+                terrain->setHorizonCulling(HorizonCulling);
+            static bool ScreenErrorLod = false;
+            if (ImGui::Checkbox("Screen-space error LOD", &ScreenErrorLod))
+                terrain->setLodMode(ScreenErrorLod ? LOD_MODE_SCREEN_ERROR : LOD_MODE_DISTANCE);
+            ImGui::SliderFloat("Pixel error", &terrainPixelError, 0.5f, 16.0f);
+            // A/B against the GeoMipGrid path, compare the frame time below
+            ImGui::RadioButton("GeoMipGrid", &terrainPath, 0); ImGui::SameLine();
+            ImGui::RadioButton("GPU tessellation", &terrainPath, 1); ImGui::SameLine();
+            ImGui::RadioButton("CDLOD", &terrainPath, 2);
+            ImGui::SliderFloat("Pixels per edge", &terrainPixelsPerEdge, 2.0f, 32.0f);
+            ImGui::SliderFloat("CDLOD LOD 0 distance", &terrainLodDistance, terrain->getCdlodMinLodDistance(),
+                               4.0f * terrain->getCdlodMinLodDistance());
+            if (terrainPath == 1) ImGui::Text("Tessellation patches %d", terrain->getNumTessPatches());
+            if (terrainPath == 2) ImGui::Text("CDLOD nodes %d, visited %d", terrain->getNumCdlodNodes(), terrain->getNumCdlodNodesVisited());
+            ImGui::Text("Patches drawn %d, culled %d", terrain->getNumDrawnPatches(), terrain->getNumCulledPatches());
+            ImGui::Text("LOD patches touched %d", terrain->getNumLodPatchesTouched());
+            ImGui::Text("Index bytes saved %zu", terrain->getIndexBytesSaved());
+            if (ImGui::Button("Drop bodies")) {
+                glm::vec3 Center = camera.getPos() + glm::vec3(0.0f, 20.0f, 0.0f);
+                for (int i = 0; i < 256; i++) {
+                    glm::vec3 Pos = Center + glm::vec3((i % 16) * 2.0f - 16.0f, (i & 3) * 2.0f, (i / 16) * 2.0f - 16.0f);
+                    physicsWorld.AddSphere(Pos, 0.5f);
+                }
+            }
+            ImGui::Text("Physics bodies %d (active %d), step %.3f ms on %u threads", physicsWorld.getNumBodies(),
+                physicsWorld.getNumActiveBodies(), physicsWorld.getStepMilliseconds(), physicsWorld.getNumThreads());
+            if (usePagedTerrain) {
+                ImGui::Text("Paged tiles resident %d (%zu MB), pending %d", pagedTerrain.getNumResidentTiles(),
+                    pagedTerrain.getResidentBytes() >> 20, pagedTerrain.getNumPendingTiles());
+            }
+
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::End();
@@ -313,12 +461,15 @@ int main() {
     }
     #if 0
     // avoid affecting the pipeline
-    unsigned char* out = new unsigned char[DISP_MAP_SIZE * DISP_MAP_SIZE * 4];
+    int DispMapSize = ocean.getParams().DispMapSize;
+    unsigned char* out = new unsigned char[DispMapSize * DispMapSize * 4];
     glBindTexture(GL_TEXTURE_2D, ocean.getDisplacementID());
     glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, out);
-    stbi_write_png("ocean-displacement-map.png", DISP_MAP_SIZE, DISP_MAP_SIZE, 4, out, 0);
+    stbi_write_png("ocean-displacement-map.png", DispMapSize, DispMapSize, 4, out, 0);
     #endif
 
+    physicsWorld.Shutdown();
+    heightmapSynth.Destroy();
     glfwTerminate();
     return 0;
 }